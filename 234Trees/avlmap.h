@@ -8,18 +8,25 @@
 #ifndef AVLMAP_H
 #define AVLMAP_H
 
+#include <stdexcept>
 #include "map.h"
 #include "arrayseq.h"
+#include "nodepool.h"
+#include "versions.h"
 
 
-template<typename K, typename V>
-class AVLMap : public Map<K,V>
+// NodeAlloc supplies the tree nodes (see nodepool.h)
+template<typename K, typename V, template<typename> class NodeAlloc = HeapAlloc>
+class AVLMap final : public Map<K,V>
 {
 public:
 
   // default constructor
   AVLMap();
 
+  // bulk-load constructor (see bulk_load)
+  AVLMap(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
   // copy constructor
   AVLMap(const AVLMap& rhs);
 
@@ -53,6 +60,16 @@ public:
   // Expects key to not exist in map prior to insertion.
   void insert(const K& key, const V& value);
 
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection, in which case args are left unused.
+  // Returns true if the key was added. Takes one descent (two while
+  // a published version shares the tree).
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -62,6 +79,15 @@ public:
   // Returns true if the key is in the collection, and false otherwise.
   bool contains(const K& key) const;
 
+  // Returns whether each of the keys is in the collection. The keys
+  // are searched for a group at a time, with the group's searches
+  // stepping down the tree together so their cache misses overlap.
+  ArraySeq<bool> contains_many(const ArraySeq<K>& keys) const;
+
+  // Returns the values of the keys, looked up as in contains_many.
+  // Throws out_of_range if any key is not in the collection.
+  ArraySeq<V> get_many(const ArraySeq<K>& keys) const;
+
   // Returns the keys k in the collection such that k1 <= k <= k2
   ArraySeq<K> find_keys(const K& k1, const K& k2) const;
 
@@ -81,9 +107,49 @@ public:
   // Removes all key-value pairs from the map.
   void clear();
 
+  // Returns a cursor over the keys k such that k1 <= k <= k2 in
+  // ascending order, walking the tree as the cursor advances
+  KeyRange<K> key_range(const K& k1, const K& k2) const;
+
+  // Returns a cursor over all keys in ascending order
+  KeyRange<K> keys() const;
+
+  // Replaces the contents of the map with the given key-value pairs,
+  // which must be in strictly ascending key order, building a
+  // balanced tree in linear time. Throws invalid_argument if the keys
+  // are not sorted.
+  void bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
   // Returns the height of the binary search tree
   int height() const;
 
+  // Returns the node allocation counters
+  const AllocStats& alloc_stats() const;
+
+  // Turns persistent mode on or off. While on, a change never touches
+  // a node that a published version can reach: it copies the path
+  // down to the change and publishes the new root, so snapshots taken
+  // by other threads stay valid. One thread may change the map while
+  // any number take snapshots.
+  void persistent(bool on);
+
+  // Returns true if the map is in persistent mode
+  bool persistent() const;
+
+  // Publishes the current contents to new snapshots. Persistent mode
+  // publishes after each insert, erase, clear, and bulk_load, but not
+  // after a value is updated through operator[].
+  void publish();
+
+  // read-only view of one published version (defined below)
+  class Snapshot;
+
+  // Returns a view of the last published version. Lock-free, and safe
+  // to call from any thread while the writer works. Throws
+  // logic_error if nothing is published (persistent mode is off). A
+  // snapshot must not outlive its map.
+  Snapshot snapshot() const;
+
   // helper to print the tree for debugging
   void print() const;
 
@@ -94,6 +160,11 @@ private:
     K key;
     V value;
     int height;
+    // parents (and published versions) pointing at the node beyond
+    // the first. Only the writer reads or changes it; the working tree
+    // may change a node in place only while it is 0. (It fills the
+    // padding after height.)
+    int shares = 0;
     Node* left;
     Node* right;
   };
@@ -104,14 +175,72 @@ private:
   // array of linked lists
   Node* root = nullptr;
 
-  // clean up the tree and reset count to zero given subtree root
+  // allocator for the tree nodes
+  NodeAlloc<Node> alloc;
+
+  // true if each change is published (see persistent)
+  bool path_copying = false;
+
+  // versions published for snapshots
+  Versions<Node> versions;
+
+  // in-order cursor from a lower bound up to an (optional) upper
+  // bound. The stack holds the nodes whose key and right subtree are
+  // still to be visited, with the current node on top.
+  class Cursor : public KeyCursor<K>
+  {
+  public:
+    Cursor(const Node* st_root, const K* k1, const K* k2);
+    bool valid() const;
+    const K& key() const;
+    void next();
+  private:
+    ArraySeq<const Node*> stack;
+    bool bounded = false;
+    K last;
+  };
+
+  // clean up the tree and reset count to zero given subtree root.
+  // Nodes still shared with a published version only lose a
+  // reference.
   void clear(Node* st_root);
 
+  // clear without publishing the empty tree
+  void clear_tree();
+
+  // returns node if only the working tree uses it, and otherwise a
+  // copy the caller links in its place
+  Node* own(Node* node)
+  {
+    return node -> shares == 0 ? node : unshare(node);
+  }
+
+  // own's copy of a node shared with a published version
+  Node* unshare(Node* node);
+
+  // frees the versions no snapshot uses any more
+  void collect();
+
+  // returns the node holding key below st_root, or nullptr
+  static const Node* find_node(const Node* st_root, const K& key);
+
   // copy assignment helper
-  Node* copy(const Node* rhs_st_root) const;
+  Node* copy(const Node* rhs_st_root);
+
+  // bulk_load helper: builds a subtree from pairs start to end
+  Node* build(const ArraySeq<std::pair<K,V>>& pairs, int start, int end);
+
+  // insert helper, forwarding key and value into the new leaf
+  template<typename KK, typename VV>
+  Node* insert(KK&& key, VV&& value, Node* st_root);
+
+  // try_emplace helper: adds key with a value built from args unless
+  // the subtree holds it, setting added if it was added
+  template<typename... Args>
+  Node* emplace(const K& key, bool& added, Node* st_root, Args&&... args);
 
-  // insert helper
-  Node* insert(const K& key, const V& value, Node* st_root);
+  // sets the node's height from its children's
+  void update_height(Node* st_root);
   
   // erase helper
   Node* erase(const K& key, Node* st_root);
@@ -132,18 +261,68 @@ private:
 
   // print helper
   void print(std::string indent, const Node* st_root) const;
+
+  // number of batched searches stepped down the tree together
+  static const int PROBE_GROUP = 16;
+
+  // calls f(i, value) for each keys[i], with value nullptr if the key
+  // is not in the map
+  template<typename F>
+  void find_many(const ArraySeq<K>& keys, F f) const;
 };
 
 
-template<typename K, typename V>
-void AVLMap<K,V>::print() const
+// Holds a reference to one published version, so its nodes stay
+// alive (and unchanged) however the writer moves on
+template<typename K, typename V, template<typename> class NodeAlloc>
+class AVLMap<K,V,NodeAlloc>::Snapshot
+{
+public:
+
+  Snapshot(const Snapshot& rhs);
+  Snapshot(Snapshot&& rhs);
+  Snapshot& operator=(const Snapshot& rhs);
+  Snapshot& operator=(Snapshot&& rhs);
+  ~Snapshot();
+
+  // Returns the number of key-value pairs in the version
+  int size() const;
+
+  // Tests if the version is empty
+  bool empty() const;
+
+  // Returns true if the key is in the version, and false otherwise.
+  bool contains(const K& key) const;
+
+  // Returns the value for a given key. Throws out_of_range if the
+  // given key is not in the version.
+  const V& operator[](const K& key) const;
+
+  // Returns the keys in the version in ascending sorted order
+  ArraySeq<K> sorted_keys() const;
+
+private:
+
+  friend class AVLMap;
+
+  Snapshot(const AVLMap* map, typename Versions<Node>::Version* version);
+
+  const AVLMap* map;
+
+  typename Versions<Node>::Version* version;
+
+};
+
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::print() const
 {
   print(std::string(""), root);
 }
 
 
-template<typename K, typename V>
-void AVLMap<K,V>::print(std::string indent, const Node* st_root) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::print(std::string indent, const Node* st_root) const
 {
   if (!st_root)
     return;
@@ -159,87 +338,132 @@ void AVLMap<K,V>::print(std::string indent, const Node* st_root) const
 }
 
 
-template<typename K, typename V>
-AVLMap<K,V>::AVLMap()
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::AVLMap()
 {
 }
 
+// bulk-load constructor
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::AVLMap(const ArraySeq<std::pair<K,V>>& sorted_pairs)
+{
+  bulk_load(sorted_pairs);
+}
+
 // TODO: Finish the remaining functions below. Many of the functions
 // for this assignment can be taken from HW8. Note that for helper
 // functions that return Node*, you must include the template
 // information for the type, e.g.:
-//   template<typename K, typename V>
-//   typename AVLMap<K,V>::Node* AVLMap<K,V>::rotate_right(Node* k2)
+//   template<typename K, typename V, template<typename> class NodeAlloc>
+//   typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::rotate_right(Node* k2)
 
 
 
 // copy constructor
-template<typename K, typename V>
-AVLMap<K,V>::AVLMap(const AVLMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::AVLMap(const AVLMap& rhs)
 {
   *this = rhs;
 }
 
 // move constructor
-template<typename K, typename V>
-AVLMap<K,V>::AVLMap(AVLMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::AVLMap(AVLMap&& rhs)
 {
   *this = std::move(rhs);
 }
 
 // copy assignment
-template<typename K, typename V>
-AVLMap<K,V>& AVLMap<K,V>::operator=(const AVLMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>& AVLMap<K,V,NodeAlloc>::operator=(const AVLMap& rhs)
 {
   if(this != &rhs)
   {
-    clear();
+    clear_tree();
     root = copy(rhs.root);
     count = rhs.count;
+    if(path_copying)
+    {
+      publish();
+    }
   }
+  return *this;
 }
 
 // move assignment
-template<typename K, typename V>
-AVLMap<K,V>& AVLMap<K,V>::operator=(AVLMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>& AVLMap<K,V,NodeAlloc>::operator=(AVLMap&& rhs)
 {
+  // published nodes have to stay with the allocator (and versions)
+  // that made them, so such a map is copied instead
   if(this != &rhs)
   {
-    clear();
-    root = rhs.root;
-    count = rhs.count;
-    rhs.root = nullptr;
-    rhs.count = 0;
-    return *this;
+    if(versions.live() > 0 || rhs.versions.live() > 0)
+    {
+      *this = rhs;
+      rhs.clear();
+    }
+    else
+    {
+      clear();
+      root = rhs.root;
+      count = rhs.count;
+      alloc.swap(rhs.alloc);
+      rhs.root = nullptr;
+      rhs.count = 0;
+    }
   }
+  return *this;
 } 
 
 // destructor
-template<typename K, typename V>
-AVLMap<K,V>::~AVLMap()
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::~AVLMap()
 {
-  clear();
+  versions.withdraw();
+  collect();
+  clear_tree();
 }
 
 // Returns the number of key-value pairs in the map
-template<typename K, typename V>
-int AVLMap<K,V>::size() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+int AVLMap<K,V,NodeAlloc>::size() const
 {
   return count;
 }
 
 // Tests if the map is empty
-template<typename K, typename V>
-bool AVLMap<K,V>::empty() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::empty() const
 {
   return count == 0;
 }
 
 // Allows values associated with a key to be updated. Throws
 // out_of_range if the given key is not in the collection.
-template<typename K, typename V>
-V& AVLMap<K,V>::operator[](const K& key)
+template<typename K, typename V, template<typename> class NodeAlloc>
+V& AVLMap<K,V,NodeAlloc>::operator[](const K& key)
 {
+  collect();
+  // the update must not show through a published version, so the
+  // path down to the key is made the working tree's own first
+  if(versions.live() > 0 && contains(key))
+  {
+    root = own(root);
+    Node* temp = root;
+    while(!(temp -> key == key))
+    {
+      if(key < temp -> key)
+      {
+        temp = temp -> left = own(temp -> left);
+      }
+      else
+      {
+        temp = temp -> right = own(temp -> right);
+      }
+    }
+    return temp -> value;
+  }
   if(root == nullptr)
   {
     throw(std::out_of_range("BSTMap<K,V>::operator[](const K& key)"));
@@ -268,8 +492,8 @@ V& AVLMap<K,V>::operator[](const K& key)
 
 // Returns the value for a given key. Throws out_of_range if the
 // given key is not in the collection. 
-template<typename K, typename V>
-const V& AVLMap<K,V>::operator[](const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+const V& AVLMap<K,V,NodeAlloc>::operator[](const K& key) const
 {
   if(root == nullptr)
   {
@@ -299,25 +523,75 @@ const V& AVLMap<K,V>::operator[](const K& key) const
 
 // Extends the collection by adding the given key-value pair.
 // Expects key to not exist in map prior to insertion.
-template<typename K, typename V>
-void AVLMap<K,V>::insert(const K& key, const V& value)//////////////////////////////////skipped
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::insert(const K& key, const V& value)//////////////////////////////////skipped
 {
+  collect();
   root = insert(key, value, root);
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::insert(K&& key, V&& value)
+{
+  collect();
+  root = insert(std::move(key), std::move(value), root);
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+// Adds the key with a value constructed from args unless the key is
+// already in the collection
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename... Args>
+bool AVLMap<K,V,NodeAlloc>::try_emplace(const K& key, Args&&... args)
+{
+  collect();
+  // as in erase, a shared path is only copied once the key is known
+  // to be missing
+  if(versions.live() > 0 && contains(key))
+  {
+    return false;
+  }
+  bool added = false;
+  root = emplace(key, added, root, std::forward<Args>(args)...);
+  if(added && path_copying)
+  {
+    publish();
+  }
+  return added;
 }
 
 // Shrinks the collection by removing the key-value pair with the
 // given key. Does not modify the collection if the collection does
 // not contain the key. Throws out_of_range if the given key is not
 // in the collection.
-template<typename K, typename V>
-void AVLMap<K,V>::erase(const K& key)//////////////////////////////////skipped
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::erase(const K& key)//////////////////////////////////skipped
 {
+  collect();
+  // a throw part way down would leave copied nodes unlinked, so a
+  // missing key is caught before any are made
+  if(versions.live() > 0 && !contains(key))
+  {
+    throw(std::out_of_range("AVLMap<K,V>::erase(const K& key)"));
+  }
   root = erase(key,root);
+  if(path_copying)
+  {
+    publish();
+  }
 }
 
 // Returns true if the key is in the collection, and false otherwise.
-template<typename K, typename V>
-bool AVLMap<K,V>::contains(const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::contains(const K& key) const
 {
   if(root == nullptr)
   {
@@ -345,9 +619,44 @@ bool AVLMap<K,V>::contains(const K& key) const
   return false;
 }
 
+// Returns whether each of the keys is in the collection
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<bool> AVLMap<K,V,NodeAlloc>::contains_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<bool> found;
+  for(int i = 0; i < keys.size(); i++)
+  {
+    found.insert(false, i);
+  }
+  find_many(keys, [&](int i, const V* value) {
+    found[i] = value != nullptr;
+  });
+  return found;
+}
+
+// Returns the values of the keys. Throws out_of_range if any key is
+// not in the collection.
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<V> AVLMap<K,V,NodeAlloc>::get_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<V> values;
+  for(int i = 0; i < keys.size(); i++)
+  {
+    values.insert(V(), i);
+  }
+  find_many(keys, [&](int i, const V* value) {
+    if(value == nullptr)
+    {
+      throw(std::out_of_range("AVLMap<K,V>::get_many(const ArraySeq<K>&)"));
+    }
+    values[i] = *value;
+  });
+  return values;
+}
+
 // Returns the keys k in the collection such that k1 <= k <= k2
-template<typename K, typename V>
-ArraySeq<K> AVLMap<K,V>::find_keys(const K& k1, const K& k2) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<K> AVLMap<K,V,NodeAlloc>::find_keys(const K& k1, const K& k2) const
 {
   ArraySeq<K> keys;
   find_keys(k1,k2,root,keys);
@@ -355,8 +664,8 @@ ArraySeq<K> AVLMap<K,V>::find_keys(const K& k1, const K& k2) const
 }
 
 // Returns the keys in the collection in ascending sorted order
-template<typename K, typename V>
-ArraySeq<K> AVLMap<K,V>::sorted_keys() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<K> AVLMap<K,V,NodeAlloc>::sorted_keys() const
 {
   ArraySeq<K> keys;
   sorted_keys(root, keys);
@@ -366,8 +675,8 @@ ArraySeq<K> AVLMap<K,V>::sorted_keys() const
 // Gives the key (as an ouptput parameter) immediately after the
 // given key according to ascending sort order. Returns true if a
 // successor key exists, and false otherwise.
-template<typename K, typename V>
-bool AVLMap<K,V>::next_key(const K& key, K& next_key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::next_key(const K& key, K& next_key) const
 {
   if(root == nullptr)
   {
@@ -424,8 +733,8 @@ bool AVLMap<K,V>::next_key(const K& key, K& next_key) const
 // Gives the key (as an ouptput parameter) immediately before the
 // given key according to ascending sort order. Returns true if a
 // predecessor key exists, and false otherwise.
-template<typename K, typename V>
-bool AVLMap<K,V>::prev_key(const K& key, K& prev_key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::prev_key(const K& key, K& prev_key) const
 {
   if(root == nullptr)
   {
@@ -480,15 +789,129 @@ bool AVLMap<K,V>::prev_key(const K& key, K& prev_key) const
 }
 
 // Removes all key-value pairs from the map.
-template<typename K, typename V>
-void AVLMap<K,V>::clear()
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::clear()
+{
+  clear_tree();
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+// a pool can drop all of its nodes at once, unless a version still
+// uses some of them
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::clear_tree()
+{
+  collect();
+  if(!NodeAlloc<Node>::bulk_release || versions.live() > 0)
+  {
+    clear(root);
+  }
+  if(versions.live() == 0)
+  {
+    alloc.release_all();
+  }
+  root = nullptr;
+  count = 0;
+}
+
+// Returns a cursor over the keys in [k1, k2]
+template<typename K, typename V, template<typename> class NodeAlloc>
+KeyRange<K> AVLMap<K,V,NodeAlloc>::key_range(const K& k1, const K& k2) const
 {
-  clear(root);
+  return KeyRange<K>(new Cursor(root, &k1, &k2));
+}
+
+// Returns a cursor over all keys
+template<typename K, typename V, template<typename> class NodeAlloc>
+KeyRange<K> AVLMap<K,V,NodeAlloc>::keys() const
+{
+  return KeyRange<K>(new Cursor(root, nullptr, nullptr));
+}
+
+// descends to the smallest key >= k1, stacking each node whose key
+// is in range on the way down
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::Cursor::Cursor(const Node* st_root, const K* k1, const K* k2)
+{
+  if(k2 != nullptr)
+  {
+    bounded = true;
+    last = *k2;
+  }
+  while(st_root != nullptr)
+  {
+    if(k1 != nullptr && st_root -> key < *k1)
+    {
+      st_root = st_root -> right;
+    }
+    else
+    {
+      stack.insert(st_root, stack.size());
+      st_root = st_root -> left;
+    }
+  }
+}
+
+// cursor is at a key unless the stack is empty or past k2
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::Cursor::valid() const
+{
+  if(stack.empty())
+  {
+    return false;
+  }
+  return !bounded || !(last < stack[stack.size() - 1] -> key);
+}
+
+// the key of the node on top of the stack
+template<typename K, typename V, template<typename> class NodeAlloc>
+const K& AVLMap<K,V,NodeAlloc>::Cursor::key() const
+{
+  return stack[stack.size() - 1] -> key;
+}
+
+// pops the current node and stacks the left spine of its right
+// subtree
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::Cursor::next()
+{
+  const Node* temp = stack[stack.size() - 1] -> right;
+  stack.erase(stack.size() - 1);
+  while(temp != nullptr)
+  {
+    stack.insert(temp, stack.size());
+    temp = temp -> left;
+  }
+}
+
+// Replaces the contents with the sorted key-value pairs
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs)
+{
+  for(int i = 1; i < sorted_pairs.size(); i++)
+  {
+    if(!(sorted_pairs[i - 1].first < sorted_pairs[i].first))
+    {
+      throw(std::invalid_argument("AVLMap<K,V>::bulk_load(const ArraySeq<std::pair<K,V>>&)"));
+    }
+  }
+  // snapshots keep seeing the old contents until the new tree is
+  // published
+  clear_tree();
+  root = build(sorted_pairs, 0, sorted_pairs.size() - 1);
+  count = sorted_pairs.size();
+  if(path_copying)
+  {
+    publish();
+  }
 }
 
 // Returns the height of the binary search tree
-template<typename K, typename V>
-int AVLMap<K,V>::height() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+int AVLMap<K,V,NodeAlloc>::height() const
 {
   if(root != nullptr)
   {
@@ -497,21 +920,230 @@ int AVLMap<K,V>::height() const
   return 0;
 }
 
+// Returns the node allocation counters
+template<typename K, typename V, template<typename> class NodeAlloc>
+const AllocStats& AVLMap<K,V,NodeAlloc>::alloc_stats() const
+{
+  return alloc.stats();
+}
+
+// Turns persistent mode on or off
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::persistent(bool on)
+{
+  path_copying = on;
+  if(on)
+  {
+    publish();
+  }
+  else
+  {
+    // snapshots already taken keep their versions
+    versions.withdraw();
+    collect();
+  }
+}
+
+// Returns true if the map is in persistent mode
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::persistent() const
+{
+  return path_copying;
+}
+
+// the version's reference to the root makes the working tree copy
+// the root (and so the path) on its next change
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::publish()
+{
+  if(root != nullptr)
+  {
+    root -> shares++;
+  }
+  versions.publish(root, count);
+  collect();
+}
+
+// Returns a view of the last published version
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Snapshot AVLMap<K,V,NodeAlloc>::snapshot() const
+{
+  typename Versions<Node>::Version* version = versions.acquire();
+  if(version == nullptr)
+  {
+    throw(std::logic_error("AVLMap<K,V>::snapshot()"));
+  }
+  return Snapshot(this, version);
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::Snapshot::Snapshot(const AVLMap* map,
+                                          typename Versions<Node>::Version* version)
+  : map(map), version(version)
+{
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::Snapshot::Snapshot(const Snapshot& rhs)
+  : map(rhs.map), version(rhs.version)
+{
+  map -> versions.share(version);
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::Snapshot::Snapshot(Snapshot&& rhs)
+  : map(rhs.map), version(rhs.version)
+{
+  rhs.version = nullptr;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Snapshot& AVLMap<K,V,NodeAlloc>::Snapshot::operator=(const Snapshot& rhs)
+{
+  if(this != &rhs)
+  {
+    rhs.map -> versions.share(rhs.version);
+    if(version != nullptr)
+    {
+      map -> versions.release(version);
+    }
+    map = rhs.map;
+    version = rhs.version;
+  }
+  return *this;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Snapshot& AVLMap<K,V,NodeAlloc>::Snapshot::operator=(Snapshot&& rhs)
+{
+  if(this != &rhs)
+  {
+    if(version != nullptr)
+    {
+      map -> versions.release(version);
+    }
+    map = rhs.map;
+    version = rhs.version;
+    rhs.version = nullptr;
+  }
+  return *this;
+}
+
+// the writer frees the version once no other snapshot holds it
+template<typename K, typename V, template<typename> class NodeAlloc>
+AVLMap<K,V,NodeAlloc>::Snapshot::~Snapshot()
+{
+  if(version != nullptr)
+  {
+    map -> versions.release(version);
+  }
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+int AVLMap<K,V,NodeAlloc>::Snapshot::size() const
+{
+  return version -> count;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::Snapshot::empty() const
+{
+  return version -> count == 0;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool AVLMap<K,V,NodeAlloc>::Snapshot::contains(const K& key) const
+{
+  return find_node(version -> root, key) != nullptr;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+const V& AVLMap<K,V,NodeAlloc>::Snapshot::operator[](const K& key) const
+{
+  const Node* temp = find_node(version -> root, key);
+  if(temp == nullptr)
+  {
+    throw(std::out_of_range("AVLMap<K,V>::Snapshot::operator[](const K& key)"));
+  }
+  return temp -> value;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<K> AVLMap<K,V,NodeAlloc>::Snapshot::sorted_keys() const
+{
+  ArraySeq<K> keys;
+  map -> sorted_keys(version -> root, keys);
+  return keys;
+}
+
 // clear function
-template<typename K, typename V>
-void AVLMap<K,V>::clear(Node* st_root)
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::clear(Node* st_root)
 {
   if(st_root != nullptr)
   {
-    clear(st_root -> left);
-    clear(st_root -> right);
-    delete st_root;
+    if(st_root -> shares > 0)
+    {
+      // still part of another version (or the working tree)
+      st_root -> shares--;
+    }
+    else
+    {
+      clear(st_root -> left);
+      clear(st_root -> right);
+      alloc.destroy(st_root);
+    }
   }
 }
 
+// the copy takes over the caller's link to node, and adds links to
+// node's children
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::unshare(Node* node)
+{
+  Node* temp = alloc.make();
+  temp -> key = node -> key;
+  temp -> value = node -> value;
+  temp -> height = node -> height;
+  temp -> left = node -> left;
+  temp -> right = node -> right;
+  if(temp -> left != nullptr)
+  {
+    temp -> left -> shares++;
+  }
+  if(temp -> right != nullptr)
+  {
+    temp -> right -> shares++;
+  }
+  node -> shares--;
+  return temp;
+}
+
+// frees each unreferenced version's nodes that no other version (or
+// the working tree) shares. Every change calls it first, so versions
+// dropped after persistent mode is turned off are freed too.
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::collect()
+{
+  versions.collect([this](const Node* st_root) {
+    clear(const_cast<Node*>(st_root));
+  });
+}
+
+// search down from st_root
+template<typename K, typename V, template<typename> class NodeAlloc>
+const typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::find_node(const Node* st_root, const K& key)
+{
+  while(st_root != nullptr && !(st_root -> key == key))
+  {
+    st_root = key < st_root -> key ? st_root -> left : st_root -> right;
+  }
+  return st_root;
+}
+
 // copy assignment helper
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::copy(const Node* rhs_st_root) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::copy(const Node* rhs_st_root)
 {
   if(rhs_st_root == nullptr)
   {
@@ -519,39 +1151,113 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::copy(const Node* rhs_st_root) const
   }
   else
   {
-    Node* temp = new Node();
+    Node* temp = alloc.make();
     temp -> key = rhs_st_root -> key;
     temp -> value = rhs_st_root -> value;
+    temp -> height = rhs_st_root -> height;
     temp -> left = copy(rhs_st_root -> left);
     temp -> right = copy(rhs_st_root -> right);
     return temp;
   }
 }
 
-// insert helper
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::insert(const K& key, const V& value, Node* st_root)//////skipped
+// bulk_load helper: the middle pair becomes the subtree root
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::build(const ArraySeq<std::pair<K,V>>& pairs, int start, int end)
+{
+  if(start > end)
+  {
+    return nullptr;
+  }
+  int mid = (start + end) / 2;
+  Node* temp = alloc.make();
+  temp -> key = pairs[mid].first;
+  temp -> value = pairs[mid].second;
+  temp -> left = build(pairs, start, mid - 1);
+  temp -> right = build(pairs, mid + 1, end);
+  // the left half is never taller than the right half
+  temp -> height = 1;
+  if(temp -> right != nullptr)
+  {
+    temp -> height = 1 + temp -> right -> height;
+  }
+  return temp;
+}
+
+// insert helper. Only one branch uses key and value after the
+// comparisons, so each is forwarded once.
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename KK, typename VV>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::insert(KK&& key, VV&& value, Node* st_root)//////skipped
 {
   if (st_root == nullptr)
   {
     count++;
-    Node* node1 = new Node();
+    Node* node1 = alloc.make();
+    node1 -> key = std::forward<KK>(key);
+    node1 -> value = std::forward<VV>(value);
+    node1 -> left = nullptr;
+    node1 -> right = nullptr;
+    node1 -> height = 1;
+    return node1;
+  }
+  st_root = own(st_root);
+  if(key < st_root -> key)
+  {
+    st_root -> left = insert(std::forward<KK>(key), std::forward<VV>(value), st_root -> left);
+  }
+  else
+  {
+    st_root -> right = insert(std::forward<KK>(key), std::forward<VV>(value), st_root-> right);
+  }
+  update_height(st_root);
+  return rebalance(st_root);
+}
+
+// try_emplace helper. A subtree holding key is returned untouched;
+// try_emplace has already ruled that out when a version shares the
+// path, so owning nodes on the way down copies nothing needlessly.
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename... Args>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::emplace(const K& key, bool& added, Node* st_root, Args&&... args)
+{
+  if(st_root == nullptr)
+  {
+    added = true;
+    count++;
+    Node* node1 = alloc.make();
     node1 -> key = key;
-    node1 -> value = value;
+    node1 -> value = V(std::forward<Args>(args)...);
     node1 -> left = nullptr;
     node1 -> right = nullptr;
     node1 -> height = 1;
     return node1;
   }
-  else if(key < st_root -> key)
+  if(st_root -> key == key)
+  {
+    return st_root;
+  }
+  st_root = own(st_root);
+  if(key < st_root -> key)
   {
-    st_root -> left = insert(key, value, st_root -> left);
+    st_root -> left = emplace(key, added, st_root -> left, std::forward<Args>(args)...);
   }
   else
   {
-    st_root -> right = insert(key, value, st_root-> right);
+    st_root -> right = emplace(key, added, st_root -> right, std::forward<Args>(args)...);
   }
+  if(!added)
+  {
+    return st_root;
+  }
+  update_height(st_root);
+  return rebalance(st_root);
+}
 
+// height helper
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::update_height(Node* st_root)
+{
   //here we are checking the height
   if(st_root -> left == nullptr && st_root -> right == nullptr)
   {
@@ -579,18 +1285,18 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::insert(const K& key, const V& value, No
       }
     }
   }
-  return rebalance(st_root);
 }
 
 // erase helper
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::erase(const K& key, Node* st_root)//////skipped
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::erase(const K& key, Node* st_root)//////skipped
 {
   
   if(st_root == nullptr)
   {
     throw(std::out_of_range("BSTMap<K,V>::erase(const K& key)"));
   }
+  st_root = own(st_root);
   if(key < st_root -> key)
   {
     st_root -> left = erase(key, st_root -> left);
@@ -606,14 +1312,14 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::erase(const K& key, Node* st_root)/////
     if(st_root -> left == nullptr)
     {
       temp = st_root -> right;
-      delete st_root;
+      alloc.destroy(st_root);
       count--;
       return temp;
     }
     else if(st_root -> right == nullptr)
     {
       temp = st_root -> left;
-      delete st_root;
+      alloc.destroy(st_root);
       count--;
       return temp;
     }
@@ -626,7 +1332,7 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::erase(const K& key, Node* st_root)/////
         temp = temp -> left;
       }
       st_root -> key = temp -> key;
-      st_root -> value = st_root -> value;
+      st_root -> value = temp -> value;
       st_root -> right = erase(temp -> key, st_root -> right);
     }
   }
@@ -660,9 +1366,68 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::erase(const K& key, Node* st_root)/////
   return rebalance(st_root);
 }
 
+// each round moves every unfinished search in the group down one
+// level and prefetches the node it lands on, so the group's next
+// round finds its nodes already on the way in
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename F>
+void AVLMap<K,V,NodeAlloc>::find_many(const ArraySeq<K>& keys, F f) const
+{
+  if(root == nullptr)
+  {
+    for(int i = 0; i < keys.size(); i++)
+    {
+      f(i, nullptr);
+    }
+    return;
+  }
+  const K* group_keys[PROBE_GROUP];
+  const Node* nodes[PROBE_GROUP];
+  for(int start = 0; start < keys.size(); start += PROBE_GROUP)
+  {
+    int n = keys.size() - start < PROBE_GROUP ? keys.size() - start : PROBE_GROUP;
+    for(int i = 0; i < n; i++)
+    {
+      group_keys[i] = &keys[start + i];
+      nodes[i] = root;
+    }
+    int active = n;
+    while(active > 0)
+    {
+      active = 0;
+      for(int i = 0; i < n; i++)
+      {
+        const Node* temp = nodes[i];
+        if(temp == nullptr)
+        {
+          continue;
+        }
+        const K& key = *group_keys[i];
+        if(temp -> key == key)
+        {
+          f(start + i, &temp -> value);
+          nodes[i] = nullptr;
+          continue;
+        }
+        temp = key < temp -> key ? temp -> left : temp -> right;
+        nodes[i] = temp;
+        if(temp == nullptr)
+        {
+          f(start + i, nullptr);
+        }
+        else
+        {
+          __builtin_prefetch(temp);
+          active++;
+        }
+      }
+    }
+  }
+}
+
 // find_keys helper
-template<typename K, typename V>
-void AVLMap<K,V>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
 {
   if(st_root != nullptr)
   {
@@ -697,8 +1462,8 @@ void AVLMap<K,V>::find_keys(const K& k1, const K& k2, const Node* st_root, Array
 }
 
 // sorted_keys helper
-template<typename K, typename V>
-void AVLMap<K,V>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+void AVLMap<K,V,NodeAlloc>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
 {
   if(st_root != nullptr)
   {
@@ -709,10 +1474,13 @@ void AVLMap<K,V>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
 }
 
 // rotations
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::rotate_right(Node* k2)//////////skipped
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::rotate_right(Node* k2)//////////skipped
 {
-  Node* k1 = k2 -> left;
+  // a rebalance after an erase can rotate a sibling subtree that is
+  // still shared with a published version
+  k2 = own(k2);
+  Node* k1 = own(k2 -> left);
   k2 -> left = k1 -> right;
   k1 -> right = k2;
   if(k2 -> left == nullptr && k2 -> right == nullptr)
@@ -771,10 +1539,11 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::rotate_right(Node* k2)//////////skipped
   return k1;
 }
 
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::rotate_left(Node* k2)//////////skipped
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::rotate_left(Node* k2)//////////skipped
 {
-  Node* k1 = k2 -> right;
+  k2 = own(k2);
+  Node* k1 = own(k2 -> right);
   k2 -> right = k1 -> left;
   k1 -> left = k2;
   if(k2 -> left == nullptr && k2 -> right == nullptr)
@@ -835,8 +1604,8 @@ typename AVLMap<K,V>::Node* AVLMap<K,V>::rotate_left(Node* k2)//////////skipped
 }
 
 // rebalance
-template<typename K, typename V>
-typename AVLMap<K,V>::Node* AVLMap<K,V>::rebalance(Node* st_root)
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename AVLMap<K,V,NodeAlloc>::Node* AVLMap<K,V,NodeAlloc>::rebalance(Node* st_root)
 {
   
   if(st_root == nullptr)
@@ -2,25 +2,39 @@
 // NAME: Samuel Sovi
 // FILE: btreemap.h
 // DATE: Spring 2022
-// DESC: Map implementation using a 2-3-4 B-Tree 
+// DESC: Map implementation using a B-Tree of the given (even) order,
+//       where order is the maximum number of children per node. The
+//       default order of 4 gives a 2-3-4 tree. Each node stores its
+//       keys, values, and child pointers in fixed inline arrays, so a
+//       node visit is a single pointer chase.
 //---------------------------------------------------------------------------
 
 #ifndef BTreeMAP_H
 #define BTreeMAP_H
 
+#include <iostream>
+#include <stdexcept>
+#include <string>
 #include "map.h"
 #include "arrayseq.h"
+#include "versions.h"
 
 
 
-template<typename K, typename V>
-class BTreeMap : public Map<K,V>
+template<typename K, typename V, int Order = 4>
+class BTreeMap final : public Map<K,V>
 {
+  static_assert(Order >= 4 && Order % 2 == 0,
+                "BTreeMap order must be even and at least 4");
+
 public:
 
   // default constructor
   BTreeMap();
 
+  // bulk-load constructor (see bulk_load)
+  BTreeMap(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
   // copy constructor
   BTreeMap(const BTreeMap& rhs);
 
@@ -31,11 +45,11 @@ public:
   BTreeMap& operator=(const BTreeMap& rhs);
 
   // move assignment
-  BTreeMap& operator=(BTreeMap&& rhs);  
+  BTreeMap& operator=(BTreeMap&& rhs);
 
   // destructor
   ~BTreeMap();
-  
+
   // Returns the number of key-value pairs in the map
   int size() const;
 
@@ -47,13 +61,23 @@ public:
   V& operator[](const K& key);
 
   // Returns the value for a given key. Throws out_of_range if the
-  // given key is not in the collection. 
+  // given key is not in the collection.
   const V& operator[](const K& key) const;
 
   // Extends the collection by adding the given key-value pair.
   // Expects key to not exist in map prior to insertion.
   void insert(const K& key, const V& value);
 
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection, in which case args are left unused.
+  // Returns true if the key was added. Takes one descent (two while
+  // a published version shares the tree).
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -63,45 +87,106 @@ public:
   // Returns true if the key is in the collection, and false otherwise.
   bool contains(const K& key) const;
 
+  // Returns whether each of the keys is in the collection. The keys
+  // are searched for a group at a time, with the group's searches
+  // stepping down the tree together so their cache misses overlap.
+  ArraySeq<bool> contains_many(const ArraySeq<K>& keys) const;
+
+  // Returns the values of the keys, looked up as in contains_many.
+  // Throws out_of_range if any key is not in the collection.
+  ArraySeq<V> get_many(const ArraySeq<K>& keys) const;
+
   // Returns the keys k in the collection such that k1 <= k <= k2
   ArraySeq<K> find_keys(const K& k1, const K& k2) const;
 
   // Returns the keys in the collection in ascending sorted order
-  ArraySeq<K> sorted_keys() const;  
+  ArraySeq<K> sorted_keys() const;
 
   // Gives the key (as an ouptput parameter) immediately after the
   // given key according to ascending sort order. Returns true if a
   // successor key exists, and false otherwise.
-  bool next_key(const K& key, K& next_key) const; 
+  bool next_key(const K& key, K& next_key) const;
 
   // Gives the key (as an ouptput parameter) immediately before the
   // given key according to ascending sort order. Returns true if a
   // predecessor key exists, and false otherwise.
-  bool prev_key(const K& key, K& next_key) const; 
+  bool prev_key(const K& key, K& next_key) const;
 
   // Removes all key-value pairs from the map.
   void clear();
-  
-  // Returns the height of the binary search tree
+
+  // Returns a cursor over the keys k such that k1 <= k <= k2 in
+  // ascending order, walking the tree as the cursor advances
+  KeyRange<K> key_range(const K& k1, const K& k2) const;
+
+  // Returns a cursor over all keys in ascending order
+  KeyRange<K> keys() const;
+
+  // Replaces the contents of the map with the given key-value pairs,
+  // which must be in strictly ascending key order, building the tree
+  // bottom-up in linear time. Throws invalid_argument if the keys are
+  // not sorted.
+  void bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
+  // Returns the height of the tree
   int height() const;
 
+  // Turns persistent mode on or off. While on, a change never touches
+  // a node that a published version can reach: it copies the nodes it
+  // changes (the path down, plus any sibling it borrows from or
+  // merges) and publishes the new root, so snapshots taken by other
+  // threads stay valid. One thread may change the map while any
+  // number take snapshots.
+  void persistent(bool on);
+
+  // Returns true if the map is in persistent mode
+  bool persistent() const;
+
+  // Publishes the current contents to new snapshots. Persistent mode
+  // publishes after each insert, erase, clear, and bulk_load, but not
+  // after a value is updated through operator[].
+  void publish();
+
+  // read-only view of one published version (defined below)
+  class Snapshot;
+
+  // Returns a view of the last published version. Lock-free, and safe
+  // to call from any thread while the writer works. Throws
+  // logic_error if nothing is published (persistent mode is off). A
+  // snapshot must not outlive its map.
+  Snapshot snapshot() const;
+
   // for debugging the tree
   void print() const {
     print("  ", root, height());
   }
 
-  
+
 private:
 
-  // node for 2-3-4 tree
-  struct Node {
-    ArraySeq<std::pair<K,V>> keyvals;
-    ArraySeq<Node*> children;
+  // max and min number of keys in a (non-root) node
+  static const int MAX_KEYS = Order - 1;
+  static const int MIN_KEYS = Order / 2 - 1;
+
+  // B-tree node; keys come first so a search of a small node stays
+  // within its first cache lines
+  struct alignas(64) Node {
+    K keys[MAX_KEYS];
+    int n = 0;
+    bool is_leaf = true;
+    // parents (and published versions) pointing at the node beyond
+    // the first. Only the writer reads or changes it; the working tree
+    // may change a node in place only while it is 0. It fits the
+    // padding after is_leaf, so an order-4 int node keeps to one cache
+    // line; nodes come from new Node(), which zeroes it.
+    unsigned int shares : 24;
+    V vals[MAX_KEYS];
+    Node* children[Order];
     // helper functions
-    bool full() const {return keyvals.size() == 3;}
-    bool leaf() const {return children.empty();}
-    K key(int i) const {return keyvals[i].first;}
-    V& val(int i) {return keyvals[i].second;}
+    bool full() const {return n == MAX_KEYS;}
+    bool leaf() const {return is_leaf;}
+    const K& key(int i) const {return keys[i];}
+    V& val(int i) {return vals[i];}
     Node* child(int i) const {return children[i];}
   };
 
@@ -111,23 +196,75 @@ private:
   // root node
   Node* root = nullptr;
 
+  // true if each change is published (see persistent)
+  bool path_copying = false;
+
+  // versions published for snapshots
+  Versions<Node> versions;
+
   // print helper function
   void print(std::string indent, Node* st_root, int levels) const;
-  
-  // clean up the tree memory 
+
+  // clean up the tree memory. Nodes still shared with a published
+  // version only lose a reference.
   void clear(Node* st_root);
 
+  // clear without publishing the empty tree
+  void clear_tree();
+
+  // returns node if only the working tree uses it, and otherwise a
+  // copy the caller links in its place
+  Node* own(Node* node)
+  {
+    return node -> shares == 0 ? node : unshare(node);
+  }
+
+  // makes the parent's i-th child the working tree's own, returning
+  // it. The parent must already be the working tree's own.
+  Node* own_child(Node* parent, int i)
+  {
+    Node* child = parent -> children[i];
+    if(child -> shares != 0)
+    {
+      child = parent -> children[i] = unshare(child);
+    }
+    return child;
+  }
+
+  // own's copy of a node shared with a published version
+  Node* unshare(Node* node);
+
+  // frees the versions no snapshot uses any more
+  void collect();
+
+  // returns the node below st_root holding key (and its index), or
+  // nullptr
+  static const Node* find_node(const Node* st_root, const K& key, int& index);
+
   // helper function for copy assignment
   Node* copy(const Node* rhs_st_root) const;
 
-  // split the parent's i-th child
+  // bulk_load helpers: the fewest keys a non-root subtree of the
+  // given height can hold, and building a subtree of that height
+  // from n pairs starting at start
+  static long long min_subtree_keys(int levels);
+  Node* build(const ArraySeq<std::pair<K,V>>& pairs, int start, int n,
+              int levels);
+
+  // index of the first key in the node not less than key
+  static int lower_bound(const Node* node, const K& key);
+
+  // returns the node holding key (and its index), or nullptr
+  Node* find(const K& key, int& index) const;
+
+  // split the parent's i-th (full) child
   void split(Node* parent, int i);
-  
+
   // erase helpers
   void erase(Node* st_root, const K& key);
-  void remove_internal(Node* st_root, int key_idx);
-  void rebalance(Node* st_root, int key_idx, int& child_idx);
-  
+  void merge(Node* st_root, int key_idx);
+  void rebalance(Node* st_root, int& child_idx);
+
   // find_keys helper
   void find_keys(const K& k1, const K& k2, const Node* st_root,
                  ArraySeq<K>& keys) const;
@@ -135,253 +272,387 @@ private:
   // sorted_keys helper
   void sorted_keys(const Node* st_root, ArraySeq<K>& keys) const;
 
-  // height helper
-  int height(const Node* st_root) const;
-  
+  // number of batched searches stepped down the tree together
+  static const int PROBE_GROUP = 16;
+
+  // calls f(i, value) for each keys[i], with value nullptr if the key
+  // is not in the map
+  template<typename F>
+  void find_many(const ArraySeq<K>& keys, F f) const;
+
+  // in-order cursor from a lower bound up to an (optional) upper
+  // bound. The stack holds the path from the root as (node, index of
+  // the next key to visit in that node) pairs, with the current key
+  // at the top.
+  class Cursor : public KeyCursor<K>
+  {
+  public:
+    Cursor(const Node* st_root, const K* k1, const K* k2);
+    bool valid() const;
+    const K& key() const;
+    void next();
+  private:
+    ArraySeq<std::pair<const Node*,int>> stack;
+    bool bounded = false;
+    K last;
+    // pops nodes whose keys have all been visited
+    void settle();
+  };
+
+  // shared body of the insert overloads, forwarding key and value
+  // into the new entry
+  template<typename KK, typename VV>
+  void insert_pair(KK&& key, VV&& value);
+
+  // splits full nodes from the root down toward key, so the leaf
+  // reached has room for it, and returns that leaf with i set to
+  // key's place in it. If stop_at_key is true, a node holding key
+  // is returned instead (with i its index).
+  Node* make_room(const K& key, int& i, bool stop_at_key);
+
+};
+
+
+// Holds a reference to one published version, so its nodes stay
+// alive (and unchanged) however the writer moves on
+template<typename K, typename V, int Order>
+class BTreeMap<K,V,Order>::Snapshot
+{
+public:
+
+  Snapshot(const Snapshot& rhs);
+  Snapshot(Snapshot&& rhs);
+  Snapshot& operator=(const Snapshot& rhs);
+  Snapshot& operator=(Snapshot&& rhs);
+  ~Snapshot();
+
+  // Returns the number of key-value pairs in the version
+  int size() const;
+
+  // Tests if the version is empty
+  bool empty() const;
+
+  // Returns true if the key is in the version, and false otherwise.
+  bool contains(const K& key) const;
+
+  // Returns the value for a given key. Throws out_of_range if the
+  // given key is not in the version.
+  const V& operator[](const K& key) const;
+
+  // Returns the keys in the version in ascending sorted order
+  ArraySeq<K> sorted_keys() const;
+
+private:
+
+  friend class BTreeMap;
+
+  Snapshot(const BTreeMap* map, typename Versions<Node>::Version* version);
+
+  const BTreeMap* map;
+
+  typename Versions<Node>::Version* version;
+
 };
 
 
-template<typename K, typename V>
-void BTreeMap<K,V>::print(std::string indent, Node* st_root, int levels) const {
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::print(std::string indent, Node* st_root, int levels) const {
   if (levels == 0)
     return;
   if (!st_root)
     return;
-  std::cout << indent << "("; 
-  for (int i = 0; i < 3; ++i) {
+  std::cout << indent << "(";
+  for (int i = 0; i < MAX_KEYS; ++i) {
     if (i != 0)
       std::cout << ",";
-    if (st_root->keyvals.size() > i)
-      std::cout << st_root->key(i); 
+    if (st_root->n > i)
+      std::cout << st_root->key(i);
     else
       std::cout << "-";
   }
   std::cout << ")" << std::endl;
-  if (levels > 1) {
-    for (int i = 0; i < st_root->children.size(); ++i)
+  if (levels > 1 && !st_root->leaf()) {
+    for (int i = 0; i <= st_root->n; ++i)
       print(indent + " ", st_root->child(i), levels - 1);
   }
 }
 
 
-// TODO: Implement the (2-3-4) BTree Map's functions below. See the
-// lecture notes for additional details. 
-
 // default constructor
-template<typename K, typename V>
-BTreeMap<K,V>::BTreeMap()
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::BTreeMap()
+{
+}
+
+// bulk-load constructor
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::BTreeMap(const ArraySeq<std::pair<K,V>>& sorted_pairs)
 {
+  bulk_load(sorted_pairs);
 }
 
 // copy constructor
-template<typename K, typename V>
-BTreeMap<K,V>::BTreeMap(const BTreeMap& rhs)
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::BTreeMap(const BTreeMap& rhs)
 {
   *this = rhs;
 }
 
 // move constructor
-template<typename K, typename V>
-BTreeMap<K,V>::BTreeMap(BTreeMap&& rhs)
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::BTreeMap(BTreeMap&& rhs)
 {
   *this = std::move(rhs);
 }
 
 // copy assignment
-template<typename K, typename V>
-BTreeMap<K,V>& BTreeMap<K,V>::operator=(const BTreeMap& rhs)
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>& BTreeMap<K,V,Order>::operator=(const BTreeMap& rhs)
 {
-  
   if(this != &rhs)
   {
-    clear();
+    clear_tree();
     root = copy(rhs.root);
     count = rhs.count;
+    if(path_copying)
+    {
+      publish();
+    }
   }
-  
+  return *this;
 }
 
 // move assignment
-template<typename K, typename V>
-BTreeMap<K,V>& BTreeMap<K,V>::operator=(BTreeMap&& rhs)
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>& BTreeMap<K,V,Order>::operator=(BTreeMap&& rhs)
 {
-  
+  // published nodes have to stay with the versions that hold them, so
+  // such a map is copied instead
   if(this != &rhs)
   {
-    clear();
-    root = rhs.root;
-    count = rhs.count;
-    rhs.root = nullptr;
-    rhs.count = 0;
-    return *this;
+    if(versions.live() > 0 || rhs.versions.live() > 0)
+    {
+      *this = rhs;
+      rhs.clear();
+    }
+    else
+    {
+      clear();
+      root = rhs.root;
+      count = rhs.count;
+      rhs.root = nullptr;
+      rhs.count = 0;
+    }
   }
-  
-} 
+  return *this;
+}
 
 // destructor
-template<typename K, typename V>
-BTreeMap<K,V>::~BTreeMap()
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::~BTreeMap()
 {
-  clear();
+  versions.withdraw();
+  collect();
+  clear_tree();
 }
 
 // Returns the number of key-value pairs in the map
-template<typename K, typename V>
-int BTreeMap<K,V>::size() const
+template<typename K, typename V, int Order>
+int BTreeMap<K,V,Order>::size() const
 {
   return count;
 }
 
 // Tests if the map is empty
-template<typename K, typename V>
-bool BTreeMap<K,V>::empty() const
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::empty() const
 {
   return count == 0;
 }
 
 // Allows values associated with a key to be updated. Throws
 // out_of_range if the given key is not in the collection.
-template<typename K, typename V>
-V& BTreeMap<K,V>::operator[](const K& key)
+template<typename K, typename V, int Order>
+V& BTreeMap<K,V,Order>::operator[](const K& key)
 {
-  Node* temp = root;
-  if(temp == nullptr)
-  {
-    throw(std::out_of_range("BTreeMap<K,V>::operator[](const K& key)"));
-  }
-  while(!(temp -> leaf()))
+  collect();
+  // the update must not show through a published version, so the
+  // path down to the key is made the working tree's own first
+  if(versions.live() > 0 && contains(key))
   {
-    for(int i = 0; i < temp -> keyvals.size(); i++)
+    root = own(root);
+    Node* temp = root;
+    int i = lower_bound(temp, key);
+    while(!(i < temp -> n && temp -> key(i) == key))
     {
-      if(key < temp -> key(i))
-      {
-        temp = temp -> child(i); 
-        break;
-      }
-      else if(key == temp -> key(i))
-      {
-        return temp -> val(i);
-      }
-      else if(i == temp -> keyvals.size() - 1)
-      {
-        temp = temp -> child(i + 1);
-        break;
-      }
+      temp = own_child(temp, i);
+      i = lower_bound(temp, key);
     }
+    return temp -> val(i);
   }
-  for(int i = 0; i < temp -> keyvals.size(); i++)
+  int i;
+  Node* temp = find(key, i);
+  if(temp == nullptr)
   {
-    if(key == temp->key(i))
-    {
-      return temp-> val(i);
-    }
+    throw(std::out_of_range("BTreeMap<K,V>::operator[](const K& key)"));
   }
-  throw(std::out_of_range("BTreeMap<K,V>::operator[](const K& key)"));
+  return temp -> val(i);
 }
 
 // Returns the value for a given key. Throws out_of_range if the
 // given key is not in the collection.
-template<typename K, typename V>
-const V& BTreeMap<K,V>::operator[](const K& key) const
+template<typename K, typename V, int Order>
+const V& BTreeMap<K,V,Order>::operator[](const K& key) const
 {
-  
+  int i;
+  Node* temp = find(key, i);
+  if(temp == nullptr)
+  {
+    throw(std::out_of_range("BTreeMap<K,V>::operator[](const K& key)"));
+  }
+  return temp -> val(i);
 }
 
 // Extends the collection by adding the given key-value pair.
 // Expects key to not exist in map prior to insertion.
-template<typename K, typename V>
-void BTreeMap<K,V>::insert(const K& key, const V& value)
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::insert(const K& key, const V& value)
+{
+  insert_pair(key, value);
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::insert(K&& key, V&& value)
 {
+  insert_pair(std::move(key), std::move(value));
+}
+
+// Shared insert body. The key is forwarded only once it is no longer
+// needed for placement.
+template<typename K, typename V, int Order>
+template<typename KK, typename VV>
+void BTreeMap<K,V,Order>::insert_pair(KK&& key, VV&& value)
+{
+  collect();
   count++;
+  int i;
+  Node* curr = make_room(key, i, false);
+  for(int j = curr -> n; j > i; j--)
+  {
+    curr -> keys[j] = std::move(curr -> keys[j - 1]);
+    curr -> vals[j] = std::move(curr -> vals[j - 1]);
+  }
+  curr -> keys[i] = std::forward<KK>(key);
+  curr -> vals[i] = std::forward<VV>(value);
+  curr -> n++;
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+// Adds the key with a value constructed from args unless the key is
+// already in the collection. Nodes split on the way to a key that
+// turns out to be present leave a valid tree.
+template<typename K, typename V, int Order>
+template<typename... Args>
+bool BTreeMap<K,V,Order>::try_emplace(const K& key, Args&&... args)
+{
+  collect();
+  // as in erase, a shared path is only copied once the key is known
+  // to be missing
+  if(versions.live() > 0 && contains(key))
+  {
+    return false;
+  }
+  int i;
+  Node* curr = make_room(key, i, true);
+  if(i < curr -> n && curr -> key(i) == key)
+  {
+    return false;
+  }
+  for(int j = curr -> n; j > i; j--)
+  {
+    curr -> keys[j] = std::move(curr -> keys[j - 1]);
+    curr -> vals[j] = std::move(curr -> vals[j - 1]);
+  }
+  curr -> keys[i] = key;
+  curr -> vals[i] = V(std::forward<Args>(args)...);
+  curr -> n++;
+  count++;
+  if(path_copying)
+  {
+    publish();
+  }
+  return true;
+}
+
+// split full nodes on the way down so a leaf always has room
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::make_room(const K& key, int& i, bool stop_at_key)
+{
   if(root == nullptr)
   {
     root = new Node();
-    std::pair<K,V> pair1;
-    pair1.first = key;
-    pair1.second = value;
-    root -> keyvals.insert(pair1, 0);
   }
   else
   {
-    if(root -> full())
-    {
-      Node* left = root;
-      root = new Node();
-      root -> children.insert(left, 0);
-      split(root, 0);
-    }
-
-    Node* prev = root;
-    Node* curr = root;
+    root = own(root);
+  }
+  if(root -> full())
+  {
+    Node* left = root;
+    root = new Node();
+    root -> is_leaf = false;
+    root -> children[0] = left;
+    split(root, 0);
+  }
 
-    while(!(curr -> leaf()) || curr -> full())
+  Node* curr = root;
+  while(!(curr -> leaf()))
+  {
+    i = lower_bound(curr, key);
+    if(stop_at_key && i < curr -> n && curr -> key(i) == key)
     {
-      if(curr -> full())
-      {
-        for(int i = 0; i < prev -> keyvals.size(); i++)
-        {
-          if(key < prev -> key(i))
-          {
-            split(prev, i);
-            i = prev -> children.size();
-          }
-          else if(i == (prev -> keyvals.size() - 1))
-          {
-            split(prev, i+1);
-            i = prev -> children.size();
-          }
-        }
-        curr = prev;
-      }
-      prev = curr;
-
-      for(int i = 0; i < curr -> keyvals.size(); i++)
-      {
-        if(key < curr -> key(i))
-        {
-          curr = curr -> child(i);
-          i = curr -> keyvals.size();
-        }
-        else if (i == curr -> keyvals.size() - 1)
-        {
-          curr = curr -> child(i + 1);
-          i = curr -> keyvals.size();
-        }
-      }
+      return curr;
     }
-    std::pair<K,V> pair1;
-    pair1.first = key;
-    pair1.second = value;
-    int k_count = curr -> keyvals.size();
-    for(int i = 0; i < k_count; i++)
+    if(own_child(curr, i) -> full())
     {
-      if(key < curr -> key(i))
+      split(curr, i);
+      if(stop_at_key && curr -> key(i) == key)
       {
-        curr -> keyvals.insert(pair1, i);
-        return;
+        return curr;
       }
-      else if(i == curr -> keyvals.size() - 1)
+      if(curr -> key(i) < key)
       {
-        curr -> keyvals.insert(pair1, i + 1);
-        return;
+        i++;
       }
     }
+    curr = curr -> child(i);
   }
+  i = lower_bound(curr, key);
+  return curr;
 }
 
 // Shrinks the collection by removing the key-value pair with the
 // given key. Does not modify the collection if the collection does
 // not contain the key. Throws out_of_range if the given key is not
 // in the collection.
-template<typename K, typename V>
-void BTreeMap<K,V>::erase(const K& key)
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::erase(const K& key)
 {
-  
+  collect();
+  if(!contains(key))
+  {
+    throw std::out_of_range("BTreeMap<K,V>::erase(const K&)");
+  }
+  root = own(root);
   erase(root, key);
-  if(root -> keyvals.empty())
+  if(root -> n == 0)
   {
     Node* left_child = nullptr;
-    if(root -> children.size() > 0)
+    if(!(root -> leaf()))
     {
       left_child = root -> child(0);
     }
@@ -389,50 +660,58 @@ void BTreeMap<K,V>::erase(const K& key)
     root = left_child;
   }
   count--;
+  if(path_copying)
+  {
+    publish();
+  }
 }
 
 // Returns true if the key is in the collection, and false otherwise.
-template<typename K, typename V>
-bool BTreeMap<K,V>::contains(const K& key) const
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::contains(const K& key) const
 {
-  Node* temp = root;
-  if(temp == nullptr)
+  int i;
+  return find(key, i) != nullptr;
+}
+
+// Returns whether each of the keys is in the collection
+template<typename K, typename V, int Order>
+ArraySeq<bool> BTreeMap<K,V,Order>::contains_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<bool> found;
+  for(int i = 0; i < keys.size(); i++)
   {
-    return false;
+    found.insert(false, i);
   }
-  while(!(temp -> leaf()))
+  find_many(keys, [&](int i, const V* value) {
+    found[i] = value != nullptr;
+  });
+  return found;
+}
+
+// Returns the values of the keys. Throws out_of_range if any key is
+// not in the collection.
+template<typename K, typename V, int Order>
+ArraySeq<V> BTreeMap<K,V,Order>::get_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<V> values;
+  for(int i = 0; i < keys.size(); i++)
   {
-    for(int i = 0; i < temp -> keyvals.size(); i++)
-    {
-      if(key < temp -> key(i))
-      {
-        temp = temp -> child(i); 
-        break;
-      }
-      else if(key == temp -> key(i))
-      {
-        return true;
-      }
-      else if(i == temp -> keyvals.size() - 1)
-      {
-        temp = temp -> child(i + 1);
-        break;
-      }
-    }
+    values.insert(V(), i);
   }
-  for(int i = 0; i < temp -> keyvals.size(); i++)
-  {
-    if(key == temp->key(i))
+  find_many(keys, [&](int i, const V* value) {
+    if(value == nullptr)
     {
-      return true;
+      throw(std::out_of_range("BTreeMap<K,V>::get_many(const ArraySeq<K>&)"));
     }
-  }
-  return false;
+    values[i] = *value;
+  });
+  return values;
 }
 
 // Returns the keys k in the collection such that k1 <= k <= k2
-template<typename K, typename V>
-ArraySeq<K> BTreeMap<K,V>::find_keys(const K& k1, const K& k2) const
+template<typename K, typename V, int Order>
+ArraySeq<K> BTreeMap<K,V,Order>::find_keys(const K& k1, const K& k2) const
 {
   ArraySeq<K> keys;
   find_keys(k1,k2,root,keys);
@@ -440,491 +719,868 @@ ArraySeq<K> BTreeMap<K,V>::find_keys(const K& k1, const K& k2) const
 }
 
 // Returns the keys in the collection in ascending sorted order
-template<typename K, typename V>
-ArraySeq<K> BTreeMap<K,V>::sorted_keys() const
+template<typename K, typename V, int Order>
+ArraySeq<K> BTreeMap<K,V,Order>::sorted_keys() const
 {
   ArraySeq<K> keys;
   sorted_keys(root, keys);
   return keys;
-}  
+}
 
 // Gives the key (as an ouptput parameter) immediately after the
 // given key according to ascending sort order. Returns true if a
 // successor key exists, and false otherwise.
-template<typename K, typename V>
-bool BTreeMap<K,V>::next_key(const K& key, K& next_key) const
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::next_key(const K& key, K& next_key) const
 {
-  if(root == nullptr)
-    return false;
+  bool found = false;
   Node* temp = root;
-  while(!(temp->leaf()))
+  while(temp != nullptr)
   {
-    for(int i = 0; i < temp -> keyvals.size(); i++)
+    // first key strictly greater than key
+    int i = lower_bound(temp, key);
+    if(i < temp -> n && temp -> key(i) == key)
     {
-      if(temp -> key(i) <= key)
-      {
-        if(i == temp-> keyvals.size() - 1)
-        {
-          temp = temp -> child(i + 1);
-          i = temp -> keyvals.size();
-        }
-      }
-      else if(key < temp->key(i))
-      {
-        next_key = temp -> key(i);
-        temp = temp -> child(i);
-        i = temp -> keyvals.size();
-        return true;
-      }
+      i++;
     }
-  }
-  for(int i = 0; i < temp -> keyvals.size(); i++)
-  {
-    if(temp -> key(i) > key)
+    if(i < temp -> n)
     {
       next_key = temp -> key(i);
-      i = temp -> keyvals.size();
-      return true;
+      found = true;
     }
+    temp = temp -> leaf() ? nullptr : temp -> child(i);
   }
-} 
+  return found;
+}
 
 // Gives the key (as an ouptput parameter) immediately before the
 // given key according to ascending sort order. Returns true if a
 // predecessor key exists, and false otherwise.
-template<typename K, typename V>
-bool BTreeMap<K,V>::prev_key(const K& key, K& next_key) const
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::prev_key(const K& key, K& next_key) const
 {
-  
-  if(root == nullptr)
+  bool found = false;
+  Node* temp = root;
+  while(temp != nullptr)
+  {
+    // keys before index i are strictly less than key
+    int i = lower_bound(temp, key);
+    if(i > 0)
+    {
+      next_key = temp -> key(i - 1);
+      found = true;
+    }
+    temp = temp -> leaf() ? nullptr : temp -> child(i);
+  }
+  return found;
+}
+
+// Removes all key-value pairs from the map.
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::clear()
+{
+  clear_tree();
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::clear_tree()
+{
+  collect();
+  clear(root);
+  root = nullptr;
+  count = 0;
+}
+
+// Returns a cursor over the keys in [k1, k2]
+template<typename K, typename V, int Order>
+KeyRange<K> BTreeMap<K,V,Order>::key_range(const K& k1, const K& k2) const
+{
+  return KeyRange<K>(new Cursor(root, &k1, &k2));
+}
+
+// Returns a cursor over all keys
+template<typename K, typename V, int Order>
+KeyRange<K> BTreeMap<K,V,Order>::keys() const
+{
+  return KeyRange<K>(new Cursor(root, nullptr, nullptr));
+}
+
+// descends toward k1, stacking each node with the index of its first
+// key not less than k1
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::Cursor::Cursor(const Node* st_root, const K* k1, const K* k2)
+{
+  if(k2 != nullptr)
+  {
+    bounded = true;
+    last = *k2;
+  }
+  while(st_root != nullptr)
+  {
+    int i = k1 == nullptr ? 0 : lower_bound(st_root, *k1);
+    stack.insert(std::make_pair(st_root, i), stack.size());
+    st_root = st_root -> is_leaf ? nullptr : st_root -> children[i];
+  }
+  settle();
+}
+
+// cursor is at a key unless the stack is empty or past k2
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::Cursor::valid() const
+{
+  if(stack.empty())
   {
     return false;
   }
+  return !bounded || !(last < key());
+}
+
+// the key at the top of the stack
+template<typename K, typename V, int Order>
+const K& BTreeMap<K,V,Order>::Cursor::key() const
+{
+  const std::pair<const Node*,int>& top = stack[stack.size() - 1];
+  return top.first -> keys[top.second];
+}
+
+// steps past the current key, then descends to the leftmost key of
+// the child that follows it (if any)
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::Cursor::next()
+{
+  std::pair<const Node*,int>& top = stack[stack.size() - 1];
+  top.second++;
+  const Node* temp = top.first -> is_leaf ? nullptr : top.first -> children[top.second];
+  while(temp != nullptr)
+  {
+    stack.insert(std::make_pair(temp, 0), stack.size());
+    temp = temp -> is_leaf ? nullptr : temp -> children[0];
+  }
+  settle();
+}
 
+// pops finished nodes; the parent's index already names its next key
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::Cursor::settle()
+{
+  while(!stack.empty() && stack[stack.size() - 1].second >= stack[stack.size() - 1].first -> n)
+  {
+    stack.erase(stack.size() - 1);
+  }
+}
+
+// Replaces the contents with the sorted key-value pairs
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs)
+{
+  for(int i = 1; i < sorted_pairs.size(); i++)
+  {
+    if(!(sorted_pairs[i - 1].first < sorted_pairs[i].first))
+    {
+      throw(std::invalid_argument("BTreeMap<K,V>::bulk_load(const ArraySeq<std::pair<K,V>>&)"));
+    }
+  }
+  // snapshots keep seeing the old contents until the new tree is
+  // published
+  clear_tree();
+  int n = sorted_pairs.size();
+  if(n == 0)
+  {
+    if(path_copying)
+    {
+      publish();
+    }
+    return;
+  }
+  // the shortest tree that can hold n keys (Order^levels - 1 >= n)
+  int levels = 1;
+  long long max_keys = MAX_KEYS;
+  while(max_keys < n)
+  {
+    max_keys = (max_keys + 1) * Order - 1;
+    levels++;
+  }
+  root = build(sorted_pairs, 0, n, levels);
+  count = n;
+  if(path_copying)
+  {
+    publish();
+  }
+}
+
+// Returns the height of the tree
+template<typename K, typename V, int Order>
+int BTreeMap<K,V,Order>::height() const
+{
+  if(root == nullptr)
+  {
+    return 0;
+  }
+  int height = 1;
   Node* temp = root;
-  bool found = false;
   while(!(temp -> leaf()))
   {
-    for(int i = 0; i < temp -> keyvals.size(); i++)
+    height++;
+    temp = temp -> child(0);
+  }
+  return height;
+}
+
+// Turns persistent mode on or off
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::persistent(bool on)
+{
+  path_copying = on;
+  if(on)
+  {
+    publish();
+  }
+  else
+  {
+    // snapshots already taken keep their versions
+    versions.withdraw();
+    collect();
+  }
+}
+
+// Returns true if the map is in persistent mode
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::persistent() const
+{
+  return path_copying;
+}
+
+// the version's reference to the root makes the working tree copy
+// the root (and so the path) on its next change
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::publish()
+{
+  if(root != nullptr)
+  {
+    root -> shares++;
+  }
+  versions.publish(root, count);
+  collect();
+}
+
+// Returns a view of the last published version
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Snapshot BTreeMap<K,V,Order>::snapshot() const
+{
+  typename Versions<Node>::Version* version = versions.acquire();
+  if(version == nullptr)
+  {
+    throw(std::logic_error("BTreeMap<K,V>::snapshot()"));
+  }
+  return Snapshot(this, version);
+}
+
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::Snapshot::Snapshot(const BTreeMap* map,
+                                        typename Versions<Node>::Version* version)
+  : map(map), version(version)
+{
+}
+
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::Snapshot::Snapshot(const Snapshot& rhs)
+  : map(rhs.map), version(rhs.version)
+{
+  map -> versions.share(version);
+}
+
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::Snapshot::Snapshot(Snapshot&& rhs)
+  : map(rhs.map), version(rhs.version)
+{
+  rhs.version = nullptr;
+}
+
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Snapshot& BTreeMap<K,V,Order>::Snapshot::operator=(const Snapshot& rhs)
+{
+  if(this != &rhs)
+  {
+    rhs.map -> versions.share(rhs.version);
+    if(version != nullptr)
     {
-      if(temp -> key(i) >= key)
-      {
-        temp = temp -> child(i);
-      }
-      
-      else if(key > temp ->key(i))
-      {
-        next_key = temp -> key(i);
-        found = true;
-        if(i == temp -> keyvals.size() - 1)
-        {
-          temp = temp -> child(i + 1);
-          i = temp -> keyvals.size();
-        }
-      }
+      map -> versions.release(version);
     }
+    map = rhs.map;
+    version = rhs.version;
   }
+  return *this;
+}
 
-  for(int i = 0; i < temp->keyvals.size(); i++)
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Snapshot& BTreeMap<K,V,Order>::Snapshot::operator=(Snapshot&& rhs)
+{
+  if(this != &rhs)
   {
-    if(key > temp -> key(i))
+    if(version != nullptr)
     {
-      next_key = temp -> key(i);
-      return true;
+      map -> versions.release(version);
     }
+    map = rhs.map;
+    version = rhs.version;
+    rhs.version = nullptr;
   }
-  return found;
-  
-} 
+  return *this;
+}
 
-// Removes all key-value pairs from the map.
-template<typename K, typename V>
-void BTreeMap<K,V>::clear()
+// the writer frees the version once no other snapshot holds it
+template<typename K, typename V, int Order>
+BTreeMap<K,V,Order>::Snapshot::~Snapshot()
 {
-  clear(root);
+  if(version != nullptr)
+  {
+    map -> versions.release(version);
+  }
 }
 
-// Returns the height of the binary search tree
-template<typename K, typename V>
-int BTreeMap<K,V>::height() const
+template<typename K, typename V, int Order>
+int BTreeMap<K,V,Order>::Snapshot::size() const
 {
-  return height(root);
+  return version -> count;
+}
+
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::Snapshot::empty() const
+{
+  return version -> count == 0;
+}
+
+template<typename K, typename V, int Order>
+bool BTreeMap<K,V,Order>::Snapshot::contains(const K& key) const
+{
+  int i;
+  return find_node(version -> root, key, i) != nullptr;
+}
+
+template<typename K, typename V, int Order>
+const V& BTreeMap<K,V,Order>::Snapshot::operator[](const K& key) const
+{
+  int i;
+  const Node* temp = find_node(version -> root, key, i);
+  if(temp == nullptr)
+  {
+    throw(std::out_of_range("BTreeMap<K,V>::Snapshot::operator[](const K& key)"));
+  }
+  return temp -> vals[i];
+}
+
+template<typename K, typename V, int Order>
+ArraySeq<K> BTreeMap<K,V,Order>::Snapshot::sorted_keys() const
+{
+  ArraySeq<K> keys;
+  map -> sorted_keys(version -> root, keys);
+  return keys;
 }
 
 //helper functions:
 
-  
-// clean up the tree memory 
-template<typename K, typename V>
-void BTreeMap<K,V>::clear(Node* st_root)
+
+// clean up the tree memory
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::clear(Node* st_root)
 {
   if(st_root == nullptr)
   {
     return;
   }
+  if(st_root -> shares > 0)
+  {
+    // still part of another version (or the working tree)
+    st_root -> shares--;
+    return;
+  }
   if(!(st_root -> leaf()))
   {
-    for(int i = 0; i < st_root -> children.size(); i++)
+    for(int i = 0; i <= st_root -> n; i++)
     {
       clear(st_root -> child(i));
     }
   }
   delete st_root;
-  count = 0;
 }
 
-// helper function for copy assignment
-template<typename K, typename V>
-typename BTreeMap<K,V>::Node* BTreeMap<K,V>::copy(const Node* rhs_st_root) const
+// the copy takes over the caller's link to node, and adds links to
+// node's children
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::unshare(Node* node)
 {
-  if(rhs_st_root == nullptr)
+  Node* temp = new Node();
+  temp -> n = node -> n;
+  temp -> is_leaf = node -> is_leaf;
+  for(int i = 0; i < node -> n; i++)
   {
-    return nullptr;
+    temp -> keys[i] = node -> keys[i];
+    temp -> vals[i] = node -> vals[i];
   }
-  else
+  if(!(node -> leaf()))
   {
-    Node* temp = new Node();
-    for(int i = 0; i < rhs_st_root -> keyvals.size(); i++)
-    {
-      std::pair<K,V> pair1;
-      pair1.first = rhs_st_root -> keyvals[i].first;
-      pair1.second = rhs_st_root -> keyvals[i].second;
-      temp -> keyvals.insert(pair1, temp -> keyvals.size());
-    }
-    for(int i = 0; i < rhs_st_root -> children.size(); i++)
+    for(int i = 0; i <= node -> n; i++)
     {
-      temp -> children.insert(copy(rhs_st_root -> child(i)), i);
+      temp -> children[i] = node -> children[i];
+      temp -> children[i] -> shares++;
     }
-    return temp;
   }
+  node -> shares--;
+  return temp;
 }
 
-// split the parent's i-th child
-template<typename K, typename V>
-void BTreeMap<K,V>::split(Node* parent, int i)
+// frees each unreferenced version's nodes that no other version (or
+// the working tree) shares. Every change calls it first, so versions
+// dropped after persistent mode is turned off are freed too.
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::collect()
 {
-  // moving up to parent
-  std::pair<K,V> pair1;
-  pair1.first = parent -> child(i) -> key(1);
-  pair1.second = parent -> child(i) -> val(1);
-  parent -> keyvals.insert(pair1, i);
+  versions.collect([this](const Node* st_root) {
+    clear(const_cast<Node*>(st_root));
+  });
+}
 
-  //moving to right
-  std::pair<K,V> pair2;
-  pair2.first = parent -> child(i) -> key(2);
-  pair2.second = parent -> child(i) -> val(2);
-  parent -> children.insert(new Node(), i + 1);
-  parent -> child(i+1) ->keyvals.insert(pair2, 0);
-  parent -> child(i) -> keyvals.erase(2);
-  parent -> child(i) -> keyvals.erase(1);
-  if(parent ->child(i) -> children.size() >= 3)
+// search down from st_root
+template<typename K, typename V, int Order>
+const typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::find_node(const Node* st_root, const K& key, int& index)
+{
+  while(st_root != nullptr)
   {
-    parent -> child(i+1) -> children.insert(parent ->child(i) -> child(2), 0);
-    parent ->child(i) -> children.erase(2);
-
-    if(parent ->child(i) -> children.size() >= 3)
+    int i = lower_bound(st_root, key);
+    if(i < st_root -> n && st_root -> key(i) == key)
     {
-      parent -> child(i+1) -> children.insert(parent ->child(i) -> child(2), 1);
-      parent ->child(i) -> children.erase(2);
+      index = i;
+      return st_root;
     }
+    st_root = st_root -> leaf() ? nullptr : st_root -> child(i);
   }
+  return nullptr;
 }
 
-// erase helpers
-template<typename K, typename V>
-void BTreeMap<K,V>::erase(Node* st_root, const K& key)
+// helper function for copy assignment
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::copy(const Node* rhs_st_root) const
 {
-  while(st_root != nullptr)
+  if(rhs_st_root == nullptr)
   {
-    if(st_root -> leaf())
-    {
-      for(int i = 0; i < st_root -> keyvals.size(); i++)
-      {
-        if(st_root -> key(i) == key)
-        {
-          st_root -> keyvals.erase(i);
-          return;
-        }
-      }
-      break;
-    }
-    else
+    return nullptr;
+  }
+  Node* temp = new Node();
+  temp -> n = rhs_st_root -> n;
+  temp -> is_leaf = rhs_st_root -> is_leaf;
+  for(int i = 0; i < rhs_st_root -> n; i++)
+  {
+    temp -> keys[i] = rhs_st_root -> keys[i];
+    temp -> vals[i] = rhs_st_root -> vals[i];
+  }
+  if(!(rhs_st_root -> leaf()))
+  {
+    for(int i = 0; i <= rhs_st_root -> n; i++)
     {
-      for(int i = 0; i < st_root->keyvals.size(); i++)
-      {
-        if(key< st_root->key(i))
-        {
-          int num = i;
-          rebalance(st_root, i, num);
-          //3a, 3b check
-          st_root = st_root->child(num);
-          break;
-        }
-        else if(key == st_root->key(i))
-        {
-          remove_internal(st_root, i);
-          return;
-        }
-        else if (i == st_root->keyvals.size() -1)
-        {
-          int num = i + 1;
-          rebalance(st_root, i, num);
-          st_root = st_root->child(num);
-          break;
-        }
-      }
+      temp -> children[i] = copy(rhs_st_root -> child(i));
     }
   }
-  throw std::out_of_range("BTreeMap<K,V>::erase(const K&)");
+  return temp;
+}
+
+// a non-root subtree of the given height has at least
+// (Order/2)^levels - 1 keys
+template<typename K, typename V, int Order>
+long long BTreeMap<K,V,Order>::min_subtree_keys(int levels)
+{
+  long long keys = 1;
+  for(int i = 0; i < levels; i++)
+  {
+    keys *= Order / 2;
+  }
+  return keys - 1;
 }
 
-template<typename K, typename V>
-void BTreeMap<K,V>::remove_internal(Node* st_root, int key_idx)
+// gives a node as many children as possible while each child still
+// gets the minimum for its height, then spreads the keys evenly
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::build(const ArraySeq<std::pair<K,V>>& pairs, int start, int n, int levels)
 {
-  Node* left = st_root -> child(key_idx);
-  Node* right = st_root -> child(key_idx + 1);
-  if(left -> keyvals.size() > 1)
+  Node* temp = new Node();
+  if(levels == 1)
   {
-    st_root -> keyvals.erase(key_idx);
-    st_root -> keyvals.insert(left -> keyvals[left -> keyvals.size() - 1], key_idx);
-    if(!(right -> leaf()))
+    temp -> n = n;
+    for(int i = 0; i < n; i++)
     {
-      right -> children.insert(left -> child(left -> children.size() - 1), 0);
-      left -> children.erase(left -> children.size() - 1);
+      temp -> keys[i] = pairs[start + i].first;
+      temp -> vals[i] = pairs[start + i].second;
     }
-    left->keyvals.erase(left -> keyvals.size() - 1);
+    return temp;
+  }
+  temp -> is_leaf = false;
+  long long child_min = min_subtree_keys(levels - 1);
+  int children = (int)((n + 1) / (child_min + 1));
+  if(children > Order)
+  {
+    children = Order;
   }
-  else if(right -> keyvals.size() > 1)
+  int child_keys = n - (children - 1);
+  for(int i = 0; i < children; i++)
   {
-    st_root -> keyvals.erase(key_idx);
-    st_root -> keyvals.insert(right -> keyvals[0], key_idx);
-    if(!(left -> leaf()))
+    int size = child_keys / children + (i < child_keys % children ? 1 : 0);
+    temp -> children[i] = build(pairs, start, size, levels - 1);
+    start += size;
+    if(i < children - 1)
     {
-      left -> children.insert(right -> child(0), left -> children.size());
-      right -> children.erase(0);
+      temp -> keys[i] = pairs[start].first;
+      temp -> vals[i] = pairs[start].second;
+      start++;
     }
-    right->keyvals.erase(0);
   }
-  else
+  temp -> n = children - 1;
+  return temp;
+}
+
+// binary search within a node
+template<typename K, typename V, int Order>
+int BTreeMap<K,V,Order>::lower_bound(const Node* node, const K& key)
+{
+  int lo = 0;
+  int hi = node -> n;
+  while(lo < hi)
   {
-    left -> keyvals.insert(st_root -> keyvals[key_idx], 1);
-    st_root -> keyvals.erase(key_idx);
-    if(!(left -> leaf()))
+    int mid = (lo + hi) / 2;
+    if(node -> key(mid) < key)
     {
-      left -> children.insert(right -> child(0), left -> children.size());
-      left -> children.insert(right -> child(1), left -> children.size());
+      lo = mid + 1;
     }
-    left -> keyvals.insert(right -> keyvals[0], 2);
-    right -> keyvals.erase(0);
-    if((left -> leaf()))
+    else
     {
-      left -> keyvals.erase(1);
+      hi = mid;
     }
-    else
+  }
+  return lo;
+}
+
+// search down from the root
+template<typename K, typename V, int Order>
+typename BTreeMap<K,V,Order>::Node* BTreeMap<K,V,Order>::find(const K& key, int& index) const
+{
+  Node* temp = root;
+  while(temp != nullptr)
+  {
+    int i = lower_bound(temp, key);
+    if(i < temp -> n && temp -> key(i) == key)
+    {
+      index = i;
+      return temp;
+    }
+    temp = temp -> leaf() ? nullptr : temp -> child(i);
+  }
+  return nullptr;
+}
+
+// split the parent's i-th child: the middle key moves up to the
+// parent and the upper half of the child moves to a new right node
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::split(Node* parent, int i)
+{
+  Node* left = parent -> child(i);
+  Node* right = new Node();
+  int mid = MAX_KEYS / 2;
+  right -> is_leaf = left -> is_leaf;
+  right -> n = MAX_KEYS - mid - 1;
+  for(int j = 0; j < right -> n; j++)
+  {
+    right -> keys[j] = std::move(left -> keys[mid + 1 + j]);
+    right -> vals[j] = std::move(left -> vals[mid + 1 + j]);
+  }
+  if(!(left -> leaf()))
+  {
+    for(int j = 0; j <= right -> n; j++)
     {
-      remove_internal(left, 1);
+      right -> children[j] = left -> children[mid + 1 + j];
     }
+  }
+  left -> n = mid;
 
+  // make room in the parent for the middle key and the new child
+  for(int j = parent -> n; j > i; j--)
+  {
+    parent -> keys[j] = std::move(parent -> keys[j - 1]);
+    parent -> vals[j] = std::move(parent -> vals[j - 1]);
+    parent -> children[j + 1] = parent -> children[j];
   }
+  parent -> keys[i] = std::move(left -> keys[mid]);
+  parent -> vals[i] = std::move(left -> vals[mid]);
+  parent -> children[i + 1] = right;
+  parent -> n++;
 }
 
-template<typename K, typename V>
-void BTreeMap<K,V>::rebalance(Node* st_root, int key_idx, int& child_idx)
+// erase helpers (each node visited below the root is given more
+// than the minimum number of keys before descending into it)
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::erase(Node* st_root, const K& key)
 {
-  if(key_idx >= child_idx)
+  while(true)
   {
-    Node* right = st_root -> child(child_idx + 1);
-    Node* left = st_root -> child(child_idx);
-    if(left -> keyvals.size() == 1)
+    int i = lower_bound(st_root, key);
+    bool here = i < st_root -> n && st_root -> key(i) == key;
+    if(st_root -> leaf())
     {
-      //if right neighbor has more than 1
-      if(right -> keyvals.size() > 1)
+      // case 1: remove from the leaf
+      for(int j = i; j < st_root -> n - 1; j++)
       {
-        // move root key to left
-        left -> keyvals.insert(st_root -> keyvals[key_idx], 1);
-
-        //erase moved root key
-        st_root -> keyvals.erase(key_idx);
-        if(!(right-> leaf()))
-        {
-          left -> children.insert(right -> child(0), left -> children.size());
-          right -> children.erase(0);
-        }
-        //move right child to top
-        st_root -> keyvals.insert(right -> keyvals[0], key_idx);
-        
-        //erase moved child
-        right -> keyvals.erase(0);
+        st_root -> keys[j] = std::move(st_root -> keys[j + 1]);
+        st_root -> vals[j] = std::move(st_root -> vals[j + 1]);
       }
-      //if left neighbor has more than 1
-      else if(child_idx != 0 && st_root -> child(child_idx - 1) -> keyvals.size() > 1)
+      st_root -> n--;
+      return;
+    }
+    if(here)
+    {
+      if(st_root -> child(i) -> n > MIN_KEYS)
       {
-        Node* lefter = st_root -> child(child_idx - 1);
-        // move root key to right
-        left -> keyvals.insert(st_root -> keyvals[key_idx-1], 0);
-
-        //erase moved root key
-        st_root -> keyvals.erase(key_idx-1);
-
-        if(!(lefter-> leaf()))
+        // case 2a: replace with the predecessor. Its key is copied
+        // since the erase below still has to find it, but its value
+        // can be moved (the path to it is made our own first).
+        Node* pred = own_child(st_root, i);
+        while(!(pred -> leaf()))
         {
-          left -> children.insert(lefter -> child(lefter -> children.size() - 1), 0);
-          lefter -> children.erase(lefter -> children.size() - 1);
+          pred = own_child(pred, pred -> n);
         }
-
-        //move left child to top
-        st_root -> keyvals.insert(lefter -> keyvals[(lefter -> keyvals.size() -1)], key_idx - 1);
-        
-        //erase moved child
-        lefter -> keyvals.erase(lefter -> keyvals.size() - 1);
+        st_root -> keys[i] = pred -> keys[pred -> n - 1];
+        st_root -> vals[i] = std::move(pred -> vals[pred -> n - 1]);
+        erase(st_root -> child(i), st_root -> key(i));
+        return;
       }
-      else
+      else if(st_root -> child(i + 1) -> n > MIN_KEYS)
       {
-        //case 3b
-        left -> keyvals.insert(st_root -> keyvals[key_idx], 1);
-        left -> keyvals.insert(right -> keyvals[0], 2);
-        if(!(right -> leaf()))
+        // case 2b: replace with the successor
+        Node* succ = own_child(st_root, i + 1);
+        while(!(succ -> leaf()))
         {
-          for(int i = 0; i < right -> children.size(); i++)
-          {
-            left -> children.insert(right->child(i), left -> children.size());
-          }
+          succ = own_child(succ, 0);
         }
-        st_root -> keyvals.erase(key_idx);
-        delete right;
-        st_root -> children.erase(child_idx + 1);
+        st_root -> keys[i] = succ -> keys[0];
+        st_root -> vals[i] = std::move(succ -> vals[0]);
+        erase(st_root -> child(i + 1), st_root -> key(i));
+        return;
       }
+      // case 2c: merge the key and right child into the left child
+      merge(st_root, i);
+      st_root = st_root -> child(i);
+    }
+    else
+    {
+      // case 3: make sure the child has a spare key, then descend
+      rebalance(st_root, i);
+      st_root = st_root -> child(i);
     }
   }
-  else if(key_idx < child_idx) // rightmost child (check kids)
+}
+
+// merge the key at key_idx and the right child into the left child
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::merge(Node* st_root, int key_idx)
+{
+  // the right node is emptied and deleted, so it is made our own too
+  Node* left = own_child(st_root, key_idx);
+  Node* right = own_child(st_root, key_idx + 1);
+  left -> keys[left -> n] = std::move(st_root -> keys[key_idx]);
+  left -> vals[left -> n] = std::move(st_root -> vals[key_idx]);
+  for(int j = 0; j < right -> n; j++)
+  {
+    left -> keys[left -> n + 1 + j] = std::move(right -> keys[j]);
+    left -> vals[left -> n + 1 + j] = std::move(right -> vals[j]);
+  }
+  if(!(left -> leaf()))
   {
-    Node* left = st_root -> child(child_idx - 1); // in this case left is -1
-    Node* right = st_root -> child(child_idx);
-    if(right -> keyvals.size() == 1)
+    for(int j = 0; j <= right -> n; j++)
     {
-      if(left -> keyvals.size() > 1)
-      {
-        // move root key to right
-        right -> keyvals.insert(st_root -> keyvals[key_idx], 0);
-
-        //erase moved root key
-        st_root -> keyvals.erase(key_idx);
-
-        //need to move left's rightmost child right (NOTE: THIS WAS JUST ADDED)
-        if(!(left -> leaf()))
-        {
-          right -> children.insert(left -> child(left -> children.size() -1), 0);
-          left -> children.erase(left -> children.size() -1);
-        }
-
-        //move left child to top
-        st_root -> keyvals.insert(left -> keyvals[(left -> keyvals.size() -1)], key_idx);
+      left -> children[left -> n + 1 + j] = right -> children[j];
+    }
+  }
+  left -> n += right -> n + 1;
+  for(int j = key_idx; j < st_root -> n - 1; j++)
+  {
+    st_root -> keys[j] = std::move(st_root -> keys[j + 1]);
+    st_root -> vals[j] = std::move(st_root -> vals[j + 1]);
+    st_root -> children[j + 1] = st_root -> children[j + 2];
+  }
+  st_root -> n--;
+  delete right;
+}
 
-        //erase moved child
-        left -> keyvals.erase(left -> keyvals.size() -1);
-      }
-      else
-      {
-        left -> keyvals.insert(st_root -> keyvals[key_idx], 1);
-        left -> keyvals.insert(right -> keyvals[0], 2);
-        if(!(right -> leaf()))
-        {
-          for(int i = 0; i < right -> children.size(); i++)
-          {
-            left -> children.insert(right->child(i), left -> children.size());
-          }
-        }
-        st_root -> keyvals.erase(key_idx);
-        delete right;
-        st_root -> children.erase(child_idx);
-        child_idx--;
-      }
+// give the child at child_idx a spare key by borrowing from a
+// sibling (case 3a) or merging with one (case 3b)
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::rebalance(Node* st_root, int& child_idx)
+{
+  // the erase descends into (and so changes) the child either way
+  Node* curr = own_child(st_root, child_idx);
+  if(curr -> n > MIN_KEYS)
+  {
+    return;
+  }
+  Node* right = child_idx < st_root -> n ? st_root -> child(child_idx + 1) : nullptr;
+  Node* left = child_idx > 0 ? st_root -> child(child_idx - 1) : nullptr;
+  if(right != nullptr && right -> n > MIN_KEYS)
+  {
+    right = own_child(st_root, child_idx + 1);
+    // rotate the parent key down and the right's first key up
+    curr -> keys[curr -> n] = std::move(st_root -> keys[child_idx]);
+    curr -> vals[curr -> n] = std::move(st_root -> vals[child_idx]);
+    curr -> children[curr -> n + 1] = right -> children[0];
+    curr -> n++;
+    st_root -> keys[child_idx] = std::move(right -> keys[0]);
+    st_root -> vals[child_idx] = std::move(right -> vals[0]);
+    for(int j = 0; j < right -> n - 1; j++)
+    {
+      right -> keys[j] = std::move(right -> keys[j + 1]);
+      right -> vals[j] = std::move(right -> vals[j + 1]);
+      right -> children[j] = right -> children[j + 1];
+    }
+    right -> children[right -> n - 1] = right -> children[right -> n];
+    right -> n--;
+  }
+  else if(left != nullptr && left -> n > MIN_KEYS)
+  {
+    left = own_child(st_root, child_idx - 1);
+    // rotate the parent key down and the left's last key up
+    for(int j = curr -> n; j > 0; j--)
+    {
+      curr -> keys[j] = std::move(curr -> keys[j - 1]);
+      curr -> vals[j] = std::move(curr -> vals[j - 1]);
+      curr -> children[j + 1] = curr -> children[j];
     }
-    
+    curr -> children[1] = curr -> children[0];
+    curr -> keys[0] = std::move(st_root -> keys[child_idx - 1]);
+    curr -> vals[0] = std::move(st_root -> vals[child_idx - 1]);
+    curr -> children[0] = left -> children[left -> n];
+    curr -> n++;
+    st_root -> keys[child_idx - 1] = std::move(left -> keys[left -> n - 1]);
+    st_root -> vals[child_idx - 1] = std::move(left -> vals[left -> n - 1]);
+    left -> n--;
+  }
+  else if(right != nullptr)
+  {
+    merge(st_root, child_idx);
+  }
+  else
+  {
+    merge(st_root, child_idx - 1);
+    child_idx--;
   }
 }
 
-// find_keys helper
-template<typename K, typename V>
-void BTreeMap<K,V>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
+// each round moves every unfinished search in the group down one
+// level and prefetches the child it lands on, so the group's next
+// round finds its nodes already on the way in
+template<typename K, typename V, int Order>
+template<typename F>
+void BTreeMap<K,V,Order>::find_many(const ArraySeq<K>& keys, F f) const
 {
-  if(st_root != nullptr)
+  if(root == nullptr)
   {
-    if(!(st_root -> leaf()))
+    for(int i = 0; i < keys.size(); i++)
     {
-      for(int i = 0; i < st_root -> keyvals.size(); i++)
+      f(i, nullptr);
+    }
+    return;
+  }
+  const K* group_keys[PROBE_GROUP];
+  const Node* nodes[PROBE_GROUP];
+  for(int start = 0; start < keys.size(); start += PROBE_GROUP)
+  {
+    int n = keys.size() - start < PROBE_GROUP ? keys.size() - start : PROBE_GROUP;
+    for(int i = 0; i < n; i++)
+    {
+      group_keys[i] = &keys[start + i];
+      nodes[i] = root;
+    }
+    int active = n;
+    while(active > 0)
+    {
+      active = 0;
+      for(int i = 0; i < n; i++)
       {
-        if(st_root -> key(i) > k1)
+        const Node* temp = nodes[i];
+        if(temp == nullptr)
         {
-          find_keys(k1, k2, st_root -> child(i), keys);
+          continue;
         }
-        if(st_root -> key(i) <= k2 && st_root -> key(i) >= k1)
+        const K& key = *group_keys[i];
+        int j = lower_bound(temp, key);
+        if(j < temp -> n && !(key < temp -> key(j)))
         {
-          keys.insert(st_root -> key(i), keys.size());
+          f(start + i, &temp -> vals[j]);
+          nodes[i] = nullptr;
+          continue;
         }
-      }
-      if(st_root -> key(st_root -> keyvals.size() - 1) < k2)
-      {
-        find_keys(k1, k2, st_root -> child(st_root -> keyvals.size()), keys);
-      }
-    }
-    else
-    {
-      for(int i = 0; i < st_root -> keyvals.size(); i++)
-      {
-        if(st_root -> key(i) <= k2 && st_root -> key(i) >= k1)
+        temp = temp -> leaf() ? nullptr : temp -> child(j);
+        nodes[i] = temp;
+        if(temp == nullptr)
+        {
+          f(start + i, nullptr);
+        }
+        else
         {
-          keys.insert(st_root -> key(i), keys.size());
+          __builtin_prefetch(temp);
+          active++;
         }
       }
-      
     }
   }
-  
 }
 
-// sorted_keys helper
-template<typename K, typename V>
-void BTreeMap<K,V>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
+// find_keys helper
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
 {
-  if(!(root == nullptr))
+  if(st_root == nullptr)
+  {
+    return;
+  }
+  // skip the keys (and subtrees) entirely below the range
+  int i = lower_bound(st_root, k1);
+  for(; i < st_root -> n; i++)
   {
     if(!(st_root -> leaf()))
     {
-      for(int i = 0; i < st_root -> keyvals.size(); i++)
-      {
-        sorted_keys(st_root -> child(i), keys);
-        keys.insert(st_root -> key(i), keys.size());
-      }
-      sorted_keys(st_root -> child(st_root -> keyvals.size()), keys);
+      find_keys(k1, k2, st_root -> child(i), keys);
     }
-    else
+    if(k2 < st_root -> key(i))
     {
-      for(int i = 0; i < st_root -> keyvals.size(); i++)
-      {
-        keys.insert(st_root -> key(i), keys.size());
-      }
+      return;
     }
+    keys.insert(st_root -> key(i), keys.size());
+  }
+  if(!(st_root -> leaf()))
+  {
+    find_keys(k1, k2, st_root -> child(st_root -> n), keys);
   }
 }
 
-// height helper
-template<typename K, typename V>
-int BTreeMap<K,V>::height(const Node* st_root) const
+// sorted_keys helper
+template<typename K, typename V, int Order>
+void BTreeMap<K,V,Order>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
 {
-  if(root == nullptr)
+  if(st_root == nullptr)
   {
-    return 0;
+    return;
   }
-  int height = 0;
-  Node* temp = root;
-  while(!(temp -> leaf()))
+  for(int i = 0; i < st_root -> n; i++)
   {
-    height++;
-    temp = temp -> child(0);
+    if(!(st_root -> leaf()))
+    {
+      sorted_keys(st_root -> child(i), keys);
+    }
+    keys.insert(st_root -> key(i), keys.size());
+  }
+  if(!(st_root -> leaf()))
+  {
+    sorted_keys(st_root -> child(st_root -> n), keys);
   }
-  height++;
-  return height;
 }
 
 #endif
@@ -19,6 +19,11 @@
 #include <functional>
 #include <vector>
 #include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <algorithm>
+#include <random>
 #include "util.h"
 #include "arrayseq.h"
 #include "map.h"
@@ -28,6 +33,28 @@
 using namespace std;
 using namespace std::chrono;
 
+// heap allocations made so far, counted by the replacement operator
+// new below (array new and the deletes forward to these)
+long heap_allocs = 0;
+
+void* operator new(std::size_t size)
+{
+  ++heap_allocs;
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
 // NOTE: all data is "shuffled"
 
 double timed_insert(Map<int,int>& m, int key);
@@ -36,12 +63,22 @@ double timed_contains(const Map<int,int>& m, int key);
 double timed_find_range(const Map<int,int>& m, int key1, int key2);
 double timed_next_key(const Map<int,int>& m, int key); 
 double timed_sorted_keys(const Map<int,int>& m);
+void sweep_row(const string& label, Map<int,int>& m, const ArraySeq<int>& keys);
+double timed_in_order_insert(Map<int,int>& m, const ArraySeq<pair<int,int>>& pairs);
+template<typename M>
+double timed_bulk_load(M& m, const ArraySeq<pair<int,int>>& pairs);
+void early_exit_row(const string& label, const Map<int,int>& m, int k1, int k2, int k);
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n);
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys);
 
 // test parameters
 const int start = 0;
 const int step = 100000; // 5000; // 15000
 const int stop = 2000000; // 50000; // 150000
 const int runs = 2;
+const int string_n = 200000;
 
 
 int main(int argc, char* argv[])
@@ -150,7 +187,100 @@ int main(int argc, char* argv[])
     
     cout << endl;
   }
-  
+
+  // B-tree order sweep (comment lines so the plot script skips them)
+  cout << "# order sweep over " << stop << " keys (msec): load, "
+       << "contains all, find range (1/20th), height" << endl;
+  {
+    AVLMap<int,int> m;
+    sweep_row("avl", m, keys);
+    cout << m.height() << endl;
+  }
+  {
+    BTreeMap<int,int,4> m;
+    sweep_row("btree-4", m, keys);
+    cout << m.height() << endl;
+  }
+  {
+    BTreeMap<int,int,16> m;
+    sweep_row("btree-16", m, keys);
+    cout << m.height() << endl;
+  }
+  {
+    BTreeMap<int,int,64> m;
+    sweep_row("btree-64", m, keys);
+    cout << m.height() << endl;
+  }
+  {
+    BTreeMap<int,int,128> m;
+    sweep_row("btree-128", m, keys);
+    cout << m.height() << endl;
+  }
+
+  // bulk load vs one-at-a-time insert of sorted input
+  cout << "# sorted load over " << stop << " keys (msec): avl bulk, "
+       << "avl insert, btree bulk, btree insert" << endl;
+  {
+    ArraySeq<pair<int,int>> pairs;
+    for (int i = 0; i < stop; ++i)
+      pairs.insert(make_pair(2 * (i + 1), i), pairs.size());
+    AVLMap<int,int> m1, m2;
+    BTreeMap<int,int> m3, m4;
+    cout << "# " << timed_bulk_load(m1, pairs) << " "
+         << timed_in_order_insert(m2, pairs) << " "
+         << timed_bulk_load(m3, pairs) << " "
+         << timed_in_order_insert(m4, pairs) << endl;
+  }
+
+  // first 100 keys of the full key range, find_keys vs cursor
+  {
+    ArraySeq<pair<int,int>> pairs;
+    for (int i = 0; i < stop; ++i)
+      pairs.insert(make_pair(2 * (i + 1), i), pairs.size());
+    AVLMap<int,int> m1(pairs);
+    BTreeMap<int,int> m2(pairs);
+    BTreeMap<int,int,64> m3(pairs);
+    cout << "# first 100 of " << stop << " keys (msec): find_keys, "
+         << "key_range" << endl;
+    early_exit_row("avl", m1, 0, stop * 2, 100);
+    early_exit_row("btree-4", m2, 0, stop * 2, 100);
+    early_exit_row("btree-64", m3, 0, stop * 2, 100);
+  }
+
+  // contains one key at a time vs contains_many in batches
+  cout << "# batched contains of " << stop << " keys (msec): one at a time, "
+       << "batches of 16, 256, 4096, 65536" << endl;
+  {
+    AVLMap<int,int> m1;
+    BTreeMap<int,int> m2;
+    BTreeMap<int,int,64> m3;
+    for (int i = 0; i < stop; ++i) {
+      m1.insert(keys[i], vals[i]);
+      m2.insert(keys[i], vals[i]);
+      m3.insert(keys[i], vals[i]);
+    }
+    // queries in random order, so neighboring lookups share nothing
+    vector<int> order;
+    for (int i = 0; i < keys.size(); ++i)
+      order.push_back(keys[i]);
+    shuffle(order.begin(), order.end(), mt19937(17));
+    ArraySeq<int> queries;
+    for (int key : order)
+      queries.insert(key, queries.size());
+    batch_row("avl", m1, queries);
+    batch_row("btree-4", m2, queries);
+    batch_row("btree-64", m3, queries);
+  }
+
+  // string keys and values copied, moved, and emplaced (comment lines
+  // so the plot script skips them)
+  cout << "# string load over " << string_n << " keys: copy msec, "
+       << "copy allocs/insert, move msec, move allocs/insert, "
+       << "try_emplace msec, try_emplace allocs/insert" << endl;
+  string_row<AVLMap<string,string>>("avl", keys, string_n);
+  string_row<BTreeMap<string,string>>("btree-4", keys, string_n);
+  string_row<BTreeMap<string,string,64>>("btree-64", keys, string_n);
+
 }
 
 
@@ -230,6 +360,132 @@ double timed_sorted_keys(const Map<int,int>& m)
   return (total/1000) / runs;
 }
 
+// loads all keys, then times looking each one up and one range
+// query; prints everything but the height
+void sweep_row(const string& label, Map<int,int>& m, const ArraySeq<int>& keys)
+{
+  int n = keys.size();
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    m.insert(keys[i], i);
+  auto t1 = high_resolution_clock::now();
+  int found = 0;
+  for (int i = 0; i < n; ++i)
+    found += m.contains(keys[i]);
+  auto t2 = high_resolution_clock::now();
+  m.find_keys(n, n + (n/20));
+  auto t3 = high_resolution_clock::now();
+  assert(found == n);
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << " ";
+}
 
+// inserts the (sorted) pairs one at a time into an empty map
+double timed_in_order_insert(Map<int,int>& m, const ArraySeq<pair<int,int>>& pairs)
+{
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < pairs.size(); ++i)
+    m.insert(pairs[i].first, pairs[i].second);
+  auto t1 = high_resolution_clock::now();
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// builds the map from the sorted pairs in one pass
+template<typename M>
+double timed_bulk_load(M& m, const ArraySeq<pair<int,int>>& pairs)
+{
+  auto t0 = high_resolution_clock::now();
+  m.bulk_load(pairs);
+  auto t1 = high_resolution_clock::now();
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// reads the first k keys of [k1, k2] from the result of find_keys and
+// from a cursor, printing both times
+void early_exit_row(const string& label, const Map<int,int>& m, int k1, int k2, int k)
+{
+  long sum = 0;
+  auto t0 = high_resolution_clock::now();
+  ArraySeq<int> keys = m.find_keys(k1, k2);
+  for (int i = 0; i < k && i < keys.size(); ++i)
+    sum += keys[i];
+  auto t1 = high_resolution_clock::now();
+  KeyRange<int> r = m.key_range(k1, k2);
+  for (int i = 0; i < k && r.valid(); ++i, r.next())
+    sum -= r.key();
+  auto t2 = high_resolution_clock::now();
+  assert(sum == 0);
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << endl;
+}
 
+// loads n string keys with 40 character values three ways: copied
+// from const references, moved in, and with try_emplace building the
+// value from its arguments. Prints the time (msec) and the heap
+// allocations per insert of each.
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  vector<string> key_strs, val_strs;
+  for (int i = 0; i < n; ++i) {
+    key_strs.push_back("string key number " + to_string(keys[i]));
+    val_strs.push_back(string(40, 'a' + i % 26));
+  }
+  cout << "# " << label;
+  for (int mode = 0; mode < 3; ++mode) {
+    vector<string> ks = key_strs;
+    vector<string> vs = val_strs;
+    M m;
+    long a0 = heap_allocs;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+      if (mode == 0)
+        m.insert(ks[i], vs[i]);
+      else if (mode == 1)
+        m.insert(std::move(ks[i]), std::move(vs[i]));
+      else
+        m.try_emplace(ks[i], 40, 'a' + i % 26);
+    }
+    auto t1 = high_resolution_clock::now();
+    long a1 = heap_allocs;
+    assert(m.size() == n);
+    cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << (a1 - a0) / (double) n;
+  }
+  cout << endl;
+}
 
+// looks every key up with contains, then with contains_many in
+// batches of each size, printing the times (msec)
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys)
+{
+  long found = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < keys.size(); ++i)
+    found += m.contains(keys[i]);
+  auto t1 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+  for (int size = 16; size <= 65536; size *= 16) {
+    vector<ArraySeq<int>> batches;
+    for (int i = 0; i < keys.size(); i += size) {
+      batches.push_back(ArraySeq<int>());
+      for (int j = i; j < i + size && j < keys.size(); ++j)
+        batches.back().insert(keys[j], j - i);
+    }
+    auto t2 = high_resolution_clock::now();
+    for (const ArraySeq<int>& batch : batches) {
+      ArraySeq<bool> results = m.contains_many(batch);
+      for (int j = 0; j < results.size(); ++j)
+        found -= results[j];
+    }
+    auto t3 = high_resolution_clock::now();
+    cout << " " << duration_cast<microseconds>(t3 - t2).count() / 1000.0;
+  }
+  cout << endl;
+  assert(found == -3L * keys.size());
+}
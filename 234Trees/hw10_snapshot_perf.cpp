@@ -0,0 +1,177 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: hw10_snapshot_perf.cpp
+// DATE: Spring 2022
+// DESC: Reader throughput of AVLMap and BTreeMap while one writer
+//       thread streams inserts. To run from the command line use:
+//          ./hw10_snapshot_perf
+//       which prints, for each reader count, the millions of lookups
+//       per second the readers complete through persistent-mode
+//       snapshots (one snapshot per lookup, and one per 64 lookups)
+//       and through a reader/writer lock, along with the writer's
+//       thousands of inserts per second. Lines starting with # are
+//       comments.
+//---------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <random>
+#include <cassert>
+#include "avlmap.h"
+#include "btreemap.h"
+
+
+using namespace std;
+using namespace std::chrono;
+
+// reads and writes completed during one run
+struct Result
+{
+  double reads;
+  double writes;
+};
+
+template<typename M>
+Result snapshot_run(int readers, int batch);
+
+template<typename M>
+Result locked_run(int readers);
+
+template<typename M>
+void row_part(int readers);
+
+// test parameters
+const int preload = 100000;
+const milliseconds run_time(300);
+
+
+int main(int argc, char* argv[])
+{
+  cout << fixed << showpoint;
+  cout << setprecision(2);
+
+  cout << "# Reader lookups (millions per second) while one writer "
+       << "inserts new keys" << endl;
+  cout << "# Map preloaded with " << preload << " keys; each run lasts "
+       << run_time.count() << " ms" << endl;
+  cout << "# hardware threads: " << thread::hardware_concurrency() << endl;
+  cout << "# Column 1 = reader threads" << endl;
+  cout << "# Columns 2-6 = AVLMap: snapshot per lookup, snapshot per 64 "
+       << "lookups, reader/writer lock; writer kinserts/s with "
+       << "snapshots, with the lock" << endl;
+  cout << "# Columns 7-11 = BTreeMap (order 4), same columns" << endl;
+
+  for (int readers = 1; readers <= 8; readers *= 2) {
+    cout << readers;
+    row_part<AVLMap<int,int>>(readers);
+    row_part<BTreeMap<int,int>>(readers);
+    cout << endl;
+  }
+}
+
+
+// prints one map's columns of a row
+template<typename M>
+void row_part(int readers)
+{
+  Result single = snapshot_run<M>(readers, 1);
+  Result batched = snapshot_run<M>(readers, 64);
+  Result locked = locked_run<M>(readers);
+  cout << " " << single.reads << " " << batched.reads << " " << locked.reads
+       << " " << batched.writes * 1000 << " " << locked.writes * 1000;
+}
+
+
+// runs the writer on the calling thread while the readers look up
+// preloaded keys through read(gen, hits), all until run_time is up.
+// Each thread watches the clock itself, since a reader-preferring
+// lock can hold the writer off for the whole run. Returns millions of
+// reads and writes per second.
+template<typename M, typename R, typename W>
+Result run(int readers, R read, W write)
+{
+  auto t0 = steady_clock::now();
+  auto deadline = t0 + run_time;
+  vector<long> counts(readers * 8);
+  vector<long> found(readers * 8);
+  vector<thread> workers;
+  for (int t = 0; t < readers; ++t) {
+    workers.emplace_back([&, t] {
+      mt19937 gen(t + 1);
+      long reads = 0;
+      long hits = 0;
+      while (steady_clock::now() < deadline)
+        reads += read(gen, hits);
+      // spaced out so the threads do not share a cache line
+      counts[t * 8] = reads;
+      found[t * 8] = hits;
+    });
+  }
+  long writes = 0;
+  while (steady_clock::now() < deadline)
+    write(preload + writes++);
+  for (thread& worker : workers)
+    worker.join();
+  double secs = duration_cast<microseconds>(steady_clock::now() - t0).count() / 1e6;
+  long reads = 0;
+  long hits = 0;
+  for (int t = 0; t < readers; ++t) {
+    reads += counts[t * 8];
+    hits += found[t * 8];
+  }
+  // every preloaded key stays in the map, so every lookup hits (and
+  // the lookups cannot be optimized away)
+  assert(hits == reads);
+  return {reads / secs / 1e6, writes / secs / 1e6};
+}
+
+
+// readers take a snapshot for every batch lookups; the writer's
+// inserts are each published
+template<typename M>
+Result snapshot_run(int readers, int batch)
+{
+  M m;
+  for (int i = 0; i < preload; ++i)
+    m.insert(i, i);
+  m.persistent(true);
+  uniform_int_distribution<int> key_dist(0, preload - 1);
+  return run<M>(readers,
+    [&](mt19937& gen, long& hits) {
+      typename M::Snapshot snap = m.snapshot();
+      for (int i = 0; i < batch; ++i)
+        hits += snap.contains(key_dist(gen));
+      return batch;
+    },
+    [&](int key) {
+      m.insert(key, key);
+    });
+}
+
+
+// readers hold the shared lock for one lookup; the writer holds the
+// exclusive lock for one insert
+template<typename M>
+Result locked_run(int readers)
+{
+  M m;
+  shared_mutex lock;
+  for (int i = 0; i < preload; ++i)
+    m.insert(i, i);
+  uniform_int_distribution<int> key_dist(0, preload - 1);
+  return run<M>(readers,
+    [&](mt19937& gen, long& hits) {
+      shared_lock<shared_mutex> guard(lock);
+      hits += m.contains(key_dist(gen));
+      return 1;
+    },
+    [&](int key) {
+      unique_lock<shared_mutex> guard(lock);
+      m.insert(key, key);
+    });
+}
@@ -7,6 +7,9 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
 #include <gtest/gtest.h>
 #include "arrayseq.h"
 #include "btreemap.h"
@@ -737,6 +740,317 @@ TEST(BasicBTreeMapTests, PrevKeyCheck)
   ASSERT_EQ('d', next);
 }
 
+//----------------------------------------------------------------------
+// Higher Order Tests
+//----------------------------------------------------------------------
+
+TEST(BasicBTreeMapTests, HigherOrderInsertEraseCheck)
+{
+  int n = 2000;
+  BTreeMap<int,int,16> m;
+  // 7919 is prime, so i*7919 % n visits every key once out of order
+  for (int i = 0; i < n; ++i)
+    m.insert((i * 7919) % n, i);
+  ASSERT_EQ(n, m.size());
+  ASSERT_GE(4, m.height());
+  for (int i = 0; i < n; ++i)
+    ASSERT_EQ(true, m.contains(i));
+  for (int i = 0; i < n; i += 2)
+    m.erase(i);
+  ASSERT_EQ(n/2, m.size());
+  for (int i = 0; i < n; ++i)
+    ASSERT_EQ(i % 2 == 1, m.contains(i));
+  ArraySeq<int> k = m.sorted_keys();
+  ASSERT_EQ(n/2, k.size());
+  for (int i = 0; i < k.size(); ++i)
+    ASSERT_EQ(2*i + 1, k[i]);
+  EXPECT_THROW(m.erase(0), std::out_of_range);
+  for (int i = 1; i < n; i += 2)
+    m.erase(i);
+  ASSERT_EQ(0, m.size());
+  ASSERT_EQ(0, m.height());
+}
+
+TEST(BasicBTreeMapTests, HigherOrderQueryCheck)
+{
+  BTreeMap<int,int,64> m;
+  for (int i = 1; i <= 1000; ++i)
+    m.insert(i * 10, i);
+  ASSERT_EQ(2, m.height());
+  ASSERT_EQ(500, m[5000]);
+  int key = 0;
+  ASSERT_EQ(true, m.next_key(5000, key));
+  ASSERT_EQ(5010, key);
+  ASSERT_EQ(true, m.next_key(5005, key));
+  ASSERT_EQ(5010, key);
+  ASSERT_EQ(true, m.prev_key(5000, key));
+  ASSERT_EQ(4990, key);
+  ASSERT_EQ(false, m.next_key(10000, key));
+  ASSERT_EQ(false, m.prev_key(10, key));
+  ArraySeq<int> k = m.find_keys(995, 1105);
+  ASSERT_EQ(11, k.size());
+  ASSERT_EQ(1000, k[0]);
+  ASSERT_EQ(1100, k[10]);
+  BTreeMap<int,int,64> m2(m);
+  m2.erase(5000);
+  ASSERT_EQ(true, m.contains(5000));
+  ASSERT_EQ(false, m2.contains(5000));
+  BTreeMap<int,int,64> m3(std::move(m2));
+  ASSERT_EQ(0, m2.size());
+  ASSERT_EQ(999, m3.size());
+}
+
+TEST(BasicBTreeMapTests, BulkLoadCheck)
+{
+  ArraySeq<std::pair<int,int>> pairs;
+  for (int i = 1; i <= 1000; ++i)
+    pairs.insert(std::make_pair(i * 10, i), pairs.size());
+  BTreeMap<int,int> m(pairs);
+  ASSERT_EQ(1000, m.size());
+  ASSERT_GE(5, m.height());
+  for (int i = 1; i <= 1000; ++i)
+    ASSERT_EQ(i, m[i * 10]);
+  ArraySeq<int> k = m.find_keys(995, 1105);
+  ASSERT_EQ(11, k.size());
+  ASSERT_EQ(1000, k[0]);
+  // the loaded tree supports the usual updates
+  for (int i = 1; i <= 1000; ++i)
+    m.insert(i * 10 + 5, i);
+  for (int i = 1; i <= 1000; i += 2)
+    m.erase(i * 10);
+  ASSERT_EQ(1500, m.size());
+  ASSERT_EQ(false, m.contains(10));
+  ASSERT_EQ(true, m.contains(20));
+  ASSERT_EQ(true, m.contains(15));
+  BTreeMap<int,int,64> m2(pairs);
+  ASSERT_EQ(1000, m2.size());
+  ASSERT_EQ(2, m2.height());
+  ASSERT_EQ(500, m2[5000]);
+  pairs.insert(std::make_pair(0, 0), pairs.size());
+  ASSERT_THROW(m2.bulk_load(pairs), std::invalid_argument);
+  ASSERT_EQ(1000, m2.size());
+}
+
+TEST(BasicBTreeMapTests, KeyRangeCursorCheck)
+{
+  BTreeMap<int,int> m;
+  for (int i = 1; i <= 1000; ++i)
+    m.insert((i * 37) % 1001 * 10, i);
+  // keys are the multiples of 10 from 10 to 10000
+  KeyRange<int> r = m.key_range(995, 1105);
+  int expected = 1000;
+  while (r.valid()) {
+    ASSERT_EQ(expected, r.key());
+    expected += 10;
+    r.next();
+  }
+  ASSERT_EQ(1110, expected);
+  int n = 0;
+  for (int k : m.keys()) {
+    ASSERT_EQ((n + 1) * 10, k);
+    ++n;
+  }
+  ASSERT_EQ(1000, n);
+  // stopping early only visits the keys that were read
+  BTreeMap<int,int,16> m2;
+  for (int i = 1; i <= 1000; ++i)
+    m2.insert(i, i);
+  KeyRange<int> r2 = m2.key_range(500, 1000);
+  for (int i = 500; i < 505; ++i) {
+    ASSERT_EQ(i, r2.key());
+    r2.next();
+  }
+  ASSERT_EQ(false, m2.key_range(1001, 2000).valid());
+  ASSERT_EQ(false, m2.key_range(10, 5).valid());
+}
+
+TEST(BasicBTreeMapTests, MoveInsertCheck)
+{
+  BTreeMap<std::string,std::string> m;
+  std::vector<const char*> buffers;
+  for (int i = 0; i < 300; ++i) {
+    std::string value(40, 'a' + (i % 26));
+    buffers.push_back(value.data());
+    m.insert(std::to_string(i * 7 % 300), std::move(value));
+  }
+  // splits and shifts move values instead of copying them
+  for (int i = 0; i < 300; ++i)
+    ASSERT_EQ(buffers[i], m[std::to_string(i * 7 % 300)].data());
+  for (int i = 0; i < 300; i += 2)
+    m.erase(std::to_string(i * 7 % 300));
+  for (int i = 1; i < 300; i += 2)
+    ASSERT_EQ(buffers[i], m[std::to_string(i * 7 % 300)].data());
+  ASSERT_EQ(false, m.try_emplace("7", 3, 'z'));
+  ASSERT_EQ(true, m.try_emplace("zz", 3, 'z'));
+  ASSERT_EQ("zzz", m["zz"]);
+  ASSERT_EQ(151, m.size());
+}
+
+TEST(BasicBTreeMapTests, TryEmplaceCheck)
+{
+  BTreeMap<int,std::string> m;
+  for (int i = 0; i < 1000; i += 2)
+    m.insert(i, "even");
+  // keys already there (including ones met while splitting on the way
+  // down) are left alone
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i % 2 == 1, m.try_emplace(i, 3, 'z'));
+  ASSERT_EQ(1000, m.size());
+  ArraySeq<int> keys = m.sorted_keys();
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i, keys[i]);
+  ASSERT_EQ("even", m[500]);
+  ASSERT_EQ("zzz", m[501]);
+  // a published version is not changed by either outcome
+  m.persistent(true);
+  BTreeMap<int,std::string>::Snapshot snap = m.snapshot();
+  ASSERT_EQ(false, m.try_emplace(10, 1, 'y'));
+  ASSERT_EQ(true, m.try_emplace(1000, 1, 'y'));
+  ASSERT_EQ(1000, snap.size());
+  ASSERT_EQ(false, snap.contains(1000));
+  ASSERT_EQ(1001, m.snapshot().size());
+  ASSERT_EQ("y", m[1000]);
+}
+
+TEST(BasicBTreeMapTests, BatchLookupCheck)
+{
+  BTreeMap<int,int> m1;
+  BTreeMap<int,int,64> m2;
+  for (int i = 0; i < 2000; ++i) {
+    m1.insert((i * 37) % 2000 * 2, i);
+    m2.insert((i * 37) % 2000 * 2, i);
+  }
+  // even keys 0..3998 are present, odd keys and negatives are not,
+  // and some keys repeat
+  ArraySeq<int> keys;
+  for (int i = 0; i < 5000; ++i)
+    keys.insert((i * 7919) % 4200 - 100, i);
+  ArraySeq<bool> found1 = m1.contains_many(keys);
+  ArraySeq<bool> found2 = m2.contains_many(keys);
+  ArraySeq<int> present;
+  for (int i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(m1.contains(keys[i]), found1[i]);
+    ASSERT_EQ(found1[i], found2[i]);
+    if (found1[i])
+      present.insert(keys[i], present.size());
+  }
+  ArraySeq<int> values1 = m1.get_many(present);
+  ArraySeq<int> values2 = m2.get_many(present);
+  for (int i = 0; i < present.size(); ++i) {
+    ASSERT_EQ(m1[present[i]], values1[i]);
+    ASSERT_EQ(m1[present[i]], values2[i]);
+  }
+  ASSERT_THROW(m1.get_many(keys), std::out_of_range);
+  ASSERT_THROW(m2.get_many(keys), std::out_of_range);
+  BTreeMap<int,int> empty;
+  ASSERT_EQ(false, empty.contains_many(keys)[0]);
+  ASSERT_THROW(empty.get_many(keys), std::out_of_range);
+}
+
+TEST(BasicBTreeMapTests, PersistentSnapshotCheck)
+{
+  BTreeMap<int,int> m;
+  ASSERT_THROW(m.snapshot(), std::logic_error);
+  for (int i = 0; i < 100; ++i)
+    m.insert(i, i);
+  m.persistent(true);
+  ASSERT_EQ(true, m.persistent());
+  BTreeMap<int,int>::Snapshot before = m.snapshot();
+  // splits, borrows, and merges all change nodes the snapshot shares
+  for (int i = 100; i < 200; ++i)
+    m.insert(i, i);
+  for (int i = 0; i < 200; i += 2)
+    m.erase(i);
+  ASSERT_THROW(m.erase(0), std::out_of_range);
+  m[1] = -1;
+  BTreeMap<int,int>::Snapshot after = m.snapshot();
+  ASSERT_EQ(100, before.size());
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_EQ(i < 100, before.contains(i));
+    if (i < 100)
+      ASSERT_EQ(i, before[i]);
+  }
+  ASSERT_THROW(before[100], std::out_of_range);
+  // operator[] updates wait for the next publish
+  ASSERT_EQ(100, after.size());
+  ASSERT_EQ(1, after[1]);
+  m.publish();
+  ASSERT_EQ(-1, m.snapshot()[1]);
+  ASSERT_EQ(1, after[1]);
+  ArraySeq<int> keys = after.sorted_keys();
+  ArraySeq<int> current = m.sorted_keys();
+  ASSERT_EQ(100, keys.size());
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(current[i], keys[i]);
+  // copies hold the version after the original is gone
+  BTreeMap<int,int>::Snapshot copy = before;
+  before = after;
+  m.clear();
+  ASSERT_EQ(true, m.snapshot().empty());
+  ASSERT_EQ(100, copy.size());
+  ASSERT_EQ(99, copy[99]);
+  ASSERT_EQ(100, before.size());
+  m.persistent(false);
+  ASSERT_THROW(m.snapshot(), std::logic_error);
+  m.insert(6, 6);
+  ASSERT_EQ(1, m.size());
+  ASSERT_EQ(100, copy.size());
+}
+
+TEST(BasicBTreeMapTests, PersistentMoveCheck)
+{
+  BTreeMap<int,int> a;
+  a.persistent(true);
+  for (int i = 0; i < 1000; ++i)
+    a.insert(i, i);
+  // a map with published versions is copied
+  BTreeMap<int,int> b(std::move(a));
+  ASSERT_EQ(1000, b.size());
+  ASSERT_EQ(0, a.size());
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i, b[i]);
+  // moving a published map into itself leaves it alone
+  for (int i = 0; i < 10; ++i)
+    a.insert(i, i);
+  BTreeMap<int,int>& alias = a;
+  a = std::move(alias);
+  ASSERT_EQ(10, a.size());
+  ASSERT_EQ(10, a.snapshot().size());
+}
+
+TEST(BasicBTreeMapTests, SnapshotThreadedCheck)
+{
+  const int readers = 4;
+  const int n = 20000;
+  BTreeMap<int,int,8> m;
+  m.persistent(true);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> workers;
+  // keys go in ascending order, so a snapshot of size s must hold
+  // exactly the keys 0 to s - 1
+  for (int t = 0; t < readers; ++t) {
+    workers.emplace_back([&, t] {
+      int last = 0;
+      for (int round = 0; !done.load(); ++round) {
+        BTreeMap<int,int,8>::Snapshot snap = m.snapshot();
+        int s = snap.size();
+        EXPECT_LE(last, s);
+        last = s;
+        int probe = (round * 7919 + t) % (n + 1);
+        EXPECT_EQ(probe < s, snap.contains(probe));
+        if (s > 0)
+          EXPECT_EQ((s - 1) * 2, snap[s - 1]);
+      }
+    });
+  }
+  for (int i = 0; i < n; ++i)
+    m.insert(i, i * 2);
+  done.store(true);
+  for (std::thread& worker : workers)
+    worker.join();
+  ASSERT_EQ(n, m.snapshot().size());
+}
+
 //----------------------------------------------------------------------
 // Main
 //----------------------------------------------------------------------
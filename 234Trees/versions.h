@@ -0,0 +1,175 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: versions.h
+// DATE: Spring 2022
+// DESC: Publication and reclamation of the versions of a persistent
+//       (path-copying) tree. One writer publishes each new root; any
+//       number of reader threads take a counted reference to the
+//       current version without locking. A version whose last
+//       reference is dropped is pushed onto a garbage stack, and the
+//       writer frees its nodes the next time no reader is in the
+//       middle of taking a reference.
+//---------------------------------------------------------------------------
+
+#ifndef VERSIONS_H
+#define VERSIONS_H
+
+#include <atomic>
+
+
+template<typename Node>
+class Versions
+{
+public:
+
+  // a published tree: its root and size, and the number of
+  // references to it (one per snapshot, plus one while current)
+  struct Version {
+    const Node* root;
+    int count;
+    std::atomic<long> refs;
+    Version* next_garbage;
+  };
+
+  Versions() = default;
+  Versions(const Versions& rhs) = delete;
+  Versions& operator=(const Versions& rhs) = delete;
+
+  // Makes root the current version (writer only). The caller gives
+  // the version its own reference to root.
+  void publish(const Node* root, int count);
+
+  // Drops the current version, so acquire returns nullptr until the
+  // next publish (writer only)
+  void withdraw();
+
+  // Returns a new reference to the current version, or nullptr if
+  // there is none. Lock-free: it only retries when the writer has
+  // published a newer version in the meantime.
+  Version* acquire() const;
+
+  // Adds a reference to a version the caller already holds
+  void share(Version* version) const;
+
+  // Drops a reference from any thread
+  void release(Version* version) const;
+
+  // Calls free_root(root) for each version no longer referenced and
+  // deletes it, unless a reader is part way through acquire (writer
+  // only; the rest are freed by a later call). Returns at once when
+  // there are no versions, so writers can call it on every change.
+  template<typename F>
+  void collect(F free_root);
+
+  // Returns the number of versions not yet collected (writer only)
+  int live() const;
+
+private:
+
+  std::atomic<Version*> current{nullptr};
+
+  // readers between loading current and counting their reference
+  mutable std::atomic<long> acquiring{0};
+
+  // unreferenced versions, linked through next_garbage
+  mutable std::atomic<Version*> garbage{nullptr};
+
+  int versions = 0;
+
+};
+
+
+template<typename Node>
+void Versions<Node>::publish(const Node* root, int count)
+{
+  Version* version = new Version{root, count, {1}, nullptr};
+  versions++;
+  Version* old = current.exchange(version);
+  if(old != nullptr)
+  {
+    release(old);
+  }
+}
+
+template<typename Node>
+void Versions<Node>::withdraw()
+{
+  Version* old = current.exchange(nullptr);
+  if(old != nullptr)
+  {
+    release(old);
+  }
+}
+
+// a version whose count has reached zero is no longer current and is
+// never counted again, so a reader that lost the race reloads the
+// newer current version
+template<typename Node>
+typename Versions<Node>::Version* Versions<Node>::acquire() const
+{
+  acquiring.fetch_add(1);
+  Version* version = current.load();
+  while(version != nullptr)
+  {
+    long refs = version -> refs.load();
+    while(refs > 0 && !version -> refs.compare_exchange_weak(refs, refs + 1))
+    {
+    }
+    if(refs > 0)
+    {
+      break;
+    }
+    version = current.load();
+  }
+  acquiring.fetch_sub(1);
+  return version;
+}
+
+template<typename Node>
+void Versions<Node>::share(Version* version) const
+{
+  version -> refs.fetch_add(1);
+}
+
+template<typename Node>
+void Versions<Node>::release(Version* version) const
+{
+  if(version -> refs.fetch_sub(1) == 1)
+  {
+    version -> next_garbage = garbage.load();
+    while(!garbage.compare_exchange_weak(version -> next_garbage, version))
+    {
+    }
+  }
+}
+
+// Every version on the stack was replaced before this check, and a
+// reader that loaded one before it was replaced is still counted in
+// acquiring, so seeing zero means no reader can touch them again.
+template<typename Node>
+template<typename F>
+void Versions<Node>::collect(F free_root)
+{
+  if(versions == 0 || acquiring.load() != 0)
+  {
+    return;
+  }
+  Version* version = garbage.exchange(nullptr);
+  while(version != nullptr)
+  {
+    Version* next = version -> next_garbage;
+    free_root(version -> root);
+    delete version;
+    versions--;
+    version = next;
+  }
+}
+
+template<typename Node>
+int Versions<Node>::live() const
+{
+  return versions;
+}
+
+
+#endif
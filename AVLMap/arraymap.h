@@ -12,7 +12,7 @@
 
 
 template<typename K, typename V>
-class ArrayMap : public Map<K,V>
+class ArrayMap final : public Map<K,V>
 {
 public:
 
@@ -13,7 +13,7 @@
 
 
 template<typename K, typename V>
-class BinSearchMap : public Map<K,V>
+class BinSearchMap final : public Map<K,V>
 {
 public:
 
@@ -64,6 +64,13 @@ public:
 
   // Removes all key-value pairs from the map.
   void clear();
+
+  // Returns a cursor over the keys k such that k1 <= k <= k2 in
+  // ascending order, reading the array in place
+  KeyRange<K> key_range(const K& k1, const K& k2) const;
+
+  // Returns a cursor over all keys in ascending order
+  KeyRange<K> keys() const;
   
 
 private:
@@ -78,6 +85,31 @@ private:
   // implemented as a resizable array of (key-value) pairs
   ArraySeq<std::pair<K,V>> seq;
 
+  // cursor over the pairs from index up to an (optional) upper bound
+  class Cursor : public KeyCursor<K>
+  {
+  public:
+    Cursor(const ArraySeq<std::pair<K,V>>& seq, int index, const K* k2)
+      : seq(seq), index(index), bounded(k2 != nullptr)
+    {
+      if(bounded)
+      {
+        last = *k2;
+      }
+    }
+    bool valid() const
+    {
+      return index < seq.size() && !(bounded && last < seq[index].first);
+    }
+    const K& key() const { return seq[index].first; }
+    void next() { index++; }
+  private:
+    const ArraySeq<std::pair<K,V>>& seq;
+    int index;
+    bool bounded;
+    K last;
+  };
+
 };
 
 // TODO: Implement the functions above. Be sure to read over the
@@ -285,6 +317,26 @@ void BinSearchMap<K,V>::clear()
   seq.clear();
 }
 
+// Returns a cursor over the keys in [k1, k2]
+template<typename K, typename V>
+KeyRange<K> BinSearchMap<K,V>::key_range(const K& k1, const K& k2) const
+{
+  int index = 0;
+  bin_search(k1, index);
+  if(index != -1 && index < seq.size() && seq[index].first < k1)
+  {
+    index++;
+  }
+  return KeyRange<K>(new Cursor(seq, index, &k2));
+}
+
+// Returns a cursor over all keys
+template<typename K, typename V>
+KeyRange<K> BinSearchMap<K,V>::keys() const
+{
+  return KeyRange<K>(new Cursor(seq, 0, nullptr));
+}
+
 // If the key is in the collection, bin_search returns true and
 // provides the key's index within the array sequence (via the index
 // output parameter). If the key is not in the collection,
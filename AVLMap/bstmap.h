@@ -10,16 +10,21 @@
 
 #include "map.h"
 #include "arrayseq.h"
+#include "nodepool.h"
 
 
-template<typename K, typename V>
-class BSTMap : public Map<K,V>
+// NodeAlloc supplies the tree nodes (see nodepool.h)
+template<typename K, typename V, template<typename> class NodeAlloc = HeapAlloc>
+class BSTMap final : public Map<K,V>
 {
 public:
 
   // default constructor
   BSTMap();
 
+  // bulk-load constructor (see bulk_load)
+  BSTMap(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
   // copy constructor
   BSTMap(const BSTMap& rhs);
 
@@ -53,6 +58,15 @@ public:
   // Expects key to not exist in map prior to insertion.
   void insert(const K& key, const V& value);
 
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection, in which case args are left unused.
+  // Returns true if the key was added. Takes one descent.
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -81,8 +95,24 @@ public:
   // Removes all key-value pairs from the map.
   void clear();
 
+  // Returns a cursor over the keys k such that k1 <= k <= k2 in
+  // ascending order, walking the tree as the cursor advances
+  KeyRange<K> key_range(const K& k1, const K& k2) const;
+
+  // Returns a cursor over all keys in ascending order
+  KeyRange<K> keys() const;
+
+  // Replaces the contents of the map with the given key-value pairs,
+  // which must be in strictly ascending key order, building a
+  // balanced tree in linear time. Throws invalid_argument if the keys
+  // are not sorted.
+  void bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs);
+
   // Returns the height of the binary search tree
   int height() const;
+
+  // Returns the node allocation counters
+  const AllocStats& alloc_stats() const;
   
 private:
 
@@ -100,11 +130,33 @@ private:
   // array of linked lists
   Node* root = nullptr;
 
+  // allocator for the tree nodes
+  NodeAlloc<Node> alloc;
+
+  // in-order cursor from a lower bound up to an (optional) upper
+  // bound. The stack holds the nodes whose key and right subtree are
+  // still to be visited, with the current node on top.
+  class Cursor : public KeyCursor<K>
+  {
+  public:
+    Cursor(const Node* st_root, const K* k1, const K* k2);
+    bool valid() const;
+    const K& key() const;
+    void next();
+  private:
+    ArraySeq<const Node*> stack;
+    bool bounded = false;
+    K last;
+  };
+
   // clean up the tree and reset count to zero given subtree root
   void clear(Node* st_root);
 
   // copy assignment helper
-  Node* copy(const Node* rhs_st_root) const;
+  Node* copy(const Node* rhs_st_root);
+
+  // bulk_load helper: builds a subtree from pairs start to end
+  Node* build(const ArraySeq<std::pair<K,V>>& pairs, int start, int end);
   
   // erase helper
   Node* erase(const K& key, Node* st_root);
@@ -118,13 +170,25 @@ private:
 
   // height helper
   int height(const Node* st_root) const;
+
+  // shared body of the insert overloads, forwarding key and value
+  // into the new entry
+  template<typename KK, typename VV>
+  void insert_pair(KK&& key, VV&& value);
   
 };
 
 
-template<typename K, typename V>
-BSTMap<K,V>::BSTMap()
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::BSTMap()
+{
+}
+
+// bulk-load constructor
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::BSTMap(const ArraySeq<std::pair<K,V>>& sorted_pairs)
 {
+  bulk_load(sorted_pairs);
 }
 
 // TODO: Implement the BST Map functions below. Note that you are not
@@ -133,22 +197,22 @@ BSTMap<K,V>::BSTMap()
 // notes.
 
 // copy constructor
-template<typename K, typename V>
-BSTMap<K,V>::BSTMap(const BSTMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::BSTMap(const BSTMap& rhs)
 {
   *this = rhs;
 }
 
 // move constructor
-template<typename K, typename V>
-BSTMap<K,V>::BSTMap(BSTMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::BSTMap(BSTMap&& rhs)
 {
   *this = std::move(rhs);
 }
 
 // copy assignment
-template<typename K, typename V>
-BSTMap<K,V>& BSTMap<K,V>::operator=(const BSTMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>& BSTMap<K,V,NodeAlloc>::operator=(const BSTMap& rhs)
 {
   if(this != &rhs)
   {
@@ -156,48 +220,50 @@ BSTMap<K,V>& BSTMap<K,V>::operator=(const BSTMap& rhs)
     root = copy(rhs.root);
     count = rhs.count;
   }
+  return *this;
 }
 
 // move assignment
-template<typename K, typename V>
-BSTMap<K,V>& BSTMap<K,V>::operator=(BSTMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>& BSTMap<K,V,NodeAlloc>::operator=(BSTMap&& rhs)
 {
   if(this != &rhs)
   {
     clear();
     root = rhs.root;
     count = rhs.count;
+    alloc.swap(rhs.alloc);
     rhs.root = nullptr;
     rhs.count = 0;
-    return *this;
   }
+  return *this;
 }  
 
 // destructor
-template<typename K, typename V>
-BSTMap<K,V>::~BSTMap()
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::~BSTMap()
 {
   clear();
 }
 
 // Returns the number of key-value pairs in the map
-template<typename K, typename V>
-int BSTMap<K,V>::size() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+int BSTMap<K,V,NodeAlloc>::size() const
 {
   return count;
 }
 
 // Tests if the map is empty
-template<typename K, typename V>
-bool BSTMap<K,V>::empty() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool BSTMap<K,V,NodeAlloc>::empty() const
 {
   return count == 0;
 }
 
 // Allows values associated with a key to be updated. Throws
 // out_of_range if the given key is not in the collection.
-template<typename K, typename V>
-V& BSTMap<K,V>::operator[](const K& key)
+template<typename K, typename V, template<typename> class NodeAlloc>
+V& BSTMap<K,V,NodeAlloc>::operator[](const K& key)
 {
   if(root == nullptr)
   {
@@ -227,8 +293,8 @@ V& BSTMap<K,V>::operator[](const K& key)
 
 // Returns the value for a given key. Throws out_of_range if the
 // given key is not in the collection. 
-template<typename K, typename V>
-const V& BSTMap<K,V>::operator[](const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+const V& BSTMap<K,V,NodeAlloc>::operator[](const K& key) const
 {
   if(root == nullptr)
   {
@@ -258,12 +324,28 @@ const V& BSTMap<K,V>::operator[](const K& key) const
 
 // Extends the collection by adding the given key-value pair.
 // Expects key to not exist in map prior to insertion.
-template<typename K, typename V>
-void BSTMap<K,V>::insert(const K& key, const V& value)
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::insert(const K& key, const V& value)
 {
-  Node* node1 = new Node();
-  node1 -> key = key;
-  node1 -> value = value;
+  insert_pair(key, value);
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::insert(K&& key, V&& value)
+{
+  insert_pair(std::move(key), std::move(value));
+}
+
+// Shared insert body. The key is forwarded only once it is no longer
+// needed for placement.
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename KK, typename VV>
+void BSTMap<K,V,NodeAlloc>::insert_pair(KK&& key, VV&& value)
+{
+  Node* node1 = alloc.make();
+  node1 -> key = std::forward<KK>(key);
+  node1 -> value = std::forward<VV>(value);
   node1 -> left = nullptr;
   node1 -> right = nullptr;
   //count = 0;
@@ -278,7 +360,7 @@ void BSTMap<K,V>::insert(const K& key, const V& value)
     Node* temp = root;
     while(temp != nullptr)
     {
-      if(key < temp -> key)
+      if(node1 -> key < temp -> key)
       {
         if(temp -> left != nullptr)
         {
@@ -308,19 +390,52 @@ void BSTMap<K,V>::insert(const K& key, const V& value)
   }
 }
 
+// Adds the key with a value constructed from args unless the key is
+// already in the collection. The search stops at the empty link the
+// new node goes in, so the value is only built there.
+template<typename K, typename V, template<typename> class NodeAlloc>
+template<typename... Args>
+bool BSTMap<K,V,NodeAlloc>::try_emplace(const K& key, Args&&... args)
+{
+  Node** link = &root;
+  while(*link != nullptr)
+  {
+    if((*link) -> key == key)
+    {
+      return false;
+    }
+    if(key < (*link) -> key)
+    {
+      link = &((*link) -> left);
+    }
+    else
+    {
+      link = &((*link) -> right);
+    }
+  }
+  Node* node1 = alloc.make();
+  node1 -> key = key;
+  node1 -> value = V(std::forward<Args>(args)...);
+  node1 -> left = nullptr;
+  node1 -> right = nullptr;
+  *link = node1;
+  count++;
+  return true;
+}
+
 // Shrinks the collection by removing the key-value pair with the
 // given key. Does not modify the collection if the collection does
 // not contain the key. Throws out_of_range if the given key is not
 // in the collection.
-template<typename K, typename V>
-void BSTMap<K,V>::erase(const K& key)
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::erase(const K& key)
 {
   root = erase(key, root);
 }
 
 // Returns true if the key is in the collection, and false otherwise.
-template<typename K, typename V>
-bool BSTMap<K,V>::contains(const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool BSTMap<K,V,NodeAlloc>::contains(const K& key) const
 {
   if(root == nullptr)
   {
@@ -349,8 +464,8 @@ bool BSTMap<K,V>::contains(const K& key) const
 }
 
 // Returns the keys k in the collection such that k1 <= k <= k2
-template<typename K, typename V>
-ArraySeq<K> BSTMap<K,V>::find_keys(const K& k1, const K& k2) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<K> BSTMap<K,V,NodeAlloc>::find_keys(const K& k1, const K& k2) const
 {
   ArraySeq<K> keys;
   find_keys(k1,k2,root,keys);
@@ -358,8 +473,8 @@ ArraySeq<K> BSTMap<K,V>::find_keys(const K& k1, const K& k2) const
 }
 
 // Returns the keys in the collection in ascending sorted order
-template<typename K, typename V>
-ArraySeq<K> BSTMap<K,V>::sorted_keys() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+ArraySeq<K> BSTMap<K,V,NodeAlloc>::sorted_keys() const
 {
   ArraySeq<K> keys;
   sorted_keys(root, keys);
@@ -369,8 +484,8 @@ ArraySeq<K> BSTMap<K,V>::sorted_keys() const
 // Gives the key (as an ouptput parameter) immediately after the
 // given key according to ascending sort order. Returns true if a
 // successor key exists, and false otherwise.
-template<typename K, typename V>
-bool BSTMap<K,V>::next_key(const K& key, K& next_key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool BSTMap<K,V,NodeAlloc>::next_key(const K& key, K& next_key) const
 {
   if(root == nullptr)
   {
@@ -427,8 +542,8 @@ bool BSTMap<K,V>::next_key(const K& key, K& next_key) const
 // Gives the key (as an ouptput parameter) immediately before the
 // given key according to ascending sort order. Returns true if a
 // predecessor key exists, and false otherwise.
-template<typename K, typename V>
-bool BSTMap<K,V>::prev_key(const K& key, K& prev_key) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool BSTMap<K,V,NodeAlloc>::prev_key(const K& key, K& prev_key) const
 {
   if(root == nullptr)
   {
@@ -483,34 +598,134 @@ bool BSTMap<K,V>::prev_key(const K& key, K& prev_key) const
 } 
 
 // Removes all key-value pairs from the map.
-template<typename K, typename V>
-void BSTMap<K,V>::clear()
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::clear()
 {
-  clear(root);
+  // a pool can drop all of its nodes at once
+  if(!NodeAlloc<Node>::bulk_release)
+  {
+    clear(root);
+  }
+  alloc.release_all();
+  root = nullptr;
+  count = 0;
+}
+
+// Returns a cursor over the keys in [k1, k2]
+template<typename K, typename V, template<typename> class NodeAlloc>
+KeyRange<K> BSTMap<K,V,NodeAlloc>::key_range(const K& k1, const K& k2) const
+{
+  return KeyRange<K>(new Cursor(root, &k1, &k2));
+}
+
+// Returns a cursor over all keys
+template<typename K, typename V, template<typename> class NodeAlloc>
+KeyRange<K> BSTMap<K,V,NodeAlloc>::keys() const
+{
+  return KeyRange<K>(new Cursor(root, nullptr, nullptr));
+}
+
+// descends to the smallest key >= k1, stacking each node whose key
+// is in range on the way down
+template<typename K, typename V, template<typename> class NodeAlloc>
+BSTMap<K,V,NodeAlloc>::Cursor::Cursor(const Node* st_root, const K* k1, const K* k2)
+{
+  if(k2 != nullptr)
+  {
+    bounded = true;
+    last = *k2;
+  }
+  while(st_root != nullptr)
+  {
+    if(k1 != nullptr && st_root -> key < *k1)
+    {
+      st_root = st_root -> right;
+    }
+    else
+    {
+      stack.insert(st_root, stack.size());
+      st_root = st_root -> left;
+    }
+  }
+}
+
+// cursor is at a key unless the stack is empty or past k2
+template<typename K, typename V, template<typename> class NodeAlloc>
+bool BSTMap<K,V,NodeAlloc>::Cursor::valid() const
+{
+  if(stack.empty())
+  {
+    return false;
+  }
+  return !bounded || !(last < stack[stack.size() - 1] -> key);
+}
+
+// the key of the node on top of the stack
+template<typename K, typename V, template<typename> class NodeAlloc>
+const K& BSTMap<K,V,NodeAlloc>::Cursor::key() const
+{
+  return stack[stack.size() - 1] -> key;
+}
+
+// pops the current node and stacks the left spine of its right
+// subtree
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::Cursor::next()
+{
+  const Node* temp = stack[stack.size() - 1] -> right;
+  stack.erase(stack.size() - 1);
+  while(temp != nullptr)
+  {
+    stack.insert(temp, stack.size());
+    temp = temp -> left;
+  }
+}
+
+// Replaces the contents with the sorted key-value pairs
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::bulk_load(const ArraySeq<std::pair<K,V>>& sorted_pairs)
+{
+  for(int i = 1; i < sorted_pairs.size(); i++)
+  {
+    if(!(sorted_pairs[i - 1].first < sorted_pairs[i].first))
+    {
+      throw(std::invalid_argument("BSTMap<K,V>::bulk_load(const ArraySeq<std::pair<K,V>>&)"));
+    }
+  }
+  clear();
+  root = build(sorted_pairs, 0, sorted_pairs.size() - 1);
+  count = sorted_pairs.size();
 }
 
 // Returns the height of the binary search tree
-template<typename K, typename V>
-int BSTMap<K,V>::height() const
+template<typename K, typename V, template<typename> class NodeAlloc>
+int BSTMap<K,V,NodeAlloc>::height() const
+{
+  return height(root);
+}
+
+// Returns the node allocation counters
+template<typename K, typename V, template<typename> class NodeAlloc>
+const AllocStats& BSTMap<K,V,NodeAlloc>::alloc_stats() const
 {
-  height(root);
+  return alloc.stats();
 }
 
 // clear helper
-template<typename K, typename V>
-void BSTMap<K,V>::clear(Node* st_root)
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::clear(Node* st_root)
 {
   if(st_root != nullptr)
   {
     clear(st_root -> left);
     clear(st_root -> right);
-    delete st_root;
+    alloc.destroy(st_root);
   }
 }
 
 // copy assignment helper
-template<typename K, typename V>
-typename BSTMap<K,V>::Node* BSTMap<K,V>::copy(const Node* rhs_st_root) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename BSTMap<K,V,NodeAlloc>::Node* BSTMap<K,V,NodeAlloc>::copy(const Node* rhs_st_root)
 {
   if(rhs_st_root == nullptr)
   {
@@ -518,7 +733,7 @@ typename BSTMap<K,V>::Node* BSTMap<K,V>::copy(const Node* rhs_st_root) const
   }
   else
   {
-    Node* temp = new Node();
+    Node* temp = alloc.make();
     temp -> key = rhs_st_root -> key;
     temp -> value = rhs_st_root -> value;
     temp -> left = copy(rhs_st_root -> left);
@@ -527,9 +742,26 @@ typename BSTMap<K,V>::Node* BSTMap<K,V>::copy(const Node* rhs_st_root) const
   }
 }
 
+// bulk_load helper: the middle pair becomes the subtree root
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename BSTMap<K,V,NodeAlloc>::Node* BSTMap<K,V,NodeAlloc>::build(const ArraySeq<std::pair<K,V>>& pairs, int start, int end)
+{
+  if(start > end)
+  {
+    return nullptr;
+  }
+  int mid = (start + end) / 2;
+  Node* temp = alloc.make();
+  temp -> key = pairs[mid].first;
+  temp -> value = pairs[mid].second;
+  temp -> left = build(pairs, start, mid - 1);
+  temp -> right = build(pairs, mid + 1, end);
+  return temp;
+}
+
 // erase helper
-template<typename K, typename V>
-typename BSTMap<K,V>::Node* BSTMap<K,V>::erase(const K& key, Node* st_root)//need to delete
+template<typename K, typename V, template<typename> class NodeAlloc>
+typename BSTMap<K,V,NodeAlloc>::Node* BSTMap<K,V,NodeAlloc>::erase(const K& key, Node* st_root)//need to delete
 {
   if(st_root == nullptr)
   {
@@ -551,13 +783,13 @@ typename BSTMap<K,V>::Node* BSTMap<K,V>::erase(const K& key, Node* st_root)//nee
     if(st_root -> left == nullptr)
     {
       temp = st_root -> right;
-      delete st_root;
+      alloc.destroy(st_root);
       return temp;
     }
     else if(st_root -> right == nullptr)
     {
       temp = st_root -> left;
-      delete st_root;
+      alloc.destroy(st_root);
       return temp;
     }
     else
@@ -579,7 +811,7 @@ typename BSTMap<K,V>::Node* BSTMap<K,V>::erase(const K& key, Node* st_root)//nee
       }
       temp -> left = st_root -> left;
       temp -> right = st_root -> right;
-      delete st_root;
+      alloc.destroy(st_root);
       st_root = temp;
     }
   }
@@ -587,8 +819,8 @@ typename BSTMap<K,V>::Node* BSTMap<K,V>::erase(const K& key, Node* st_root)//nee
 }
 
 // find_keys helper
-template<typename K, typename V>
-void BSTMap<K,V>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::find_keys(const K& k1, const K& k2, const Node* st_root, ArraySeq<K>& keys) const
 {
   if(st_root != nullptr)
   {
@@ -641,8 +873,8 @@ void BSTMap<K,V>::find_keys(const K& k1, const K& k2, const Node* st_root, Array
 }
 
 // sorted_keys helper
-template<typename K, typename V>
-void BSTMap<K,V>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+void BSTMap<K,V,NodeAlloc>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
 {
   if(st_root != nullptr)
   {
@@ -653,8 +885,8 @@ void BSTMap<K,V>::sorted_keys(const Node* st_root, ArraySeq<K>& keys) const
 }
 
 // height helper
-template<typename K, typename V>
-int BSTMap<K,V>::height(const Node* st_root) const
+template<typename K, typename V, template<typename> class NodeAlloc>
+int BSTMap<K,V,NodeAlloc>::height(const Node* st_root) const
 {
   if(st_root == nullptr)
   {
@@ -13,7 +13,7 @@
 
 
 template<typename K, typename V>
-class HashMap : public Map<K,V>
+class HashMap final : public Map<K,V>
 {
 public:
 
@@ -53,6 +53,15 @@ public:
   // Expects key to not exist in map prior to insertion.
   void insert(const K& key, const V& value);
 
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection, in which case args are left unused.
+  // Returns true if the key was added. The key is hashed once.
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -116,6 +125,11 @@ private:
 
   // initialize the table to all nullptr
   void init_table();
+
+  // shared body of the insert overloads, forwarding key and value
+  // into the new entry
+  template<typename KK, typename VV>
+  void insert_pair(KK&& key, VV&& value);
   
 };
 
@@ -271,6 +285,22 @@ const V& HashMap<K,V>::operator[](const K& key) const
 // Expects key to not exist in map prior to insertion.
 template<typename K, typename V>
 void HashMap<K,V>::insert(const K& key, const V& value)
+{
+  insert_pair(key, value);
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V>
+void HashMap<K,V>::insert(K&& key, V&& value)
+{
+  insert_pair(std::move(key), std::move(value));
+}
+
+// Shared insert body. The key is forwarded only once it is no longer
+// needed for placement.
+template<typename K, typename V>
+template<typename KK, typename VV>
+void HashMap<K,V>::insert_pair(KK&& key, VV&& value)
 {
   if(count/capacity >= load_factor_threshold)
   {
@@ -278,11 +308,40 @@ void HashMap<K,V>::insert(const K& key, const V& value)
   }
   int index = hash(key);
   Node* temp = new Node();
+  temp -> key = std::forward<KK>(key);
+  temp -> value = std::forward<VV>(value);
+  temp -> next = table[index];
+  table[index] = temp;
+  count++;
+}
+
+// Adds the key with a value constructed from args unless the key is
+// already in the collection. The key's chain is searched and, when
+// the table does not grow, linked into without hashing again.
+template<typename K, typename V>
+template<typename... Args>
+bool HashMap<K,V>::try_emplace(const K& key, Args&&... args)
+{
+  int index = hash(key);
+  for(Node* temp = table[index]; temp != nullptr; temp = temp -> next)
+  {
+    if(temp -> key == key)
+    {
+      return false;
+    }
+  }
+  if(count/capacity >= load_factor_threshold)
+  {
+    resize_and_rehash();
+    index = hash(key);
+  }
+  Node* temp = new Node();
   temp -> key = key;
-  temp -> value = value;
+  temp -> value = V(std::forward<Args>(args)...);
   temp -> next = table[index];
   table[index] = temp;
   count++;
+  return true;
 }
 
 // Shrinks the collection by removing the key-value pair with the
@@ -551,7 +610,9 @@ template<typename K, typename V>
 int HashMap<K,V>::hash(const K& key) const
 {
   std::hash<K> hash_code;
-  int code = hash_code(key);
+  // unsigned, so codes with the top bit set still give an index
+  // inside the table
+  std::size_t code = hash_code(key);
   return code % capacity;
 }
 
@@ -19,6 +19,11 @@
 #include <functional>
 #include <vector>
 #include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <algorithm>
+#include <random>
 #include "util.h"
 #include "arrayseq.h"
 #include "map.h"
@@ -31,6 +36,28 @@
 using namespace std;
 using namespace std::chrono;
 
+// heap allocations made so far, counted by the replacement operator
+// new below (array new and the deletes forward to these)
+long heap_allocs = 0;
+
+void* operator new(std::size_t size)
+{
+  ++heap_allocs;
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
 // NOTE: all data is "shuffled"
 
 double timed_insert(Map<int,int>& m, int key);
@@ -39,6 +66,18 @@ double timed_contains(const Map<int,int>& m, int key);
 double timed_find_range(const Map<int,int>& m, int key1, int key2);
 double timed_next_key(const Map<int,int>& m, int key); 
 double timed_sorted_keys(const Map<int,int>& m);
+double timed_in_order_insert(Map<int,int>& m, const ArraySeq<pair<int,int>>& pairs);
+template<typename M>
+double timed_bulk_load(M& m, const ArraySeq<pair<int,int>>& pairs);
+template<typename M>
+void alloc_row(const string& label, const ArraySeq<int>& keys, int n);
+void early_exit_row(const string& label, const Map<int,int>& m, int k1, int k2, int k);
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n);
+template<typename M>
+double timed_lookups(const M& m, const ArraySeq<int>& keys, int passes);
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys);
 
 // test parameters
 const int start = 0;
@@ -195,7 +234,97 @@ int main(int argc, char* argv[])
     
     cout << endl;
   }
-  
+
+  // bulk load vs one-at-a-time insert of sorted input (comment lines
+  // so the plot script skips them); in-order insert into the bst is
+  // quadratic, so its sizes are kept small
+  cout << "# sorted load (msec): n, bst bulk, bst insert, avl bulk, "
+       << "avl insert" << endl;
+  for (int n = 5000; n <= 20000; n += 5000) {
+    ArraySeq<pair<int,int>> pairs;
+    for (int i = 0; i < n; ++i)
+      pairs.insert(make_pair(2 * (i + 1), i), pairs.size());
+    BSTMap<int,int> m1, m2;
+    AVLMap<int,int> m3, m4;
+    cout << "# " << n << " " << timed_bulk_load(m1, pairs) << " "
+         << timed_in_order_insert(m2, pairs) << " "
+         << timed_bulk_load(m3, pairs) << " "
+         << timed_in_order_insert(m4, pairs) << endl;
+  }
+
+  // heap vs pool node allocation
+  cout << "# node allocation over " << stop << " keys (msec): load, "
+       << "erase+reinsert half, clear, nodes, system allocations" << endl;
+  alloc_row<BSTMap<int,int>>("bst-heap", keys, stop);
+  alloc_row<BSTMap<int,int,PoolAlloc>>("bst-pool", keys, stop);
+  alloc_row<AVLMap<int,int>>("avl-heap", keys, stop);
+  alloc_row<AVLMap<int,int,PoolAlloc>>("avl-pool", keys, stop);
+
+  // first 100 keys of the full key range, find_keys vs cursor
+  {
+    BinSearchMap<int,int> m1;
+    BSTMap<int,int> m2;
+    AVLMap<int,int> m3;
+    for (int i = 0; i < stop; ++i) {
+      m1.insert(keys[i], vals[i]);
+      m2.insert(keys[i], vals[i]);
+      m3.insert(keys[i], vals[i]);
+    }
+    cout << "# first 100 of " << stop << " keys (msec): find_keys, "
+         << "key_range" << endl;
+    early_exit_row("binsearch", m1, 0, stop * 2, 100);
+    early_exit_row("bst", m2, 0, stop * 2, 100);
+    early_exit_row("avl", m3, 0, stop * 2, 100);
+  }
+
+  // contains of every key through Map<int,int>& (virtual) and through
+  // the final map type (direct calls)
+  cout << "# dispatch, 5 x contains of " << stop << " keys (msec): "
+       << "avl virtual, avl static, hash virtual, hash static" << endl;
+  {
+    AVLMap<int,int> m1;
+    HashMap<int,int> m2;
+    for (int i = 0; i < stop; ++i) {
+      m1.insert(keys[i], vals[i]);
+      m2.insert(keys[i], vals[i]);
+    }
+    cout << "# " << timed_lookups<Map<int,int>>(m1, keys, 5) << " "
+         << timed_lookups(m1, keys, 5) << " "
+         << timed_lookups<Map<int,int>>(m2, keys, 5) << " "
+         << timed_lookups(m2, keys, 5) << endl;
+  }
+
+  // contains one key at a time vs contains_many in batches
+  cout << "# batched contains of " << stop << " keys (msec): one at a time, "
+       << "batches of 16, 256, 4096, 65536" << endl;
+  {
+    AVLMap<int,int> m1;
+    HashMap<int,int> m2;
+    for (int i = 0; i < stop; ++i) {
+      m1.insert(keys[i], vals[i]);
+      m2.insert(keys[i], vals[i]);
+    }
+    // queries in random order, so neighboring lookups share nothing
+    vector<int> order;
+    for (int i = 0; i < keys.size(); ++i)
+      order.push_back(keys[i]);
+    shuffle(order.begin(), order.end(), mt19937(17));
+    ArraySeq<int> queries;
+    for (int key : order)
+      queries.insert(key, queries.size());
+    batch_row("avl", m1, queries);
+    batch_row("hash", m2, queries);
+  }
+
+  // string keys and values copied, moved, and emplaced (comment lines
+  // so the plot script skips them)
+  cout << "# string load over " << stop << " keys: copy msec, "
+       << "copy allocs/insert, move msec, move allocs/insert, "
+       << "try_emplace msec, try_emplace allocs/insert" << endl;
+  string_row<BSTMap<string,string>>("bst", keys, stop);
+  string_row<AVLMap<string,string>>("avl", keys, stop);
+  string_row<HashMap<string,string>>("hash", keys, stop);
+
 }
 
 
@@ -275,6 +404,148 @@ double timed_sorted_keys(const Map<int,int>& m)
   return (total/1000) / runs;
 }
 
+// inserts the (sorted) pairs one at a time into an empty map
+double timed_in_order_insert(Map<int,int>& m, const ArraySeq<pair<int,int>>& pairs)
+{
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < pairs.size(); ++i)
+    m.insert(pairs[i].first, pairs[i].second);
+  auto t1 = high_resolution_clock::now();
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// builds the map from the sorted pairs in one pass
+template<typename M>
+double timed_bulk_load(M& m, const ArraySeq<pair<int,int>>& pairs)
+{
+  auto t0 = high_resolution_clock::now();
+  m.bulk_load(pairs);
+  auto t1 = high_resolution_clock::now();
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// loads the keys, erases and reinserts every other key, and clears
+// the map, printing the three times and the allocation counts
+template<typename M>
+void alloc_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  M m;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    m.insert(keys[i], keys[i]);
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < n; i += 2)
+    m.erase(keys[i]);
+  for (int i = 0; i < n; i += 2)
+    m.insert(keys[i], keys[i]);
+  auto t2 = high_resolution_clock::now();
+  m.clear();
+  auto t3 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << " "
+       << m.alloc_stats().nodes << " " << m.alloc_stats().system << endl;
+}
+
+// reads the first k keys of [k1, k2] from the result of find_keys and
+// from a cursor, printing both times
+void early_exit_row(const string& label, const Map<int,int>& m, int k1, int k2, int k)
+{
+  long sum = 0;
+  auto t0 = high_resolution_clock::now();
+  ArraySeq<int> keys = m.find_keys(k1, k2);
+  for (int i = 0; i < k && i < keys.size(); ++i)
+    sum += keys[i];
+  auto t1 = high_resolution_clock::now();
+  KeyRange<int> r = m.key_range(k1, k2);
+  for (int i = 0; i < k && r.valid(); ++i, r.next())
+    sum -= r.key();
+  auto t2 = high_resolution_clock::now();
+  assert(sum == 0);
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << endl;
+}
 
+// loads n string keys with 40 character values three ways: copied
+// from const references, moved in, and with try_emplace building the
+// value from its arguments. Prints the time (msec) and the heap
+// allocations per insert of each.
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  vector<string> key_strs, val_strs;
+  for (int i = 0; i < n; ++i) {
+    key_strs.push_back("string key number " + to_string(keys[i]));
+    val_strs.push_back(string(40, 'a' + i % 26));
+  }
+  cout << "# " << label;
+  for (int mode = 0; mode < 3; ++mode) {
+    vector<string> ks = key_strs;
+    vector<string> vs = val_strs;
+    M m;
+    long a0 = heap_allocs;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+      if (mode == 0)
+        m.insert(ks[i], vs[i]);
+      else if (mode == 1)
+        m.insert(std::move(ks[i]), std::move(vs[i]));
+      else
+        m.try_emplace(ks[i], 40, 'a' + i % 26);
+    }
+    auto t1 = high_resolution_clock::now();
+    long a1 = heap_allocs;
+    assert(m.size() == n);
+    cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << (a1 - a0) / (double) n;
+  }
+  cout << endl;
+}
 
+// checks every key is in the map, passes times over
+template<typename M>
+double timed_lookups(const M& m, const ArraySeq<int>& keys, int passes)
+{
+  int found = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int p = 0; p < passes; ++p)
+    for (int i = 0; i < keys.size(); ++i)
+      found += m.contains(keys[i]);
+  auto t1 = high_resolution_clock::now();
+  assert(found == passes * keys.size());
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
 
+// looks every key up with contains, then with contains_many in
+// batches of each size, printing the times (msec)
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys)
+{
+  long found = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < keys.size(); ++i)
+    found += m.contains(keys[i]);
+  auto t1 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+  for (int size = 16; size <= 65536; size *= 16) {
+    vector<ArraySeq<int>> batches;
+    for (int i = 0; i < keys.size(); i += size) {
+      batches.push_back(ArraySeq<int>());
+      for (int j = i; j < i + size && j < keys.size(); ++j)
+        batches.back().insert(keys[j], j - i);
+    }
+    auto t2 = high_resolution_clock::now();
+    for (const ArraySeq<int>& batch : batches) {
+      ArraySeq<bool> results = m.contains_many(batch);
+      for (int j = 0; j < results.size(); ++j)
+        found -= results[j];
+    }
+    auto t3 = high_resolution_clock::now();
+    cout << " " << duration_cast<microseconds>(t3 - t2).count() / 1000.0;
+  }
+  cout << endl;
+  assert(found == -3L * keys.size());
+}
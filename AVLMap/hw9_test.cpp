@@ -7,6 +7,9 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
 #include <gtest/gtest.h>
 #include "arrayseq.h"
 #include "avlmap.h"
@@ -555,6 +558,330 @@ TEST(BasicAVLMapTests, EraseRebalanceCheck) {
 
 
 
+TEST(BasicAVLMapTests, BulkLoadCheck)
+{
+  ArraySeq<std::pair<int,char>> pairs;
+  for (int i = 0; i < 100; ++i)
+    pairs.insert(std::make_pair(i * 2, 'a' + (i % 26)), pairs.size());
+  AVLMap<int,char> m(pairs);
+  ASSERT_EQ(100, m.size());
+  ASSERT_EQ(7, m.height());
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(true, m.contains(i * 2));
+    ASSERT_EQ('a' + (i % 26), m[i * 2]);
+  }
+  ArraySeq<int> keys = m.sorted_keys();
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(i * 2, keys[i]);
+  // still balanced under later updates
+  for (int i = 0; i < 100; ++i)
+    m.insert(i * 2 + 1, 'z');
+  for (int i = 0; i < 200; i += 3)
+    m.erase(i);
+  ASSERT_EQ(133, m.size());
+  ASSERT_GE(9, m.height());
+  // reloading replaces the contents
+  ArraySeq<std::pair<int,char>> empty;
+  m.bulk_load(empty);
+  ASSERT_EQ(0, m.size());
+  ASSERT_EQ(0, m.height());
+}
+
+TEST(BasicAVLMapTests, BulkLoadUnsortedCheck)
+{
+  ArraySeq<std::pair<int,char>> pairs;
+  pairs.insert(std::make_pair(10, 'a'), 0);
+  pairs.insert(std::make_pair(20, 'b'), 1);
+  pairs.insert(std::make_pair(20, 'c'), 2);
+  AVLMap<int,char> m;
+  m.insert(5, 'x');
+  ASSERT_THROW(m.bulk_load(pairs), std::invalid_argument);
+  ASSERT_EQ(1, m.size());
+  ASSERT_EQ(true, m.contains(5));
+}
+
+TEST(BasicAVLMapTests, PoolAllocCheck)
+{
+  AVLMap<int,int,PoolAlloc> m;
+  for (int i = 0; i < 1000; ++i)
+    m.insert(i, i * 2);
+  for (int i = 0; i < 1000; i += 2)
+    m.erase(i);
+  ASSERT_EQ(500, m.size());
+  ASSERT_EQ(1000, m.alloc_stats().nodes);
+  // erased nodes are reused before the pool grows
+  long slabs = m.alloc_stats().system;
+  ASSERT_GT(10, slabs);
+  for (int i = 0; i < 1000; i += 2)
+    m.insert(i, i * 2);
+  ASSERT_EQ(slabs, m.alloc_stats().system);
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i * 2, m[i]);
+  AVLMap<int,int,PoolAlloc> m2(m);
+  AVLMap<int,int,PoolAlloc> m3(std::move(m));
+  ASSERT_EQ(0, m.size());
+  ASSERT_EQ(1000, m2.size());
+  ASSERT_EQ(1000, m3.size());
+  m2.clear();
+  ASSERT_EQ(0, m2.size());
+  ASSERT_EQ(false, m2.contains(10));
+  m2.insert(10, 20);
+  ASSERT_EQ(20, m2[10]);
+  ASSERT_EQ(998, m3[499]);
+}
+
+TEST(BasicAVLMapTests, PoolAllocNonTrivialCheck)
+{
+  AVLMap<std::string,std::string,PoolAlloc> m;
+  for (int i = 0; i < 200; ++i)
+    m.insert(std::to_string(i), std::string(40, 'a' + (i % 26)));
+  for (int i = 0; i < 200; i += 3)
+    m.erase(std::to_string(i));
+  ASSERT_EQ(133, m.size());
+  ASSERT_EQ(std::string(40, 'b'), m["1"]);
+  m.clear();
+  ASSERT_EQ(0, m.size());
+}
+
+TEST(BasicAVLMapTests, KeyRangeCursorCheck)
+{
+  AVLMap<int,char> m;
+  for (int i = 1; i <= 100; ++i)
+    m.insert((i * 37) % 101 * 2, 'a');
+  // keys are the even numbers 2..200
+  KeyRange<int> r = m.key_range(51, 61);
+  int expected = 52;
+  while (r.valid()) {
+    ASSERT_EQ(expected, r.key());
+    expected += 2;
+    r.next();
+  }
+  ASSERT_EQ(62, expected);
+  int n = 0;
+  for (int k : m.keys()) {
+    ASSERT_EQ((n + 1) * 2, k);
+    ++n;
+  }
+  ASSERT_EQ(100, n);
+  ASSERT_EQ(false, m.key_range(201, 300).valid());
+  ASSERT_EQ(false, m.key_range(60, 50).valid());
+  ASSERT_EQ(2, m.key_range(-5, 2).key());
+  AVLMap<int,char> empty;
+  ASSERT_EQ(false, empty.keys().valid());
+}
+
+TEST(BasicAVLMapTests, MoveInsertCheck)
+{
+  AVLMap<std::string,std::string> m;
+  std::vector<const char*> buffers;
+  for (int i = 0; i < 200; ++i) {
+    std::string value(40, 'a' + (i % 26));
+    buffers.push_back(value.data());
+    m.insert(std::to_string(i), std::move(value));
+  }
+  // moved-in values keep their buffers through rebalancing
+  for (int i = 0; i < 200; ++i)
+    ASSERT_EQ(buffers[i], m[std::to_string(i)].data());
+  ASSERT_EQ(false, m.try_emplace("5", 3, 'z'));
+  ASSERT_EQ(std::string(40, 'f'), m["5"]);
+  ASSERT_EQ(true, m.try_emplace("x", 3, 'z'));
+  ASSERT_EQ("zzz", m["x"]);
+  ASSERT_EQ(201, m.size());
+  ASSERT_EQ(true, m.height() <= 10);
+}
+
+TEST(BasicAVLMapTests, TryEmplaceCheck)
+{
+  AVLMap<int,std::string,PoolAlloc> m;
+  for (int i = 0; i < 1000; i += 2)
+    m.insert(i, "even");
+  // a key already there allocates nothing and keeps its value
+  long nodes = m.alloc_stats().nodes;
+  for (int i = 0; i < 1000; i += 2)
+    ASSERT_EQ(false, m.try_emplace(i, 3, 'z'));
+  ASSERT_EQ(nodes, m.alloc_stats().nodes);
+  for (int i = 1; i < 1000; i += 2)
+    ASSERT_EQ(true, m.try_emplace(i, 3, 'z'));
+  ASSERT_EQ(1000, m.size());
+  ASSERT_EQ(true, m.height() <= 14);
+  ASSERT_EQ("even", m[500]);
+  ASSERT_EQ("zzz", m[501]);
+  // a published version is not changed by either outcome
+  m.persistent(true);
+  AVLMap<int,std::string,PoolAlloc>::Snapshot snap = m.snapshot();
+  ASSERT_EQ(false, m.try_emplace(10, 1, 'y'));
+  ASSERT_EQ(true, m.try_emplace(1000, 1, 'y'));
+  ASSERT_EQ(1000, snap.size());
+  ASSERT_EQ(false, snap.contains(1000));
+  ASSERT_EQ(1001, m.snapshot().size());
+  ASSERT_EQ("y", m[1000]);
+}
+
+TEST(BasicAVLMapTests, BatchLookupCheck)
+{
+  AVLMap<int,int> m;
+  for (int i = 0; i < 500; ++i)
+    m.insert((i * 37) % 500 * 2, i);
+  // even keys 0..998 are present, odd keys and negatives are not, and
+  // some keys repeat
+  ArraySeq<int> keys;
+  for (int i = 0; i < 1200; ++i)
+    keys.insert((i * 7919) % 1100 - 50, i);
+  ArraySeq<bool> found = m.contains_many(keys);
+  ASSERT_EQ(keys.size(), found.size());
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(m.contains(keys[i]), found[i]);
+  ArraySeq<int> present;
+  for (int i = 0; i < keys.size(); ++i)
+    if (found[i])
+      present.insert(keys[i], present.size());
+  ArraySeq<int> values = m.get_many(present);
+  for (int i = 0; i < present.size(); ++i)
+    ASSERT_EQ(m[present[i]], values[i]);
+  ASSERT_THROW(m.get_many(keys), std::out_of_range);
+  AVLMap<int,int> empty;
+  ASSERT_EQ(false, empty.contains_many(keys)[0]);
+  ASSERT_THROW(empty.get_many(keys), std::out_of_range);
+  ASSERT_EQ(0, m.contains_many(ArraySeq<int>()).size());
+}
+
+TEST(BasicAVLMapTests, PersistentSnapshotCheck)
+{
+  AVLMap<int,int,PoolAlloc> m;
+  ASSERT_THROW(m.snapshot(), std::logic_error);
+  for (int i = 0; i < 100; ++i)
+    m.insert(i, i);
+  m.persistent(true);
+  ASSERT_EQ(true, m.persistent());
+  AVLMap<int,int,PoolAlloc>::Snapshot before = m.snapshot();
+  // inserts and erases rotate (and so copy) nodes the snapshot shares
+  for (int i = 100; i < 200; ++i)
+    m.insert(i, i);
+  for (int i = 0; i < 100; i += 2)
+    m.erase(i);
+  ASSERT_THROW(m.erase(0), std::out_of_range);
+  m[1] = -1;
+  AVLMap<int,int,PoolAlloc>::Snapshot after = m.snapshot();
+  ASSERT_EQ(100, before.size());
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_EQ(i < 100, before.contains(i));
+    if (i < 100)
+      ASSERT_EQ(i, before[i]);
+  }
+  ASSERT_THROW(before[100], std::out_of_range);
+  // operator[] updates wait for the next publish
+  ASSERT_EQ(150, after.size());
+  ASSERT_EQ(1, after[1]);
+  m.publish();
+  ASSERT_EQ(-1, m.snapshot()[1]);
+  ASSERT_EQ(1, after[1]);
+  ASSERT_EQ(150, m.size());
+  ArraySeq<int> keys = after.sorted_keys();
+  ArraySeq<int> current = m.sorted_keys();
+  ASSERT_EQ(150, keys.size());
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(current[i], keys[i]);
+  // copies hold the version after the original is gone
+  AVLMap<int,int,PoolAlloc>::Snapshot copy = before;
+  before = after;
+  m.clear();
+  ASSERT_EQ(true, m.snapshot().empty());
+  ASSERT_EQ(100, copy.size());
+  ASSERT_EQ(99, copy[99]);
+  ASSERT_EQ(150, before.size());
+  m.insert(5, 5);
+  ASSERT_EQ(1, m.snapshot().size());
+  m.persistent(false);
+  ASSERT_THROW(m.snapshot(), std::logic_error);
+  m.insert(6, 6);
+  ASSERT_EQ(2, m.size());
+  ASSERT_EQ(100, copy.size());
+}
+
+TEST(BasicAVLMapTests, PersistentMoveCheck)
+{
+  AVLMap<int,int> a;
+  a.persistent(true);
+  for (int i = 0; i < 1000; ++i)
+    a.insert(i, i);
+  a.publish();
+  ASSERT_EQ(10, a.height());
+  // a map with published versions is copied, heights and all
+  AVLMap<int,int> b(std::move(a));
+  ASSERT_EQ(10, b.height());
+  ASSERT_EQ(1000, b.size());
+  ASSERT_EQ(0, a.size());
+  for (int i = 1000; i < 2000; ++i)
+    b.insert(i, i);
+  ASSERT_EQ(11, b.height());
+  for (int i = 0; i < 2000; ++i)
+    ASSERT_EQ(i, b[i]);
+  // moving a published map into itself leaves it alone
+  for (int i = 0; i < 10; ++i)
+    a.insert(i, i);
+  AVLMap<int,int>& alias = a;
+  a = std::move(alias);
+  ASSERT_EQ(10, a.size());
+  ASSERT_EQ(10, a.snapshot().size());
+}
+
+TEST(BasicAVLMapTests, PersistentOffCheck)
+{
+  AVLMap<int,int> m;
+  for (int i = 0; i < 1000; ++i)
+    m.insert(i, i);
+  m.persistent(true);
+  {
+    AVLMap<int,int>::Snapshot snap = m.snapshot();
+    m.persistent(false);
+    // the snapshot still shares the tree, so the update copies a path
+    m[0] = -1;
+    ASSERT_EQ(0, snap[0]);
+  }
+  // the dropped version is freed by the next change, after which
+  // updates are made in place again
+  m[1] = -1;
+  long nodes = m.alloc_stats().nodes;
+  for (int i = 0; i < 1000; ++i)
+    m[i] = i + 1;
+  ASSERT_EQ(nodes, m.alloc_stats().nodes);
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i + 1, m[i]);
+}
+
+TEST(BasicAVLMapTests, SnapshotThreadedCheck)
+{
+  const int readers = 4;
+  const int n = 20000;
+  AVLMap<int,int> m;
+  m.persistent(true);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> workers;
+  // keys go in ascending order, so a snapshot of size s must hold
+  // exactly the keys 0 to s - 1
+  for (int t = 0; t < readers; ++t) {
+    workers.emplace_back([&, t] {
+      int last = 0;
+      for (int round = 0; !done.load(); ++round) {
+        AVLMap<int,int>::Snapshot snap = m.snapshot();
+        int s = snap.size();
+        EXPECT_LE(last, s);
+        last = s;
+        int probe = (round * 7919 + t) % (n + 1);
+        EXPECT_EQ(probe < s, snap.contains(probe));
+        if (s > 0)
+          EXPECT_EQ((s - 1) * 2, snap[s - 1]);
+      }
+    });
+  }
+  for (int i = 0; i < n; ++i)
+    m.insert(i, i * 2);
+  done.store(true);
+  for (std::thread& worker : workers)
+    worker.join();
+  ASSERT_EQ(n, m.snapshot().size());
+}
+
 //----------------------------------------------------------------------
 // Main
 //----------------------------------------------------------------------
@@ -16,9 +16,101 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <memory>
+#include <utility>
 #include "arrayseq.h"
 
 
+// A forward cursor over keys in ascending order. Ordered maps walk
+// their own structure as the cursor advances, so reading only the
+// first few keys of a large range costs only those keys. A cursor is
+// invalidated by any change to the map it came from.
+template<typename K>
+class KeyCursor
+{
+public:
+
+  // For concrete subclasses
+  virtual ~KeyCursor() {}
+
+  // Tests if the cursor is at a key (false once the keys run out)
+  virtual bool valid() const = 0;
+
+  // Returns the current key. Only defined while valid() is true.
+  virtual const K& key() const = 0;
+
+  // Moves the cursor to the next key
+  virtual void next() = 0;
+
+};
+
+
+// Owns a cursor and adds begin()/end() so the keys can be read with
+// a range-based for loop. Iterators share the range's cursor, so a
+// range can only be traversed once.
+template<typename K>
+class KeyRange
+{
+public:
+
+  // Takes ownership of the given cursor
+  KeyRange(KeyCursor<K>* cursor) : cursor(cursor) {}
+
+  bool valid() const { return cursor -> valid(); }
+  const K& key() const { return cursor -> key(); }
+  void next() { cursor -> next(); }
+
+  class iterator
+  {
+  public:
+    iterator(KeyCursor<K>* cursor) : cursor(cursor) {}
+    const K& operator*() const { return cursor -> key(); }
+    iterator& operator++() { cursor -> next(); return *this; }
+    // only used to compare against end()
+    bool operator!=(const iterator& rhs) const
+    {
+      return (cursor != nullptr && cursor -> valid()) !=
+        (rhs.cursor != nullptr && rhs.cursor -> valid());
+    }
+  private:
+    KeyCursor<K>* cursor;
+  };
+
+  iterator begin() { return iterator(cursor.get()); }
+  iterator end() { return iterator(nullptr); }
+
+private:
+
+  std::unique_ptr<KeyCursor<K>> cursor;
+
+};
+
+
+// Cursor over a sequence of keys that is already sorted (used by
+// maps that cannot walk their keys in order)
+template<typename K>
+class SeqKeyCursor : public KeyCursor<K>
+{
+public:
+
+  SeqKeyCursor(ArraySeq<K>&& keys, int first, int last)
+    : keys(std::move(keys)), index(first), last(last) {}
+  bool valid() const { return index <= last; }
+  const K& key() const { return keys[index]; }
+  void next() { index++; }
+
+private:
+
+  ArraySeq<K> keys;
+  int index;
+  int last;
+
+};
+
+
+// The concrete maps are final, so code that holds one by its own type
+// calls its members directly, while code holding a Map<K,V>& goes
+// through the vtable.
 template<typename K, typename V>
 class Map
 {
@@ -45,6 +137,14 @@ public:
   // Expects key to not exist in map prior to insertion.
   virtual void insert(const K& key, const V& value) = 0;
 
+  // Extends the collection by adding the given key-value pair, moving
+  // from the key and value. Expects key to not exist in map prior to
+  // insertion. The default copies them; maps override it to move.
+  virtual void insert(K&& key, V&& value)
+  {
+    insert(static_cast<const K&>(key), static_cast<const V&>(value));
+  }
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -54,6 +154,27 @@ public:
   // Returns true if the key is in the collection, and false otherwise.
   virtual bool contains(const K& key) const = 0;
 
+  // Returns whether each of the keys is in the collection (the i-th
+  // result is for keys[i]). The default looks the keys up one at a
+  // time; maps override it to overlap the lookups of a batch.
+  virtual ArraySeq<bool> contains_many(const ArraySeq<K>& keys) const
+  {
+    ArraySeq<bool> found;
+    for(int i = 0; i < keys.size(); i++)
+      found.insert(contains(keys[i]), i);
+    return found;
+  }
+
+  // Returns the values of the keys (the i-th value is for keys[i]).
+  // Throws out_of_range if any key is not in the collection.
+  virtual ArraySeq<V> get_many(const ArraySeq<K>& keys) const
+  {
+    ArraySeq<V> values;
+    for(int i = 0; i < keys.size(); i++)
+      values.insert((*this)[keys[i]], i);
+    return values;
+  }
+
   // Returns the keys k in the collection such that k1 <= k <= k2
   virtual ArraySeq<K> find_keys(const K& k1, const K& k2) const = 0;
 
@@ -72,6 +193,29 @@ public:
 
   // Removes all key-value pairs from the map.
   virtual void clear() = 0;
+
+  // Returns a cursor over the keys k in the collection such that
+  // k1 <= k <= k2, in ascending order. The default copies out the
+  // sorted keys; ordered maps override it to find keys lazily.
+  virtual KeyRange<K> key_range(const K& k1, const K& k2) const
+  {
+    ArraySeq<K> keys = sorted_keys();
+    int first = 0;
+    while(first < keys.size() && keys[first] < k1)
+      first++;
+    int last = keys.size() - 1;
+    while(last >= first && k2 < keys[last])
+      last--;
+    return KeyRange<K>(new SeqKeyCursor<K>(std::move(keys), first, last));
+  }
+
+  // Returns a cursor over all of the keys in ascending order
+  virtual KeyRange<K> keys() const
+  {
+    ArraySeq<K> keys = sorted_keys();
+    int last = keys.size() - 1;
+    return KeyRange<K>(new SeqKeyCursor<K>(std::move(keys), 0, last));
+  }
   
 };
 
@@ -12,11 +12,18 @@
 
 #include <stdexcept>
 #include <ostream>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include "sequence.h"
+#include "taskpool.h"
 
 
 template<typename T>
-class ArraySeq : public Sequence<T>
+class ArraySeq final : public Sequence<T>
 {
 public:
 
@@ -59,20 +66,40 @@ public:
 
   // Extends the sequence by inserting the element at the given index.
   // Throws out_of_range if the index is invalid (less than 0 or
-  // greater than size()).
+  // greater than size()). Shifts whichever side of the index is
+  // shorter, so inserts at either end are O(1) amortized.
   void insert(const T& elem, int index);
 
+  // Same as insert(const T&, int), but moves the element in
+  void insert(T&& elem, int index);
+
+  // Inserts an element constructed from args at the given index.
+  // Throws out_of_range if the index is invalid.
+  template<typename... Args>
+  void emplace(int index, Args&&... args);
+
   // Shrinks the sequence by removing the element at the index in the
-  // sequence. Throws out_of_range if index is invalid.
+  // sequence. Throws out_of_range if index is invalid. Shifts
+  // whichever side of the index is shorter.
   void erase(int index);
 
   // Returns true if the element is in the sequence, and false
   // otherwise.
   bool contains(const T& elem) const;
 
+  // Grows the capacity to hold at least n elements without further
+  // allocation. Never shrinks.
+  void reserve(int n);
+
+  // Shrinks the capacity down to the number of elements
+  void shrink_to_fit();
+
+  // Returns the number of elements storage is allocated for (the
+  // capacity)
+  int allocated() const;
+
   // Sorts the elements in the sequence in place using less than equal
-  // (<=) operator. Uses quick sort with a randomly selected pivot
-  // index.
+  // (<=) operator. Uses introsort.
   void sort(); 
 
   // Sorts the sequence in place using the merge sort algorithm.
@@ -86,12 +113,37 @@ public:
   // randomly selected indexes for pivot values.
   void quick_sort_random();
 
+  // Sorts the sequence in place using introsort: quick sort with
+  // median-of-three (ninther for large ranges) pivots that splits off
+  // runs of duplicate keys, insertion sort for small ranges, and heap
+  // sort once the recursion gets too deep.
+  void intro_sort();
+
+  // Sorts the sequence in place using LSD radix sort on 8-bit digits.
+  // Only for integral element types.
+  void radix_sort();
+
+  // Sorts the sequence in place using merge sort, sorting the halves
+  // and merging the sorted runs in parallel. Uses the given number of
+  // threads (0 for one per hardware thread).
+  void parallel_merge_sort(int threads = 0);
+
+  // Sorts the sequence in place using quick sort, sorting the two
+  // sides of each partition in parallel. Uses the given number of
+  // threads (0 for one per hardware thread).
+  void parallel_quick_sort(int threads = 0);
+
   
 private:
 
-  // resizable array
+  // resizable array, used as a ring buffer: element i is stored at
+  // array[(front + i) % capacity]. Only the count slots holding
+  // elements are constructed, the rest is raw storage.
   T* array = nullptr;
 
+  // slot holding element 0
+  int front = 0;
+
   // size of list
   int count = 0;
 
@@ -101,11 +153,62 @@ private:
   // helper to double the capacity of the array
   void resize();
 
+  // moves the elements (element 0 first) into new raw storage with
+  // the given capacity, which must hold them all
+  void relocate(int new_capacity);
+
+  // raw storage for n elements, and its release
+  static T* allocate(int n);
+  static void deallocate(T* storage);
+
+  // destroys every element, leaving the storage raw
+  void destroy_all();
+
+  // returns the slot of the element at index
+  int slot(int index) const;
+
+  // move the elements at indexes [start, end) up (or down) by one
+  // index, a contiguous run of slots at a time
+  void shift_up(int start, int end);
+  void shift_down(int start, int end);
+
+  // moves the elements so element 0 is in array[0], as the sorts
+  // index the array directly
+  void linearize();
+
   // sort function helpers
   void merge_sort(int start, int end);
   void quick_sort(int start, int end);
   void quick_sort_random(int start, int end);  
 
+  // introsort helpers. Ranges of at most INSERTION_CUTOFF elements are
+  // left for a final insertion sort pass; intro_sort never reads below
+  // index first.
+  static const int INSERTION_CUTOFF = 16;
+  void intro_sort(int start, int end, int depth_limit, int first = 0);
+  int median_of_three(int a, int b, int c) const;
+  void insertion_sort(int start, int end);
+
+  // shared body of the insert overloads, forwarding elem into place
+  template<typename U>
+  void insert_value(U&& elem, int index);
+  void heap_sort(int start, int end);
+  void sift_down(int start, int root, int end);
+
+  // ranges smaller than this are sorted (or merged) sequentially by
+  // the parallel sorts
+  static const int PARALLEL_CUTOFF = 8192;
+
+  // parallel sort helpers. The merge sort leaves each sorted range in
+  // the array or, if into_buffer, in the buffer, alternating between
+  // the two by level so each merge reads one and writes the other.
+  void parallel_merge_sort(TaskPool& pool, T* buffer, int start, int end,
+                           bool into_buffer);
+  static void parallel_merge(TaskPool& pool, const T* src, int start1,
+                             int end1, int start2, int end2, T* dst,
+                             int at);
+  void parallel_quick_sort(TaskPool& pool, int start, int end);
+
   // random seed for quick sort
   int seed = 22;
   
@@ -152,23 +255,20 @@ ArraySeq<T>& ArraySeq<T>::operator=(const ArraySeq& rhs)
 {
   if(this != &rhs)
   {
-    if(capacity != rhs.capacity)
+    clear();
+    if(capacity < rhs.count)
     {
+      deallocate(array);
+      array = allocate(rhs.capacity);
       capacity = rhs.capacity;
-      if(array != nullptr)
-      {
-        delete[] array;
-      }
-      array = new T[rhs.capacity];
     }
-    count = rhs.count;
-    for(int i = 0; i < rhs.capacity; ++i)
+    for(int i = 0; i < rhs.count; ++i)
     {
-      array[i] = rhs.array[i];
+      new (array + i) T(rhs.array[rhs.slot(i)]);
     }
-    return *this;
+    count = rhs.count;
   }
-  
+  return *this;
 }
 
 // Move assignment operator
@@ -177,26 +277,26 @@ ArraySeq<T>& ArraySeq<T>::operator=(ArraySeq&& rhs)
 {
   if(this != &rhs)
   {
+    clear();
+    deallocate(array);
     array = rhs.array;
+    front = rhs.front;
     count = rhs.count;
     capacity = rhs.capacity;
     rhs.array = nullptr;
+    rhs.front = 0;
     rhs.count = 0;
     rhs.capacity = 0;
-    return *this;
   }
-  
+  return *this;
 }
 
 // Destructor
 template<typename T>
 ArraySeq<T>::~ArraySeq()
 {
-  if(array != nullptr)
-  {
-    delete[] array;
-  }
-  
+  destroy_all();
+  deallocate(array);
 }
 
 // Returns the number of elements in the sequence
@@ -218,6 +318,8 @@ bool ArraySeq<T>::empty() const
 template<typename T>
 void ArraySeq<T>::clear()
 {
+  destroy_all();
+  front = 0;
   count = 0;
 }
 
@@ -233,7 +335,7 @@ T& ArraySeq<T>::operator[](int index)
   }
   else
   {
-    return array[index];
+    return array[slot(index)];
   }
 }
 
@@ -249,7 +351,7 @@ const T& ArraySeq<T>::operator[](int index) const
   }
   else
   {
-    return array[index];
+    return array[slot(index)];
   }
 }
 
@@ -258,6 +360,30 @@ const T& ArraySeq<T>::operator[](int index) const
 // greater than size()).
 template<typename T>
 void ArraySeq<T>::insert(const T& elem, int index)
+{
+  insert_value(elem, index);
+}
+
+// Same as above, but moves the element in
+template<typename T>
+void ArraySeq<T>::insert(T&& elem, int index)
+{
+  insert_value(std::move(elem), index);
+}
+
+// Inserts an element constructed from args at the given index
+template<typename T>
+template<typename... Args>
+void ArraySeq<T>::emplace(int index, Args&&... args)
+{
+  insert_value(T(std::forward<Args>(args)...), index);
+}
+
+// Shared insert body. The slot joining the ring is constructed from
+// elem and the others are assigned, so elem is forwarded exactly once.
+template<typename T>
+template<typename U>
+void ArraySeq<T>::insert_value(U&& elem, int index)
 {
   
   if(index < 0 || index > size())
@@ -268,23 +394,38 @@ void ArraySeq<T>::insert(const T& elem, int index)
   {
     if(count == capacity)
     {
-      if(capacity == 0)
+      resize();
+    }
+    
+    // open the gap on the shorter side. The slot joining the ring is
+    // raw, so it is constructed and the rest are moved by assignment.
+    if(index < count - index)
+    {
+      front = front == 0 ? capacity - 1 : front - 1;
+      if(index == 0)
       {
-        array = new T[1];
-        capacity = 1;
+        new (array + front) T(std::forward<U>(elem));
       }
       else
       {
-        resize();
+        new (array + front) T(std::move(array[slot(1)]));
+        shift_down(2, index + 1);
+        array[slot(index)] = std::forward<U>(elem);
       }
     }
-    
-    for(int i = count; i > index; --i)
+    else
     {
-      array[i] = array[i-1];
+      if(index == count)
+      {
+        new (array + slot(count)) T(std::forward<U>(elem));
+      }
+      else
+      {
+        new (array + slot(count)) T(std::move(array[slot(count - 1)]));
+        shift_up(index, count - 1);
+        array[slot(index)] = std::forward<U>(elem);
+      }
     }
-    
-    array[index] = elem;
     ++count;
   }
   
@@ -302,9 +443,18 @@ void ArraySeq<T>::erase(int index)
   }
   else
   {
-    for(int i = index; i < count - 1; i++)
+    // close the gap from the shorter side, destroying the slot that
+    // leaves the ring
+    if(index < count - 1 - index)
     {
-      array[i] = array[i+1];
+      shift_up(0, index);
+      array[front].~T();
+      front = slot(1);
+    }
+    else
+    {
+      shift_down(index + 1, count);
+      array[slot(count - 1)].~T();
     }
     --count;
   }
@@ -318,7 +468,7 @@ bool ArraySeq<T>::contains(const T& elem) const
 {
   for(int i = 0; i < count; i++)
   {
-    if(array[i] == elem)
+    if(array[slot(i)] == elem)
     {
       return true;
     }
@@ -326,31 +476,178 @@ bool ArraySeq<T>::contains(const T& elem) const
   return false;
 }
 
-//resizes array
+// grows to a capacity of at least n
+template<typename T>
+void ArraySeq<T>::reserve(int n)
+{
+  if(n > capacity)
+  {
+    relocate(n);
+  }
+}
+
+// gives back the unused slots
+template<typename T>
+void ArraySeq<T>::shrink_to_fit()
+{
+  if(count == 0)
+  {
+    deallocate(array);
+    array = nullptr;
+    capacity = 0;
+    front = 0;
+  }
+  else if(count < capacity)
+  {
+    relocate(count);
+  }
+}
+
+// the current capacity
+template<typename T>
+int ArraySeq<T>::allocated() const
+{
+  return capacity;
+}
+
+//resizes array, doubling its capacity
 template<typename T>
 void ArraySeq<T>::resize()
 {
-  T* arr2 = new T[capacity*2];
-  for(int i = 0; i < count; i++)
+  relocate(capacity == 0 ? 1 : 2 * capacity);
+}
+
+// trivially copyable elements are copied as the (at most two) runs of
+// bytes they occupy; anything else is move-constructed into place and
+// the original destroyed
+template<typename T>
+void ArraySeq<T>::relocate(int new_capacity)
+{
+  T* arr2 = allocate(new_capacity);
+  if constexpr(std::is_trivially_copyable<T>::value)
+  {
+    if(count > 0)
+    {
+      int first = std::min(count, capacity - front);
+      std::memcpy(arr2, array + front, first * sizeof(T));
+      std::memcpy(arr2 + first, array, (count - first) * sizeof(T));
+    }
+  }
+  else
   {
-    arr2[i] = array[i];
+    for(int i = 0; i < count; i++)
+    {
+      T& elem = array[slot(i)];
+      new (arr2 + i) T(std::move(elem));
+      elem.~T();
+    }
   }
-  capacity = 2*capacity;
-  delete[] array;
+  deallocate(array);
   array = arr2;
+  capacity = new_capacity;
+  front = 0;
 }
 
-//defaults sort() to quick_sort_random
+template<typename T>
+T* ArraySeq<T>::allocate(int n)
+{
+  return static_cast<T*>(::operator new(sizeof(T) * n));
+}
+
+template<typename T>
+void ArraySeq<T>::deallocate(T* storage)
+{
+  ::operator delete(storage);
+}
+
+template<typename T>
+void ArraySeq<T>::destroy_all()
+{
+  if constexpr(!std::is_trivially_destructible<T>::value)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      array[slot(i)].~T();
+    }
+  }
+}
+
+// maps an index to its ring slot without a division
+template<typename T>
+int ArraySeq<T>::slot(int index) const
+{
+  int i = front + index;
+  return i >= capacity ? i - capacity : i;
+}
+
+// works down from the top; each run ends where the source or the
+// destination wraps around the end of the array
+template<typename T>
+void ArraySeq<T>::shift_up(int start, int end)
+{
+  int i = end;
+  while(i > start)
+  {
+    int dst = slot(i);
+    if(dst == 0)
+    {
+      array[0] = std::move(array[capacity - 1]);
+      --i;
+    }
+    else
+    {
+      int run = std::min(i - start, dst);
+      std::move_backward(array + dst - run, array + dst, array + dst + 1);
+      i -= run;
+    }
+  }
+}
+
+// works up from the bottom, the mirror image of shift_up
+template<typename T>
+void ArraySeq<T>::shift_down(int start, int end)
+{
+  int i = start;
+  while(i < end)
+  {
+    int src = slot(i);
+    if(src == 0)
+    {
+      array[capacity - 1] = std::move(array[0]);
+      ++i;
+    }
+    else
+    {
+      int run = std::min(end - i, capacity - src);
+      std::move(array + src, array + src + run, array + src - 1);
+      i += run;
+    }
+  }
+}
+
+// the free slots are raw storage, so rather than rotating in place
+// the elements are relocated at the same capacity
+template<typename T>
+void ArraySeq<T>::linearize()
+{
+  if(front != 0)
+  {
+    relocate(capacity);
+  }
+}
+
+//defaults sort() to intro_sort
 template<typename T>
 void ArraySeq<T>::sort()
 {
-  quick_sort_random();
+  intro_sort();
 }
 
 //calls merge sort
 template<typename T>
 void ArraySeq<T>::merge_sort()
 {
+  linearize();
 
   merge_sort(0,size() - 1);
   
@@ -360,6 +657,7 @@ void ArraySeq<T>::merge_sort()
 template<typename T>
 void ArraySeq<T>::quick_sort()
 {
+  linearize();
 
   quick_sort(0,size()-1);
   
@@ -369,6 +667,7 @@ void ArraySeq<T>::quick_sort()
 template<typename T>
 void ArraySeq<T>::quick_sort_random()
 {
+  linearize();
   // seed the pseudo-random number generator
   std::srand(seed);            
 
@@ -453,7 +752,7 @@ void ArraySeq<T>::quick_sort_random(int start, int end)
 {
   if(start < end)
   {
-    int rand_index = std::rand() % (end - start + 1);
+    int rand_index = start + std::rand() % (end - start + 1);
     //swap
     T val  = array[start];
     array[start] = array[rand_index];
@@ -476,9 +775,414 @@ void ArraySeq<T>::quick_sort_random(int start, int end)
     T temp  = array[start];
     array[start] = array[end_p1];
     array[end_p1] = temp;
-    quick_sort(start, end_p1 - 1);
-    quick_sort(end_p1 + 1, end);
+    quick_sort_random(start, end_p1 - 1);
+    quick_sort_random(end_p1 + 1, end);
+  }
+}
+
+//calls intro sort with a depth limit of 2 log n
+template<typename T>
+void ArraySeq<T>::intro_sort()
+{
+  linearize();
+  int depth_limit = 0;
+  for(int n = count; n > 1; n /= 2)
+  {
+    depth_limit += 2;
+  }
+  intro_sort(0, count - 1, depth_limit);
+  insertion_sort(0, count - 1);
+}
+
+// one counting pass builds the histograms for every digit, then each
+// digit is a stable scatter between the array and one scratch buffer.
+// Digits where every key agrees are skipped.
+template<typename T>
+void ArraySeq<T>::radix_sort()
+{
+  static_assert(std::is_integral<T>::value && !std::is_same<T,bool>::value,
+                "ArraySeq<T>::radix_sort() needs an integral T");
+  typedef typename std::make_unsigned<T>::type U;
+  const int DIGITS = sizeof(T);
+  // flipping the sign bit orders signed values like unsigned ones
+  const U flip = std::is_signed<T>::value ? U(U(1) << (8 * sizeof(T) - 1)) : U(0);
+  linearize();
+  if(count < 2)
+  {
+    return;
+  }
+  int counts[DIGITS][256] = {};
+  for(int i = 0; i < count; i++)
+  {
+    U key = U(array[i]) ^ flip;
+    for(int d = 0; d < DIGITS; d++)
+    {
+      counts[d][(key >> (8 * d)) & 0xFF]++;
+    }
+  }
+  T* buffer = new T[count];
+  T* src = array;
+  T* dst = buffer;
+  for(int d = 0; d < DIGITS; d++)
+  {
+    int shift = 8 * d;
+    if(counts[d][((U(src[0]) ^ flip) >> shift) & 0xFF] == count)
+    {
+      continue;
+    }
+    // bucket start offsets
+    int total = 0;
+    for(int b = 0; b < 256; b++)
+    {
+      int c = counts[d][b];
+      counts[d][b] = total;
+      total += c;
+    }
+    for(int i = 0; i < count; i++)
+    {
+      dst[counts[d][((U(src[i]) ^ flip) >> shift) & 0xFF]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  if(src != array)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      array[i] = src[i];
+    }
+  }
+  delete[] buffer;
+}
+
+// partitions around the pivot, recursing on the smaller side and
+// looping on the larger to bound the stack. When the pivot equals the
+// element just before the range (which is no larger than anything in
+// it), the run of keys equal to the pivot is split off and skipped
+// instead, so duplicates are partitioned three ways. The check is
+// skipped when the range starts at first. Small ranges are left for
+// the final insertion sort.
+template<typename T>
+void ArraySeq<T>::intro_sort(int start, int end, int depth_limit, int first)
+{
+  while(end - start + 1 > INSERTION_CUTOFF)
+  {
+    if(depth_limit == 0)
+    {
+      heap_sort(start, end);
+      return;
+    }
+    depth_limit--;
+    int mid = start + (end - start) / 2;
+    int pivot_index;
+    if(end - start + 1 > 128)
+    {
+      int step = (end - start + 1) / 8;
+      pivot_index = median_of_three(
+        median_of_three(start, start + step, start + 2 * step),
+        median_of_three(mid - step, mid, mid + step),
+        median_of_three(end - 2 * step, end - step, end));
+    }
+    else
+    {
+      pivot_index = median_of_three(start, mid, end);
+    }
+    std::swap(array[start], array[pivot_index]);
+    T pivot_val = array[start];
+    int i = start;
+    int j = end + 1;
+    if(start > first && !(array[start - 1] < pivot_val))
+    {
+      // everything <= pivot is equal to it, so gather those on the left
+      while(true)
+      {
+        while(!(pivot_val < array[++i]) && i < end)
+        {
+        }
+        while(pivot_val < array[--j])
+        {
+        }
+        if(i >= j)
+        {
+          break;
+        }
+        std::swap(array[i], array[j]);
+      }
+      std::swap(array[start], array[j]);
+      start = j + 1;
+      continue;
+    }
+    // keys equal to the pivot stop both scans, keeping splits even
+    while(true)
+    {
+      while(array[++i] < pivot_val && i < end)
+      {
+      }
+      while(pivot_val < array[--j])
+      {
+      }
+      if(i >= j)
+      {
+        break;
+      }
+      std::swap(array[i], array[j]);
+    }
+    std::swap(array[start], array[j]);
+    if(j - start < end - j)
+    {
+      intro_sort(start, j - 1, depth_limit, first);
+      start = j + 1;
+    }
+    else
+    {
+      intro_sort(j + 1, end, depth_limit, first);
+      end = j - 1;
+    }
+  }
+}
+
+// index of the median of the elements at a, b, and c
+template<typename T>
+int ArraySeq<T>::median_of_three(int a, int b, int c) const
+{
+  if(array[a] < array[b])
+  {
+    if(array[b] < array[c])
+    {
+      return b;
+    }
+    return array[a] < array[c] ? c : a;
+  }
+  if(array[a] < array[c])
+  {
+    return a;
+  }
+  return array[b] < array[c] ? c : b;
+}
+
+// insertion sort, fast on the nearly sorted array introsort leaves
+template<typename T>
+void ArraySeq<T>::insertion_sort(int start, int end)
+{
+  for(int i = start + 1; i <= end; i++)
+  {
+    T val = array[i];
+    int j = i - 1;
+    while(j >= start && val < array[j])
+    {
+      array[j + 1] = array[j];
+      j--;
+    }
+    array[j + 1] = val;
+  }
+}
+
+// heap sort of array[start..end] (max-heap rooted at start)
+template<typename T>
+void ArraySeq<T>::heap_sort(int start, int end)
+{
+  int n = end - start + 1;
+  for(int root = n / 2 - 1; root >= 0; root--)
+  {
+    sift_down(start, root, n - 1);
+  }
+  for(int last = n - 1; last > 0; last--)
+  {
+    std::swap(array[start], array[start + last]);
+    sift_down(start, 0, last - 1);
+  }
+}
+
+// moves the heap element at root (relative to start) down until both
+// children are no larger, considering heap positions up to end
+template<typename T>
+void ArraySeq<T>::sift_down(int start, int root, int end)
+{
+  T val = array[start + root];
+  int child = 2 * root + 1;
+  while(child <= end)
+  {
+    if(child < end && array[start + child] < array[start + child + 1])
+    {
+      child++;
+    }
+    if(!(val < array[start + child]))
+    {
+      break;
+    }
+    array[start + root] = array[start + child];
+    root = child;
+    child = 2 * root + 1;
+  }
+  array[start + root] = val;
+}
+
+// parallel merge sort
+template<typename T>
+void ArraySeq<T>::parallel_merge_sort(int threads)
+{
+  linearize();
+  if(count < 2)
+  {
+    return;
+  }
+  if(threads <= 0)
+  {
+    threads = std::thread::hardware_concurrency();
+  }
+  TaskPool pool(threads);
+  T* buffer = new T[count];
+  parallel_merge_sort(pool, buffer, 0, count - 1, false);
+  delete[] buffer;
+}
+
+// parallel quick sort
+template<typename T>
+void ArraySeq<T>::parallel_quick_sort(int threads)
+{
+  linearize();
+  if(count < 2)
+  {
+    return;
+  }
+  if(threads <= 0)
+  {
+    threads = std::thread::hardware_concurrency();
+  }
+  TaskPool pool(threads);
+  parallel_quick_sort(pool, 0, count - 1);
+}
+
+// sorts both halves in parallel into the other storage, then merges
+// them into the requested one
+template<typename T>
+void ArraySeq<T>::parallel_merge_sort(TaskPool& pool, T* buffer, int start, int end, bool into_buffer)
+{
+  if(end - start < PARALLEL_CUTOFF)
+  {
+    merge_sort(start, end);
+    if(into_buffer)
+    {
+      for(int i = start; i <= end; i++)
+      {
+        buffer[i] = array[i];
+      }
+    }
+    return;
+  }
+  int mid = (start + end) / 2;
+  pool.fork_join([&] { parallel_merge_sort(pool, buffer, start, mid, !into_buffer); },
+                 [&] { parallel_merge_sort(pool, buffer, mid + 1, end, !into_buffer); });
+  T* src = into_buffer ? array : buffer;
+  T* dst = into_buffer ? buffer : array;
+  parallel_merge(pool, src, start, mid, mid + 1, end, dst, start);
+}
+
+// merges the sorted runs src[start1..end1] and src[start2..end2] into
+// dst starting at index at. The middle element of the longer run is
+// placed directly, and the elements on either side of it are merged
+// in parallel.
+template<typename T>
+void ArraySeq<T>::parallel_merge(TaskPool& pool, const T* src, int start1, int end1, int start2, int end2, T* dst, int at)
+{
+  int len1 = end1 - start1 + 1;
+  int len2 = end2 - start2 + 1;
+  if(len1 + len2 < PARALLEL_CUTOFF)
+  {
+    while(start1 <= end1 && start2 <= end2)
+    {
+      if(src[start1] < src[start2])
+      {
+        dst[at++] = src[start1++];
+      }
+      else
+      {
+        dst[at++] = src[start2++];
+      }
+    }
+    while(start1 <= end1)
+    {
+      dst[at++] = src[start1++];
+    }
+    while(start2 <= end2)
+    {
+      dst[at++] = src[start2++];
+    }
+    return;
+  }
+  if(len1 < len2)
+  {
+    std::swap(start1, start2);
+    std::swap(end1, end2);
+  }
+  int mid1 = (start1 + end1) / 2;
+  // first index in the other run not less than the middle element
+  int left = start2;
+  int right = end2 + 1;
+  while(left < right)
+  {
+    int mid = (left + right) / 2;
+    if(src[mid] < src[mid1])
+    {
+      left = mid + 1;
+    }
+    else
+    {
+      right = mid;
+    }
+  }
+  int mid_at = at + (mid1 - start1) + (left - start2);
+  dst[mid_at] = src[mid1];
+  pool.fork_join([&] { parallel_merge(pool, src, start1, mid1 - 1, start2, left - 1, dst, at); },
+                 [&] { parallel_merge(pool, src, mid1 + 1, end1, left, end2, dst, mid_at + 1); });
+}
+
+// Hoare partition around the median of the first, middle, and last
+// elements, then sorts both sides in parallel. Small ranges use
+// introsort, which (unlike quick_sort_random) shares no random state
+// between the pool's threads. It is kept from reading the element
+// before its range, which another task may be sorting.
+template<typename T>
+void ArraySeq<T>::parallel_quick_sort(TaskPool& pool, int start, int end)
+{
+  if(end - start < PARALLEL_CUTOFF)
+  {
+    int depth_limit = 0;
+    for(int n = end - start + 1; n > 1; n /= 2)
+    {
+      depth_limit += 2;
+    }
+    intro_sort(start, end, depth_limit, start);
+    insertion_sort(start, end);
+    return;
+  }
+  T a = array[start];
+  T b = array[(start + end) / 2];
+  T c = array[end];
+  T pivot_val = a < b ? (b < c ? b : (a < c ? c : a))
+                      : (a < c ? a : (b < c ? c : b));
+  int i = start - 1;
+  int j = end + 1;
+  while(true)
+  {
+    do
+    {
+      i++;
+    } while(array[i] < pivot_val);
+    do
+    {
+      j--;
+    } while(pivot_val < array[j]);
+    if(i >= j)
+    {
+      break;
+    }
+    //swap
+    T temp = array[i];
+    array[i] = array[j];
+    array[j] = temp;
   }
+  pool.fork_join([&] { parallel_quick_sort(pool, start, j); },
+                 [&] { parallel_quick_sort(pool, j + 1, end); });
 }
 
 
@@ -18,15 +18,44 @@
 #include <iomanip>
 #include <chrono>
 #include <functional>
+#include <thread>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <new>
 #include "util.h"
 #include "sequence.h"
 #include "arrayseq.h"
 #include "linkedseq.h"
+#include "unrolledseq.h"
 
 
 using namespace std;
 using namespace std::chrono;
 
+// heap allocations made so far, counted by the replacement operator
+// new below (array new and the deletes forward to these)
+long heap_allocs = 0;
+
+void* operator new(std::size_t size)
+{
+  ++heap_allocs;
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
 typedef function<void(ArraySeq<int>&)> array_sort_fn;
 typedef function<void(LinkedSeq<int>&)> linked_sort_fn;
 
@@ -46,11 +75,26 @@ void array_quick_sort_random(ArraySeq<int>& s)
   s.quick_sort_random();
 }
 
+void array_intro_sort(ArraySeq<int>& s)
+{
+  s.intro_sort();
+}
+
+void array_radix_sort(ArraySeq<int>& s)
+{
+  s.radix_sort();
+}
+
 void linked_merge_sort(LinkedSeq<int>& s)
 {
   s.merge_sort();
 }
 
+void linked_natural_merge_sort(LinkedSeq<int>& s)
+{
+  s.natural_merge_sort();
+}
+
 void linked_quick_sort(LinkedSeq<int>& s)
 {
   s.quick_sort();
@@ -65,6 +109,18 @@ void linked_quick_sort_random(LinkedSeq<int>& s)
 double array_timed(const ArraySeq<int>& seq, array_sort_fn f);
 double linked_timed(const LinkedSeq<int>& seq, linked_sort_fn f);
 void check_sorted(const Sequence<int>& s);
+template<typename F>
+double pooled_timed(const ArraySeq<int>& values, F f);
+template<typename L>
+void alloc_row(const string& label, int n);
+template<typename S>
+void access_row(const string& label, int n);
+template<typename S>
+void insert_row(const string& label, int n);
+template<typename S>
+void string_row(const string& label, int n);
+template<typename S>
+long index_sum(const S& s, int passes);
 
 // test parameters
 const int start = 0;
@@ -72,6 +128,17 @@ const int step = 1500;
 const int stop = 15000;
 const int runs = 1;
 const int shuffles = 5;
+const int alloc_n = 1000000;
+const int parallel_n = 4000000;
+const int linked_n = 1000000;
+const int access_n = 20000;
+const int access_ops = 1000;
+const int scan_start = 5000;
+const int scan_stop = 40000;
+const int insert_n = 50000;
+const int string_n = 1000000;
+const int dispatch_n = 4000000;
+const int load_n = 10000000;
 
 
 int main(int argc, char* argv[])
@@ -102,6 +169,15 @@ int main(int argc, char* argv[])
   cout << "# Column 12 = avg time linked quick sort random, reversed" << endl;
   cout << "# Column 13 = avg time linked quick sort random, shuffled" << endl;
 
+  cout << "# Column 14 = avg time array intro sort, reversed" << endl;
+  cout << "# Column 15 = avg time array intro sort, shuffled" << endl;
+
+  cout << "# Column 16 = avg time array radix sort, reversed" << endl;
+  cout << "# Column 17 = avg time array radix sort, shuffled" << endl;
+
+  cout << "# Column 18 = avg time linked natural merge sort, reversed" << endl;
+  cout << "# Column 19 = avg time linked natural merge sort, shuffled" << endl;
+
   
   // run tests and print test results
   for (int size = start; size <= stop; size += step) {
@@ -131,12 +207,196 @@ int main(int argc, char* argv[])
     double c12 = linked_timed(linked_reversed, linked_quick_sort_random);
     double c13 = linked_timed(linked_shuffled, linked_quick_sort_random);
 
+    double c14 = array_timed(array_reversed, array_intro_sort);
+    double c15 = array_timed(array_shuffled, array_intro_sort);
+
+    double c16 = array_timed(array_reversed, array_radix_sort);
+    double c17 = array_timed(array_shuffled, array_radix_sort);
+
+    double c18 = linked_timed(linked_reversed, linked_natural_merge_sort);
+    double c19 = linked_timed(linked_shuffled, linked_natural_merge_sort);
+
     cout << size << " " << c2 << " " << c3 << " " << c4 << " "
 	 << c5 << " " << c6 << " " << c7 << " " << c8 << " "
 	 << c9 << " " << c10 << " " << c11 << " " << c12 << " "
-         << c13 << endl;
+         << c13 << " " << c14 << " " << c15 << " " << c16 << " "
+         << c17 << " " << c18 << " " << c19 << endl;
   }
 
+  // heap vs pool node allocation (comment lines so the plot script
+  // skips them)
+  cout << "# node allocation over " << alloc_n << " elements (msec): "
+       << "load, erase+reinsert front half, clear, nodes, "
+       << "system allocations" << endl;
+  alloc_row<LinkedSeq<int>>("heap", alloc_n);
+  alloc_row<LinkedSeq<int,PoolAlloc>>("pool", alloc_n);
+
+  // indexed access for the array, linked, and unrolled sequences
+  cout << "# indexed access over " << access_n << " elements (msec): "
+       << "index scan, " << access_ops << " missing contains, "
+       << access_ops << " middle inserts+erases" << endl;
+  access_row<ArraySeq<int>>("array", access_n);
+  access_row<LinkedSeq<int>>("linked", access_n);
+  access_row<UnrolledSeq<int,64>>("unrolled-64", access_n);
+  access_row<UnrolledSeq<int,256>>("unrolled-256", access_n);
+  access_row<UnrolledSeq<int,4096>>("unrolled-4096", access_n);
+
+  // inserts at the front, middle, and back, then erases from the front
+  cout << "# inserts of " << insert_n << " elements (msec): "
+       << "front, middle, back, front erases" << endl;
+  insert_row<ArraySeq<int>>("array", insert_n);
+  insert_row<LinkedSeq<int>>("linked", insert_n);
+  insert_row<UnrolledSeq<int>>("unrolled-256", insert_n);
+
+  // appends of strings copied, moved, and emplaced
+  cout << "# string appends of " << string_n << " elements: copy msec, "
+       << "copy allocs/insert, move msec, move allocs/insert, "
+       << "emplace msec, emplace allocs/insert" << endl;
+  string_row<ArraySeq<string>>("array", string_n);
+  string_row<LinkedSeq<string>>("linked", string_n);
+  string_row<UnrolledSeq<string>>("unrolled-256", string_n);
+
+  // linked full index scans: forward scans resume from the finger,
+  // backward scans restart at head for every element
+  cout << "# linked index scan (msec): n, forward, backward" << endl;
+  for (int n = scan_start; n <= scan_stop; n *= 2) {
+    LinkedSeq<int> seq;
+    for (int i = 0; i < n; ++i)
+      seq.insert(i, i);
+    long sum = 0;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i)
+      sum += seq[i];
+    auto t1 = high_resolution_clock::now();
+    for (int i = n - 1; i >= 0; --i)
+      sum -= seq[i];
+    auto t2 = high_resolution_clock::now();
+    if (sum != 0) {
+      std::cerr << "Error: linked index scan check failed" << endl;
+      std::terminate();
+    }
+    cout << "# " << n << " "
+         << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+         << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << endl;
+  }
+
+  // large linked sorts (first-element quick sort is left out, it
+  // recurses once per element on ordered input)
+  ArraySeq<int> big_shuffled, big_reversed;
+  load_shuffled(big_shuffled, linked_n, shuffles);
+  load_reverse_order(big_reversed, linked_n);
+  auto merge = [](LinkedSeq<int,PoolAlloc>& s) { s.merge_sort(); };
+  auto quick = [](LinkedSeq<int,PoolAlloc>& s) { s.quick_sort_random(); };
+  auto natural = [](LinkedSeq<int,PoolAlloc>& s) { s.natural_merge_sort(); };
+  cout << "# linked sort of " << linked_n << " ints (msec): "
+       << "shuffled merge, quick random, natural merge; "
+       << "reversed merge, quick random, natural merge" << endl;
+  cout << "# " << pooled_timed(big_shuffled, merge) << " "
+       << pooled_timed(big_shuffled, quick) << " "
+       << pooled_timed(big_shuffled, natural) << " "
+       << pooled_timed(big_reversed, merge) << " "
+       << pooled_timed(big_reversed, quick) << " "
+       << pooled_timed(big_reversed, natural) << endl;
+
+  // parallel sorts, with speedup over the one-thread run
+  ArraySeq<int> parallel_shuffled;
+  load_shuffled(parallel_shuffled, parallel_n, shuffles);
+
+  // sequential sorts at the same size, with std::sort for reference
+  vector<int> std_shuffled;
+  for (int i = 0; i < parallel_n; ++i)
+    std_shuffled.push_back(parallel_shuffled[i]);
+  auto t0 = high_resolution_clock::now();
+  std::sort(std_shuffled.begin(), std_shuffled.end());
+  auto t1 = high_resolution_clock::now();
+  cout << "# sequential sort of " << parallel_n << " shuffled ints (msec): "
+       << "intro, quick random, radix, std::sort" << endl;
+  cout << "# " << array_timed(parallel_shuffled, array_intro_sort) << " "
+       << array_timed(parallel_shuffled, array_quick_sort_random) << " "
+       << array_timed(parallel_shuffled, array_radix_sort) << " "
+       << duration_cast<milliseconds>(t1 - t0).count() << endl;
+  int max_threads = max(4, (int)thread::hardware_concurrency());
+  cout << "# parallel sort of " << parallel_n << " shuffled ints (msec): "
+       << "threads, merge, merge speedup, quick, quick speedup" << endl;
+  double merge_base = 0;
+  double quick_base = 0;
+  for (int t = 1; t <= max_threads; t *= 2) {
+    double m = array_timed(parallel_shuffled,
+                           [t](ArraySeq<int>& s) { s.parallel_merge_sort(t); });
+    double q = array_timed(parallel_shuffled,
+                           [t](ArraySeq<int>& s) { s.parallel_quick_sort(t); });
+    if (t == 1) {
+      merge_base = m;
+      quick_base = q;
+    }
+    cout << "# " << t << " " << m << " " << merge_base / m << " "
+         << q << " " << quick_base / q << endl;
+  }
+
+  // util helpers and an indexed scan called through Sequence<int>&
+  // (virtual) and through the final ArraySeq<int> (direct calls)
+  cout << "# dispatch over " << dispatch_n << " elements (msec): "
+       << "load virtual, load static, shuffle virtual, shuffle static, "
+       << "scan virtual, scan static" << endl;
+  {
+    ArraySeq<int> seq1, seq2;
+    Sequence<int>& base = seq1;
+    seq1.reserve(dispatch_n);
+    seq2.reserve(dispatch_n);
+    auto t0 = high_resolution_clock::now();
+    load_in_order(base, dispatch_n);
+    auto t1 = high_resolution_clock::now();
+    load_in_order(seq2, dispatch_n);
+    auto t2 = high_resolution_clock::now();
+    faro_shuffle(base, shuffles);
+    auto t3 = high_resolution_clock::now();
+    faro_shuffle(seq2, shuffles);
+    auto t4 = high_resolution_clock::now();
+    long sum1 = index_sum<Sequence<int>>(base, 5);
+    auto t5 = high_resolution_clock::now();
+    long sum2 = index_sum(seq2, 5);
+    auto t6 = high_resolution_clock::now();
+    if (sum1 != sum2 || seq1[1] != seq2[1]) {
+      std::cerr << "Error: dispatch check failed" << endl;
+      std::terminate();
+    }
+    cout << "# " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << duration_cast<microseconds>(t2 - t1).count() / 1000.0
+         << " " << duration_cast<microseconds>(t3 - t2).count() / 1000.0
+         << " " << duration_cast<microseconds>(t4 - t3).count() / 1000.0
+         << " " << duration_cast<microseconds>(t5 - t4).count() / 1000.0
+         << " " << duration_cast<microseconds>(t6 - t5).count() / 1000.0
+         << endl;
+  }
+
+  // appending load_n ints (load_in_order) and strings, growing as
+  // needed or into reserved storage; the strings are too long for the
+  // small string buffer, so each copy allocates
+  cout << "# load in order of " << load_n << " elements (msec): "
+       << "int, int reserved, string, string reserved" << endl;
+  cout << "#";
+  for (int reserved = 0; reserved < 2; ++reserved) {
+    ArraySeq<int> seq;
+    if (reserved)
+      seq.reserve(load_n);
+    auto t0 = high_resolution_clock::now();
+    load_in_order(seq, load_n);
+    auto t1 = high_resolution_clock::now();
+    cout << " " << duration_cast<milliseconds>(t1 - t0).count();
+  }
+  for (int reserved = 0; reserved < 2; ++reserved) {
+    ArraySeq<string> seq;
+    if (reserved)
+      seq.reserve(load_n);
+    string value = "a value too long for the small string buffer";
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < load_n; ++i)
+      seq.insert(value, i);
+    auto t1 = high_resolution_clock::now();
+    cout << " " << duration_cast<milliseconds>(t1 - t0).count();
+  }
+  cout << endl;
+
 }
 
 double array_timed(const ArraySeq<int>& seq, array_sort_fn f)
@@ -167,6 +427,26 @@ double linked_timed(const LinkedSeq<int>& seq, linked_sort_fn f)
   return (total * 1.0) / runs;
 }
 
+// sorts a new pooled list of the values, so every run starts with the
+// nodes laid out in list order (a heap list copy reuses nodes freed in
+// the last sort's order)
+template<typename F>
+double pooled_timed(const ArraySeq<int>& values, F f)
+{
+  int total = 0;
+  for (int r = 0; r < runs; ++r) {
+    LinkedSeq<int,PoolAlloc> s;
+    for (int i = 0; i < values.size(); ++i)
+      s.insert(values[i], i);
+    auto t0 = high_resolution_clock::now();
+    f(s);
+    auto t1 = high_resolution_clock::now();
+    total += duration_cast<milliseconds>(t1 - t0).count();
+    check_sorted(s);
+  }
+  return (total * 1.0) / runs;
+}
+
 void check_sorted(const Sequence<int>& s)
 {
   for (int i = 0; i < s.size() - 1; ++i) {
@@ -178,3 +458,139 @@ void check_sorted(const Sequence<int>& s)
     }
   }
 }
+
+// fills the list at the front, erases and reinserts the front half,
+// and clears the list, printing the three times and allocation counts
+template<typename L>
+void alloc_row(const string& label, int n)
+{
+  L seq;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    seq.insert(i, 0);
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < n / 2; ++i)
+    seq.erase(0);
+  for (int i = 0; i < n / 2; ++i)
+    seq.insert(i, 0);
+  auto t2 = high_resolution_clock::now();
+  seq.clear();
+  auto t3 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << " "
+       << seq.alloc_stats().nodes << " " << seq.alloc_stats().system << endl;
+}
+
+// appends n values, then times reading every index, searching for a
+// value that is not there, and inserting then erasing at the middle
+template<typename S>
+void access_row(const string& label, int n)
+{
+  S seq;
+  for (int i = 0; i < n; ++i)
+    seq.insert(i, i);
+  auto t0 = high_resolution_clock::now();
+  long sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += seq[i];
+  auto t1 = high_resolution_clock::now();
+  int found = 0;
+  for (int i = 0; i < access_ops; ++i)
+    found += seq.contains(-i - 1);
+  auto t2 = high_resolution_clock::now();
+  for (int i = 0; i < access_ops; ++i)
+    seq.insert(i, n / 2);
+  for (int i = 0; i < access_ops; ++i)
+    seq.erase(n / 2);
+  auto t3 = high_resolution_clock::now();
+  if (sum != (long) n * (n - 1) / 2 || found != 0 || seq.size() != n) {
+    std::cerr << "Error: " << label << " access check failed" << endl;
+    std::terminate();
+  }
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << endl;
+}
+
+// builds three sequences of n values by inserting at the front, at
+// the middle, and at the back, then empties the last from the front
+template<typename S>
+void insert_row(const string& label, int n)
+{
+  S front_seq, middle_seq, back_seq;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    front_seq.insert(i, 0);
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    middle_seq.insert(i, i / 2);
+  auto t2 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    back_seq.insert(i, i);
+  auto t3 = high_resolution_clock::now();
+  long sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += back_seq[0];
+    back_seq.erase(0);
+  }
+  auto t4 = high_resolution_clock::now();
+  if (sum != (long) n * (n - 1) / 2 || front_seq[0] != n - 1) {
+    std::cerr << "Error: " << label << " insert check failed" << endl;
+    std::terminate();
+  }
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t4 - t3).count() / 1000.0 << endl;
+}
+
+// appends n strings too long for the small string buffer three ways:
+// copied from const references, moved in, and emplaced from the
+// constructor arguments. Prints the time (msec) and the heap
+// allocations per insert of each.
+template<typename S>
+void string_row(const string& label, int n)
+{
+  vector<string> strs;
+  for (int i = 0; i < n; ++i)
+    strs.push_back(string(40, 'a' + i % 26));
+  cout << "# " << label;
+  for (int mode = 0; mode < 3; ++mode) {
+    vector<string> values = strs;
+    S seq;
+    long a0 = heap_allocs;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+      if (mode == 0)
+        seq.insert(values[i], i);
+      else if (mode == 1)
+        seq.insert(std::move(values[i]), i);
+      else
+        seq.emplace(i, 40, 'a' + i % 26);
+    }
+    auto t1 = high_resolution_clock::now();
+    long a1 = heap_allocs;
+    if (seq.size() != n || seq[n - 1] != strs[n - 1]) {
+      std::cerr << "Error: " << label << " string check failed" << endl;
+      std::terminate();
+    }
+    cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << (a1 - a0) / (double) n;
+  }
+  cout << endl;
+}
+
+// sums the elements by index, passes times over
+template<typename S>
+long index_sum(const S& s, int passes)
+{
+  long sum = 0;
+  for (int p = 0; p < passes; ++p)
+    for (int i = 0; i < s.size(); ++i)
+      sum += s[i];
+  return sum;
+}
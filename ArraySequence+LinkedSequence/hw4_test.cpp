@@ -7,9 +7,12 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <gtest/gtest.h>
 #include "linkedseq.h"
 #include "arrayseq.h"
+#include "unrolledseq.h"
 
 using namespace std;
 
@@ -733,6 +736,472 @@ TEST(BasicArraySeqTests, FourElemMergeSortCases)
 
 
 
+TEST(BasicLinkedSeqTests, PoolAllocCheck)
+{
+  LinkedSeq<int,PoolAlloc> seq;
+  for (int i = 0; i < 100; ++i)
+    seq.insert(100 - i, i);
+  for (int i = 0; i < 50; ++i)
+    seq.erase(0);
+  long slabs = seq.alloc_stats().system;
+  for (int i = 0; i < 50; ++i)
+    seq.insert(i, 0);
+  ASSERT_EQ(slabs, seq.alloc_stats().system);
+  ASSERT_EQ(150, seq.alloc_stats().nodes);
+  seq.sort();
+  for (int i = 0; i < 99; ++i)
+    ASSERT_LE(seq[i], seq[i + 1]);
+  LinkedSeq<int,PoolAlloc> seq2(seq);
+  LinkedSeq<int,PoolAlloc> seq3(std::move(seq));
+  ASSERT_EQ(0, seq.size());
+  ASSERT_EQ(100, seq2.size());
+  ASSERT_EQ(100, seq3.size());
+  seq2.clear();
+  ASSERT_EQ(true, seq2.empty());
+  seq2.insert(7, 0);
+  ASSERT_EQ(7, seq2[0]);
+  ASSERT_EQ(50, seq3[99]);
+}
+
+TEST(BasicArraySeqTests, ParallelSortCases)
+{
+  // large enough to split many times, with and without duplicates
+  ArraySeq<int> seq1, seq2, seq3;
+  for (int i = 0; i < 100000; ++i) {
+    seq1.insert((i * 7919) % 100003, i);
+    seq2.insert(i % 10, i);
+    seq3.insert(100000 - i, i);
+  }
+  ArraySeq<int> seq4 = seq1, seq5 = seq2, seq6 = seq3;
+  seq1.parallel_merge_sort(4);
+  seq2.parallel_merge_sort(3);
+  seq3.parallel_merge_sort(1);
+  seq4.parallel_quick_sort(4);
+  seq5.parallel_quick_sort(3);
+  seq6.parallel_quick_sort(1);
+  for (int i = 0; i < 99999; ++i) {
+    ASSERT_LE(seq1[i], seq1[i + 1]);
+    ASSERT_LE(seq2[i], seq2[i + 1]);
+    ASSERT_EQ(i + 1, seq3[i]);
+    ASSERT_EQ(seq1[i], seq4[i]);
+    ASSERT_EQ(seq2[i], seq5[i]);
+    ASSERT_EQ(seq3[i], seq6[i]);
+  }
+  ASSERT_EQ(0, seq2[0]);
+  ASSERT_EQ(9, seq2[99999]);
+  // small and empty sequences
+  ArraySeq<int> seq7, seq8;
+  seq7.parallel_merge_sort(4);
+  seq8.insert(20, 0);
+  seq8.insert(10, 1);
+  seq8.parallel_quick_sort(4);
+  ASSERT_EQ(10, seq8[0]);
+  ASSERT_EQ(20, seq8[1]);
+}
+
+TEST(BasicArraySeqTests, FourElemIntroSortCases)
+{
+  ArraySeq<int> seq1; // <10,20,30,40>
+  ArraySeq<int> seq2; // <40,30,20,10>
+  ArraySeq<int> seq3; // <20,40,30,10>
+  ArraySeq<int> seq4; // <10,20,20,10> (testing duplicates)
+  
+  for(int i = 1; i < 5; i++)
+  {
+    seq1.insert(10*i, i-1);
+  }
+  for(int a = 1; a < 5; a++)
+  {
+    seq2.insert(10*a, 0);
+  }
+  seq3.insert(20, 0);
+  seq3.insert(40, 1);
+  seq3.insert(30, 2);
+  seq3.insert(10, 3);
+
+  seq4.insert(10, 0);
+  seq4.insert(20, 1);
+  seq4.insert(20, 2);
+  seq4.insert(10, 3);
+
+  seq1.intro_sort();
+  seq2.intro_sort();
+  seq3.intro_sort();
+  seq4.sort();
+  
+  for(int i = 1; i < 5; i++)
+  {
+    ASSERT_EQ(10*i, seq1[i-1]);
+    ASSERT_EQ(10*i, seq2[i-1]);
+    ASSERT_EQ(10*i, seq3[i-1]);
+  }
+  ASSERT_EQ(10, seq4[0]);
+  ASSERT_EQ(10, seq4[1]);
+  ASSERT_EQ(20, seq4[2]);
+  ASSERT_EQ(20, seq4[3]);
+}
+
+TEST(BasicArraySeqTests, LargeIntroSortCases)
+{
+  // reversed, shuffled, and few distinct values (past the insertion
+  // sort cutoff so partitioning is exercised)
+  ArraySeq<int> seq1, seq2, seq3;
+  for (int i = 0; i < 5000; ++i) {
+    seq1.insert(5000 - i, i);
+    seq2.insert((i * 7919) % 5003, i);
+    seq3.insert(i % 3, i);
+  }
+  seq1.sort();
+  seq2.sort();
+  seq3.sort();
+  for (int i = 0; i < 4999; ++i) {
+    ASSERT_EQ(i + 1, seq1[i]);
+    ASSERT_LT(seq2[i], seq2[i + 1]);
+    ASSERT_LE(seq3[i], seq3[i + 1]);
+  }
+  ASSERT_EQ(0, seq3[0]);
+  ASSERT_EQ(2, seq3[4999]);
+}
+
+TEST(BasicArraySeqTests, RadixSortCases)
+{
+  ArraySeq<int> seq1, seq2, seq3;
+  for (int i = 0; i < 5000; ++i) {
+    seq1.insert(5000 - i, i);
+    seq2.insert((i * 7919) % 5003 - 2500, i);  // negative and positive
+    seq3.insert(i % 2 == 0 ? 2147483647 : -2147483647 - 1, i);
+  }
+  seq1.radix_sort();
+  seq2.radix_sort();
+  seq3.radix_sort();
+  for (int i = 0; i < 4999; ++i) {
+    ASSERT_EQ(i + 1, seq1[i]);
+    ASSERT_LT(seq2[i], seq2[i + 1]);
+    ASSERT_LE(seq3[i], seq3[i + 1]);
+  }
+  ASSERT_EQ(-2147483647 - 1, seq3[0]);
+  ASSERT_EQ(2147483647, seq3[4999]);
+  // other integral widths
+  ArraySeq<unsigned char> seq4;
+  ArraySeq<long long> seq5;
+  for (int i = 0; i < 300; ++i) {
+    seq4.insert(255 - (i % 256), i);
+    seq5.insert((i % 2 ? -1LL : 1LL) * i * 1000000007LL, i);
+  }
+  seq4.radix_sort();
+  seq5.radix_sort();
+  for (int i = 0; i < 299; ++i) {
+    ASSERT_LE(seq4[i], seq4[i + 1]);
+    ASSERT_LE(seq5[i], seq5[i + 1]);
+  }
+  ArraySeq<int> empty;
+  empty.radix_sort();
+  ASSERT_EQ(0, empty.size());
+}
+
+TEST(BasicLinkedSeqTests, NaturalMergeSortCases)
+{
+  LinkedSeq<int> seq1; // <10,20,30,40>
+  LinkedSeq<int> seq2; // <40,30,20,10>
+  LinkedSeq<int> seq3; // <20,40,30,10>
+  LinkedSeq<int> seq4; // <10,20,20,10> (testing duplicates)
+  for (int i = 1; i < 5; ++i) {
+    seq1.insert(10 * i, i - 1);
+    seq2.insert(10 * i, 0);
+  }
+  seq3.insert(20, 0);
+  seq3.insert(40, 1);
+  seq3.insert(30, 2);
+  seq3.insert(10, 3);
+  seq4.insert(10, 0);
+  seq4.insert(20, 1);
+  seq4.insert(20, 2);
+  seq4.insert(10, 3);
+  seq1.natural_merge_sort();
+  seq2.natural_merge_sort();
+  seq3.natural_merge_sort();
+  seq4.natural_merge_sort();
+  for (int i = 1; i < 5; ++i) {
+    ASSERT_EQ(10 * i, seq1[i - 1]);
+    ASSERT_EQ(10 * i, seq2[i - 1]);
+    ASSERT_EQ(10 * i, seq3[i - 1]);
+  }
+  ASSERT_EQ(10, seq4[0]);
+  ASSERT_EQ(10, seq4[1]);
+  ASSERT_EQ(20, seq4[2]);
+  ASSERT_EQ(20, seq4[3]);
+  // many short runs, then the tail must still accept appends
+  LinkedSeq<int> seq5;
+  for (int i = 0; i < 1000; ++i)
+    seq5.insert((i * 37) % 101, i);
+  seq5.natural_merge_sort();
+  for (int i = 0; i < 999; ++i)
+    ASSERT_LE(seq5[i], seq5[i + 1]);
+  seq5.insert(500, 1000);
+  ASSERT_EQ(500, seq5[1000]);
+  ASSERT_EQ(100, seq5[999]);
+  LinkedSeq<int> empty;
+  empty.natural_merge_sort();
+  ASSERT_EQ(0, empty.size());
+}
+
+TEST(BasicUnrolledSeqTests, SplitMergeCases)
+{
+  // four ints per chunk so inserts and erases split and merge often
+  UnrolledSeq<int,16> seq;
+  ASSERT_EQ(4, seq.chunk_capacity());
+  ASSERT_TRUE(seq.empty());
+  ASSERT_THROW(seq[0], std::out_of_range);
+  ASSERT_THROW(seq.insert(1, 1), std::out_of_range);
+  for (int i = 0; i < 10; ++i)
+    seq.insert(i, i);  // appends fill chunks
+  ASSERT_EQ(3, seq.chunk_count());
+  seq.insert(100, 1);  // splits the first chunk
+  ASSERT_EQ(4, seq.chunk_count());
+  ASSERT_EQ(0, seq[0]);
+  ASSERT_EQ(100, seq[1]);
+  ASSERT_EQ(1, seq[2]);
+  ASSERT_EQ(9, seq[10]);
+  ASSERT_TRUE(seq.contains(100));
+  ASSERT_FALSE(seq.contains(10));
+  // drain the middle down to a single chunk
+  while (seq.size() > 2)
+    seq.erase(1);
+  ASSERT_EQ(1, seq.chunk_count());
+  ASSERT_EQ(0, seq[0]);
+  ASSERT_EQ(9, seq[1]);
+  ASSERT_THROW(seq.erase(2), std::out_of_range);
+  seq.erase(0);
+  seq.erase(0);
+  ASSERT_EQ(0, seq.chunk_count());
+  ASSERT_TRUE(seq.empty());
+}
+
+TEST(BasicUnrolledSeqTests, MatchesLinkedSeq)
+{
+  UnrolledSeq<int,32,PoolAlloc> seq1;
+  LinkedSeq<int> seq2;
+  int r = 7;
+  for (int step = 0; step < 3000; ++step) {
+    r = (r * 1103 + 12345) % 30011;
+    if (seq2.size() > 0 && r % 3 == 0) {
+      seq1.erase(r % seq2.size());
+      seq2.erase(r % seq2.size());
+    } else {
+      seq1.insert(r, r % (seq2.size() + 1));
+      seq2.insert(r, r % (seq2.size() + 1));
+    }
+  }
+  ASSERT_EQ(seq2.size(), seq1.size());
+  for (int i = 0; i < seq2.size(); ++i)
+    ASSERT_EQ(seq2[i], seq1[i]);
+  // copies, moves, and sort
+  UnrolledSeq<int,32,PoolAlloc> seq3 = seq1;
+  UnrolledSeq<int,32,PoolAlloc> seq4 = std::move(seq1);
+  ASSERT_EQ(0, seq1.size());
+  seq3.sort();
+  seq2.sort();
+  for (int i = 0; i < seq2.size(); ++i) {
+    ASSERT_EQ(seq2[i], seq3[i]);
+    ASSERT_EQ(seq4[i], seq4[i]);
+  }
+  ASSERT_EQ(seq2.size(), seq4.size());
+}
+
+TEST(BasicLinkedSeqTests, FingerAccessCases)
+{
+  // reads interleaved with inserts and erases before, at, and after
+  // the last accessed index
+  LinkedSeq<int> seq;
+  std::vector<int> expected;
+  int r = 11;
+  for (int step = 0; step < 4000; ++step) {
+    r = (r * 1103 + 12345) % 30011;
+    int n = expected.size();
+    if (n > 0 && r % 5 == 0) {
+      seq.erase(r % n);
+      expected.erase(expected.begin() + r % n);
+    } else if (r % 5 < 3) {
+      seq.insert(r, r % (n + 1));
+      expected.insert(expected.begin() + r % (n + 1), r);
+    } else if (n > 0) {
+      ASSERT_EQ(expected[r % n], seq[r % n]);
+      seq[r % n] = step;
+      expected[r % n] = step;
+    }
+    if (step % 500 == 0) {
+      seq.sort();
+      std::sort(expected.begin(), expected.end());
+    }
+  }
+  ASSERT_EQ((int) expected.size(), seq.size());
+  for (int i = 0; i < seq.size(); ++i)
+    ASSERT_EQ(expected[i], seq[i]);
+  for (int i = seq.size() - 1; i >= 0; --i)
+    ASSERT_EQ(expected[i], seq[i]);
+  LinkedSeq<int> copy = seq;
+  seq.clear();
+  ASSERT_THROW(seq[0], std::out_of_range);
+  for (int i = 0; i < copy.size(); ++i)
+    ASSERT_EQ(expected[i], copy[i]);
+}
+
+TEST(BasicArraySeqTests, RingInsertEraseCases)
+{
+  // front, back, and middle edits wrap around the ring; sorts, copies,
+  // and moves must see the elements in order
+  ArraySeq<int> seq;
+  std::vector<int> expected;
+  int r = 5;
+  for (int step = 0; step < 6000; ++step) {
+    r = (r * 1103 + 12345) % 30011;
+    int n = expected.size();
+    int at = r % 4 == 0 ? 0 : (r % 4 == 1 ? n : r % (n + 1));
+    if (n > 0 && r % 7 < 3) {
+      at = at == n ? n - 1 : at;
+      seq.erase(at);
+      expected.erase(expected.begin() + at);
+    } else {
+      seq.insert(r, at);
+      expected.insert(expected.begin() + at, r);
+    }
+    if (step % 1000 == 999) {
+      ArraySeq<int> copy = seq;
+      ArraySeq<int> moved = std::move(copy);
+      moved.sort();
+      std::vector<int> sorted = expected;
+      std::sort(sorted.begin(), sorted.end());
+      for (int i = 0; i < (int) sorted.size(); ++i)
+        ASSERT_EQ(sorted[i], moved[i]);
+    }
+  }
+  ASSERT_EQ((int) expected.size(), seq.size());
+  for (int i = 0; i < seq.size(); ++i)
+    ASSERT_EQ(expected[i], seq[i]);
+  ASSERT_TRUE(seq.contains(expected.back()));
+  // a queue: push at the back, pop at the front
+  ArraySeq<int> queue;
+  for (int i = 0; i < 100; ++i) {
+    queue.insert(i, queue.size());
+    queue.insert(i, queue.size());
+    ASSERT_EQ(i / 2, queue[0]);
+    queue.erase(0);
+  }
+  queue.radix_sort();
+  for (int i = 0; i < queue.size() - 1; ++i)
+    ASSERT_LE(queue[i], queue[i + 1]);
+}
+
+// counts live objects and copies to check ArraySeq's raw storage
+struct Tracked {
+  static int live;
+  static int copies;
+  int value = 0;
+  Tracked() { ++live; }
+  Tracked(int v) : value(v) { ++live; }
+  Tracked(const Tracked& rhs) : value(rhs.value) { ++live; ++copies; }
+  Tracked(Tracked&& rhs) : value(rhs.value) { ++live; }
+  Tracked& operator=(const Tracked& rhs) { value = rhs.value; ++copies; return *this; }
+  Tracked& operator=(Tracked&& rhs) { value = rhs.value; return *this; }
+  ~Tracked() { --live; }
+  bool operator==(const Tracked& rhs) const { return value == rhs.value; }
+  bool operator<(const Tracked& rhs) const { return value < rhs.value; }
+};
+int Tracked::live = 0;
+int Tracked::copies = 0;
+
+TEST(BasicArraySeqTests, RawStorageCases)
+{
+  {
+    ArraySeq<Tracked> seq;
+    Tracked elem(1);
+    for (int i = 0; i < 1000; ++i)
+      seq.insert(elem, seq.size());
+    // one copy per insert, growth only moves, and only elements live
+    ASSERT_EQ(1000, Tracked::copies);
+    ASSERT_EQ(1001, Tracked::live);
+    seq.erase(0);
+    seq.erase(500);
+    seq.erase(seq.size() - 1);
+    ASSERT_EQ(998, Tracked::live);
+    seq.shrink_to_fit();
+    ASSERT_EQ(997, seq.allocated());
+    seq.clear();
+    ASSERT_EQ(1, Tracked::live);
+    seq.shrink_to_fit();
+    ASSERT_EQ(0, seq.allocated());
+  }
+  ASSERT_EQ(0, Tracked::live);
+  // strings long enough to live on the heap
+  ArraySeq<std::string> seq;
+  std::vector<std::string> expected;
+  seq.reserve(10);
+  ASSERT_EQ(10, seq.allocated());
+  seq.reserve(5);
+  ASSERT_EQ(10, seq.allocated());
+  for (int i = 0; i < 300; ++i) {
+    std::string value = "a long string value number " + std::to_string(i * 7919 % 300);
+    int at = i % 3 == 0 ? 0 : (i % 3 == 1 ? seq.size() : seq.size() / 2);
+    seq.insert(value, at);
+    expected.insert(expected.begin() + at, value);
+    if (i % 5 == 4) {
+      seq.erase(i % seq.size());
+      expected.erase(expected.begin() + i % expected.size());
+    }
+  }
+  ArraySeq<std::string> copy = seq;
+  ArraySeq<std::string> moved = std::move(seq);
+  ASSERT_EQ(0, seq.size());
+  for (int i = 0; i < (int) expected.size(); ++i) {
+    ASSERT_EQ(expected[i], copy[i]);
+    ASSERT_EQ(expected[i], moved[i]);
+  }
+  moved.shrink_to_fit();
+  moved.sort();
+  std::sort(expected.begin(), expected.end());
+  for (int i = 0; i < (int) expected.size(); ++i)
+    ASSERT_EQ(expected[i], moved[i]);
+}
+
+// inserts rvalues and emplaces at the front, middle, and back, checking
+// the order against a vector and that no element was ever copied
+template<typename S>
+void move_insert_check()
+{
+  Tracked::copies = 0;
+  S seq;
+  std::vector<int> expected;
+  for (int i = 0; i < 600; ++i) {
+    int at = i % 3 == 0 ? 0 : (i % 3 == 1 ? seq.size() : seq.size() / 2);
+    if (i % 2 == 0)
+      seq.insert(Tracked(i), at);
+    else
+      seq.emplace(at, i);
+    expected.insert(expected.begin() + at, i);
+  }
+  ASSERT_EQ(0, Tracked::copies);
+  ASSERT_EQ((int) expected.size(), seq.size());
+  for (int i = 0; i < (int) expected.size(); ++i)
+    ASSERT_EQ(expected[i], seq[i].value);
+  ASSERT_THROW(seq.emplace(-1, 0), std::out_of_range);
+  ASSERT_THROW(seq.insert(Tracked(0), seq.size() + 1), std::out_of_range);
+}
+
+TEST(BasicSeqTests, MoveInsertCases)
+{
+  move_insert_check<ArraySeq<Tracked>>();
+  move_insert_check<LinkedSeq<Tracked>>();
+  move_insert_check<UnrolledSeq<Tracked, 64>>();
+  // a moved-in string keeps its buffer
+  LinkedSeq<std::string> seq;
+  std::string value(100, 'x');
+  const char* buffer = value.data();
+  seq.insert(std::move(value), 0);
+  ASSERT_EQ(buffer, seq[0].data());
+  seq.emplace(1, 3, 'y');
+  ASSERT_EQ("yyy", seq[1]);
+}
+
 //----------------------------------------------------------------------
 // Main
 //----------------------------------------------------------------------
@@ -12,11 +12,14 @@
 
 #include <stdexcept>
 #include <ostream>
+#include <utility>
 #include "sequence.h"
+#include "nodepool.h"
 
 
-template<typename T>
-class LinkedSeq : public Sequence<T>
+// NodeAlloc supplies the list nodes (see nodepool.h)
+template<typename T, template<typename> class NodeAlloc = HeapAlloc>
+class LinkedSeq final : public Sequence<T>
 {
 public:
 
@@ -48,7 +51,9 @@ public:
   void clear() override;
   
   // Returns a reference to the element at the index in the
-  // sequence. Throws out_of_range if index is invalid.
+  // sequence. Throws out_of_range if index is invalid. Resumes from
+  // the last accessed position when index is at or after it, so
+  // sequential access is O(1) per element.
   T& operator[](int index) override;
 
   // Returns a constant address to the element at the index in the
@@ -59,6 +64,14 @@ public:
   // index. Throws out_of_range if the index is invalid.
   void insert(const T& elem, int index) override;
 
+  // Same as insert(const T&, int), but moves the element in
+  void insert(T&& elem, int index) override;
+
+  // Inserts an element constructed from args at the given index.
+  // Throws out_of_range if the index is invalid.
+  template<typename... Args>
+  void emplace(int index, Args&&... args);
+
   // Shrinks the sequence by removing the element at the index in the
   // sequence. Throws out_of_range if index is invalid.
   void erase(int index) override;
@@ -68,12 +81,17 @@ public:
   bool contains(const T& elem) const override;
 
   // Sorts the elements in the sequence in place using less than equal
-  // (<=) operator. Uses merge sort.
+  // (<=) operator. Uses natural merge sort.
   void sort(); 
 
   // Sorts the sequence in place using the merge sort algorithm.
   void merge_sort();
 
+  // Sorts the sequence in place using an iterative, bottom-up natural
+  // merge sort. Stable, and linear on already sorted (or reversed)
+  // input.
+  void natural_merge_sort();
+
   // Sorts the sequence in place using the quick sort algorithm. Uses
   // first element for pivot values.
   void quick_sort();
@@ -81,6 +99,9 @@ public:
   // Sorts the sequence in place using the quick sort algorithm. Uses
   // randomly selected indexes for pivot values.
   void quick_sort_random();
+
+  // Returns the node allocation counters
+  const AllocStats& alloc_stats() const;
   
 private:
 
@@ -99,8 +120,25 @@ private:
   // size of list
   int node_count = 0;
 
+  // last node reached by operator[] and its index (finger is null
+  // when it is not valid)
+  mutable Node* finger = nullptr;
+  mutable int finger_index = 0;
+
+  // allocator for the list nodes
+  NodeAlloc<Node> alloc;
+
+  // returns the node at a valid index, walking from the finger when
+  // the index is at or after it and from head otherwise
+  Node* node_at(int index) const;
+
+  // shared body of the insert overloads, forwarding elem into place
+  template<typename U>
+  void insert_value(U&& elem, int index);
+
   // sort function helpers
   Node* merge_sort(Node* left, int len);
+  Node* merge_runs(Node* left, Node* right);
   Node* quick_sort(Node* start, int len);
   Node* quick_sort_random(Node* start, int len);
 
@@ -110,8 +148,8 @@ private:
 };
 
 
-template<typename T>
-std::ostream& operator<<(std::ostream& stream, const LinkedSeq<T>& seq)
+template<typename T, template<typename> class NodeAlloc>
+std::ostream& operator<<(std::ostream& stream, const LinkedSeq<T,NodeAlloc>& seq)
 {
   int n = seq.size();
   for (int i = 0; i < n - 1; ++i) 
@@ -122,8 +160,8 @@ std::ostream& operator<<(std::ostream& stream, const LinkedSeq<T>& seq)
 }
 
 
-template<typename T>
-LinkedSeq<T>::LinkedSeq()
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>::LinkedSeq()
 {
 }
 
@@ -131,8 +169,8 @@ LinkedSeq<T>::LinkedSeq()
 Copy Constructor initializes object as a copy of
 rhs 
 */
-template<typename T>
-LinkedSeq<T>::LinkedSeq(const LinkedSeq<T>& rhs)
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>::LinkedSeq(const LinkedSeq<T,NodeAlloc>& rhs)
 {
   *this = rhs;
 }
@@ -141,8 +179,8 @@ LinkedSeq<T>::LinkedSeq(const LinkedSeq<T>& rhs)
 Move Constructor moves object from rhs
 into lhs
 */
-template<typename T>
-LinkedSeq<T>::LinkedSeq(LinkedSeq<T>&& rhs)
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>::LinkedSeq(LinkedSeq<T,NodeAlloc>&& rhs)
 {
   *this = std::move(rhs);
 }
@@ -151,8 +189,8 @@ LinkedSeq<T>::LinkedSeq(LinkedSeq<T>&& rhs)
 Copy Assignment Operator sets object as a copy of
 rhs 
 */
-template<typename T>
-LinkedSeq<T>& LinkedSeq<T>::operator=(const LinkedSeq<T>& rhs)
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>& LinkedSeq<T,NodeAlloc>::operator=(const LinkedSeq<T,NodeAlloc>& rhs)
 {
   if(this != &rhs)
   {
@@ -164,35 +202,37 @@ LinkedSeq<T>& LinkedSeq<T>::operator=(const LinkedSeq<T>& rhs)
       temp = temp -> next;
     }
   }
-
+  return *this;
 }
 
 /*
 Move Assignment Operator moves object from rhs
 into lhs
 */
-template<typename T>
-LinkedSeq<T>& LinkedSeq<T>::operator=(LinkedSeq<T>&& rhs)
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>& LinkedSeq<T,NodeAlloc>::operator=(LinkedSeq<T,NodeAlloc>&& rhs)
 {
   if(this != &rhs)
   {
     clear();
     head = rhs.head;
     tail = rhs.tail;
+    alloc.swap(rhs.alloc);
     rhs.head = nullptr;
     rhs.tail = nullptr;
     node_count = rhs.node_count;
     rhs.node_count = 0;
-    return *this;
+    finger = nullptr;
+    rhs.finger = nullptr;
   }
-
+  return *this;
 }
 
 /*
 Destructor destroys object by calling clear
 */
-template<typename T>
-LinkedSeq<T>::~LinkedSeq()
+template<typename T, template<typename> class NodeAlloc>
+LinkedSeq<T,NodeAlloc>::~LinkedSeq()
 {
   clear();
 }
@@ -200,8 +240,8 @@ LinkedSeq<T>::~LinkedSeq()
 /*
 Returns true if the Linked List is empty
 */
-template<typename T>
-bool LinkedSeq<T>::empty() const
+template<typename T, template<typename> class NodeAlloc>
+bool LinkedSeq<T,NodeAlloc>::empty() const
 {
   return size() == 0;
 }
@@ -210,82 +250,49 @@ bool LinkedSeq<T>::empty() const
 clears all elements of the linked list from
 head to tail
 */
-template<typename T>
-void LinkedSeq<T>::clear()
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::clear()
 {
-  while(!empty())
+  // a pool can drop all of its nodes at once
+  if(!NodeAlloc<Node>::bulk_release)
   {
-    erase(0);
+    while(head != nullptr)
+    {
+      Node* temp = head;
+      head = head -> next;
+      alloc.destroy(temp);
+    }
   }
+  alloc.release_all();
+  head = nullptr;
+  tail = nullptr;
+  node_count = 0;
+  finger = nullptr;
 }
 
 // Returns a reference to the element at the index in the
 // sequence. Throws out_of_range if index is invalid.
-template<typename T>
-T& LinkedSeq<T>::operator[](int index)
+template<typename T, template<typename> class NodeAlloc>
+T& LinkedSeq<T,NodeAlloc>::operator[](int index)
 {
   
   if(index < 0 || index >= size())
   {
     throw(std::out_of_range("LinkedSeq<T>::insert(const T&, int)"));
   }
-  else
-  {
-    if(index == 0)
-    { 
-      return (head -> value);
-    }
-    else if(index == size()-1)
-    {
-      return (tail -> value);
-    }
-    else
-    {
-      Node* node_ptr = head->next;
-      for(int i = 1; i < size(); i++)
-      {
-        if(i == index)
-        {
-          return (node_ptr -> value);
-        }
-        node_ptr = node_ptr -> next;
-      }
-    }
-  }
+  return node_at(index) -> value;
 }
 
 // Returns a constant address to the element at the index in the
 // sequence. Throws out_of_range if index is invalid.
-template<typename T>
-const T& LinkedSeq<T>::operator[](int index) const
+template<typename T, template<typename> class NodeAlloc>
+const T& LinkedSeq<T,NodeAlloc>::operator[](int index) const
 {
   if(index < 0 || index >= size())
   {
     throw(std::out_of_range("LinkedSeq<T>::insert(const T&, int)"));
   }
-  else
-  {
-    if(index == 0)
-    { 
-      return (head -> value);
-    }
-    else if(index == size()-1)
-    {
-      return (tail -> value);
-    }
-    else
-    {
-      Node* node_ptr = head->next;
-      for(int i = 1; i < size(); i++)
-      {
-        if(i == index)
-        {
-          return (node_ptr -> value);
-        }
-        node_ptr = node_ptr -> next;
-      }
-    }
-  }
+  return node_at(index) -> value;
 }
 
 
@@ -293,8 +300,33 @@ const T& LinkedSeq<T>::operator[](int index) const
 Inserts an element at a specific index including after the
 last element
 */
-template<typename T>
-void LinkedSeq<T>::insert(const T& elem, int index)
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::insert(const T& elem, int index)
+{
+  insert_value(elem, index);
+}
+
+// Same as above, but moves the element in
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::insert(T&& elem, int index)
+{
+  insert_value(std::move(elem), index);
+}
+
+// Inserts an element constructed from args at the given index
+template<typename T, template<typename> class NodeAlloc>
+template<typename... Args>
+void LinkedSeq<T,NodeAlloc>::emplace(int index, Args&&... args)
+{
+  insert_value(T(std::forward<Args>(args)...), index);
+}
+
+/*
+Shared insert body, forwarding elem into the new node
+*/
+template<typename T, template<typename> class NodeAlloc>
+template<typename U>
+void LinkedSeq<T,NodeAlloc>::insert_value(U&& elem, int index)
 {
   if(index < 0 || index > size())
   {
@@ -302,8 +334,13 @@ void LinkedSeq<T>::insert(const T& elem, int index)
   }
   else
   {
-    Node* node1 = new Node;
-    node1 -> value = elem;
+    // an insert at or before the finger shifts it, so drop it
+    if(index <= finger_index)
+    {
+      finger = nullptr;
+    }
+    Node* node1 = alloc.make();
+    node1 -> value = std::forward<U>(elem);
     if(index == 0)
     {
       
@@ -331,21 +368,10 @@ void LinkedSeq<T>::insert(const T& elem, int index)
     else
     {
       
-      if(size() > 1)
-      {
-        Node* temp = head;
-        for(int i = 1; i <= index; i++)
-        {
-            if(i == index)
-            {
-              node1 -> next = temp -> next;
-              temp -> next = node1;
-              
-            }
-            temp = temp -> next;
-        }
-        
-      }
+      // the predecessor comes from the finger, which stays valid
+      Node* temp = node_at(index - 1);
+      node1 -> next = temp -> next;
+      temp -> next = node1;
     }
     
     
@@ -360,8 +386,8 @@ void LinkedSeq<T>::insert(const T& elem, int index)
 /*
 Erases a target node from the linked list
 */
-template<typename T>
-void LinkedSeq<T>::erase(int index)
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::erase(int index)
 {
   if(index < 0 || index >= size())
   {
@@ -369,6 +395,10 @@ void LinkedSeq<T>::erase(int index)
   }
   else
   {
+    if(index <= finger_index)
+    {
+      finger = nullptr;
+    }
     Node* temp = head;
     Node* temp2;
     if(index == 0)
@@ -377,45 +407,27 @@ void LinkedSeq<T>::erase(int index)
       {
         temp = head;
         head = head -> next;
-        delete temp;
+        alloc.destroy(temp);
       }
       else if(head -> next == nullptr)
       {
         temp = head;
         head = nullptr;
         tail = nullptr;
-        delete temp;
+        alloc.destroy(temp);
       }
     }
     else
     {
       
-      if(size() > 1)
+      // the predecessor comes from the finger, which stays valid
+      temp = node_at(index - 1);
+      temp2 = temp -> next;
+      temp -> next = temp2 -> next;
+      alloc.destroy(temp2);
+      if(temp -> next == nullptr)
       {
-        for(int i = 1; i < size(); i++)
-        {
-          
-          
-          if(i == index)
-          {
-            temp2 = temp -> next;
-            temp -> next = temp2 -> next;
-            delete temp2;
-            //break;
-            if(temp->next == nullptr)
-            {
-              tail = temp;
-            }
-            
-            node_count--;
-            return;
-            //break;
-          }
-          
-          temp = temp -> next;
-          
-        }
-        delete temp;
+        tail = temp;
       }
     }
     node_count--;
@@ -427,8 +439,8 @@ void LinkedSeq<T>::erase(int index)
 /*
 checks if an element is contained in the linked list
 */
-template<typename T>
-bool LinkedSeq<T>::contains(const T& elem) const
+template<typename T, template<typename> class NodeAlloc>
+bool LinkedSeq<T,NodeAlloc>::contains(const T& elem) const
 {
   if(head != nullptr)
   {
@@ -467,23 +479,24 @@ bool LinkedSeq<T>::contains(const T& elem) const
 returns the size of the linked sequence
 */
 
-template<typename T>
-int LinkedSeq<T>::size() const
+template<typename T, template<typename> class NodeAlloc>
+int LinkedSeq<T,NodeAlloc>::size() const
 {
   return node_count;
 }
 
-//defaults sort() to merge sort
-template<typename T>
-void LinkedSeq<T>::sort()
+//defaults sort() to natural merge sort
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::sort()
 {
-  merge_sort();
+  natural_merge_sort();
 }
 
 //calls merge sort
-template<typename T>
-void LinkedSeq<T>::merge_sort()
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::merge_sort()
 {
+  finger = nullptr;
   if(head != nullptr)
   {
     head = merge_sort(head, size());
@@ -498,10 +511,77 @@ void LinkedSeq<T>::merge_sort()
   }
 }
 
+// cuts the list into runs (strictly descending runs are reversed in
+// place) and merges them like a binary counter: bins[k] holds the
+// merge of 2^k runs, so no midpoint walks, recursion, or allocation
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::natural_merge_sort()
+{
+  finger = nullptr;
+  if(head == nullptr)
+  {
+    return;
+  }
+  Node* bins[32] = {};
+  Node* rest = head;
+  while(rest != nullptr)
+  {
+    Node* run = rest;
+    rest = rest -> next;
+    run -> next = nullptr;
+    if(rest != nullptr && rest -> value < run -> value)
+    {
+      while(rest != nullptr && rest -> value < run -> value)
+      {
+        Node* next = rest -> next;
+        rest -> next = run;
+        run = rest;
+        rest = next;
+      }
+    }
+    else
+    {
+      Node* last = run;
+      while(rest != nullptr && !(rest -> value < last -> value))
+      {
+        last -> next = rest;
+        last = rest;
+        rest = rest -> next;
+      }
+      last -> next = nullptr;
+    }
+    // older (earlier) runs stay on the left to keep the sort stable
+    int k = 0;
+    while(bins[k] != nullptr)
+    {
+      run = merge_runs(bins[k], run);
+      bins[k] = nullptr;
+      k++;
+    }
+    bins[k] = run;
+  }
+  Node* sorted = nullptr;
+  for(int k = 0; k < 32; k++)
+  {
+    if(bins[k] != nullptr)
+    {
+      sorted = sorted == nullptr ? bins[k] : merge_runs(bins[k], sorted);
+    }
+  }
+  head = sorted;
+  Node* temp = head;
+  while(temp -> next != nullptr)
+  {
+    temp = temp -> next;
+  }
+  tail = temp;
+}
+
 //calls quick sort
-template<typename T>
-void LinkedSeq<T>::quick_sort()
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::quick_sort()
 {
+  finger = nullptr;
   if(head != nullptr)
   {
     head = quick_sort(head, size());
@@ -515,9 +595,10 @@ void LinkedSeq<T>::quick_sort()
 }
 
 
-template<typename T>
-void LinkedSeq<T>::quick_sort_random()
+template<typename T, template<typename> class NodeAlloc>
+void LinkedSeq<T,NodeAlloc>::quick_sort_random()
 {
+  finger = nullptr;
   // seed the pseudo-random number generator
   std::srand(seed);
   if(head != nullptr)
@@ -533,8 +614,38 @@ void LinkedSeq<T>::quick_sort_random()
 }
 
 
-template<typename T>
-typename LinkedSeq<T>::Node* LinkedSeq<T>::merge_sort(Node* left, int len)
+// returns the node allocation counters
+template<typename T, template<typename> class NodeAlloc>
+const AllocStats& LinkedSeq<T,NodeAlloc>::alloc_stats() const
+{
+  return alloc.stats();
+}
+
+
+// the tail is returned directly and leaves the finger in place
+template<typename T, template<typename> class NodeAlloc>
+typename LinkedSeq<T,NodeAlloc>::Node* LinkedSeq<T,NodeAlloc>::node_at(int index) const
+{
+  if(index == node_count - 1)
+  {
+    return tail;
+  }
+  if(finger == nullptr || index < finger_index)
+  {
+    finger = head;
+    finger_index = 0;
+  }
+  while(finger_index < index)
+  {
+    finger = finger -> next;
+    finger_index++;
+  }
+  return finger;
+}
+
+
+template<typename T, template<typename> class NodeAlloc>
+typename LinkedSeq<T,NodeAlloc>::Node* LinkedSeq<T,NodeAlloc>::merge_sort(Node* left, int len)
 {
   if(len <= 1)
   {
@@ -626,9 +737,35 @@ typename LinkedSeq<T>::Node* LinkedSeq<T>::merge_sort(Node* left, int len)
   return tmp_head;
 }
 
+// splices two sorted, null-terminated lists into one, taking from
+// left on ties
+template<typename T, template<typename> class NodeAlloc>
+typename LinkedSeq<T,NodeAlloc>::Node* LinkedSeq<T,NodeAlloc>::merge_runs(Node* left, Node* right)
+{
+  Node* merged = nullptr;
+  Node** link = &merged;
+  while(left != nullptr && right != nullptr)
+  {
+    if(right -> value < left -> value)
+    {
+      *link = right;
+      link = &right -> next;
+      right = right -> next;
+    }
+    else
+    {
+      *link = left;
+      link = &left -> next;
+      left = left -> next;
+    }
+  }
+  *link = left != nullptr ? left : right;
+  return merged;
+}
+
 //quick sort with pivot as start
-template<typename T>
-typename LinkedSeq<T>::Node* LinkedSeq<T>::quick_sort(Node* start, int len)
+template<typename T, template<typename> class NodeAlloc>
+typename LinkedSeq<T,NodeAlloc>::Node* LinkedSeq<T,NodeAlloc>::quick_sort(Node* start, int len)
 {
   if(len <= 1)
   {
@@ -707,8 +844,8 @@ typename LinkedSeq<T>::Node* LinkedSeq<T>::quick_sort(Node* start, int len)
 
 
 //quick sort with random pivot
-template<typename T>
-typename LinkedSeq<T>::Node* LinkedSeq<T>::quick_sort_random(Node* start, int len)
+template<typename T, template<typename> class NodeAlloc>
+typename LinkedSeq<T,NodeAlloc>::Node* LinkedSeq<T,NodeAlloc>::quick_sort_random(Node* start, int len)
 {
 
   if(len <= 1)
@@ -779,8 +916,8 @@ typename LinkedSeq<T>::Node* LinkedSeq<T>::quick_sort_random(Node* start, int le
       larger -> next = nullptr;
     }
   }
-  smaller_head = quick_sort(smaller_head, smaller_count);
-  larger_head = quick_sort(larger_head, larger_count);
+  smaller_head = quick_sort_random(smaller_head, smaller_count);
+  larger_head = quick_sort_random(larger_head, larger_count);
 
   Node* current = nullptr;
 
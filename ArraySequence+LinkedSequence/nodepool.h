@@ -0,0 +1,235 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: nodepool.h
+// DATE: Spring 2022
+// DESC: node allocators for the linked containers. HeapAlloc gets
+//       each node from new/delete; PoolAlloc carves nodes out of large
+//       slabs, reuses freed nodes through a free list, and can drop
+//       every node at once by freeing its slabs.
+//---------------------------------------------------------------------------
+
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+
+// allocation counters kept by each allocator
+struct AllocStats
+{
+  // number of nodes handed out
+  long nodes = 0;
+
+  // number of calls made to the system allocator
+  long system = 0;
+};
+
+
+template<typename T>
+class HeapAlloc
+{
+public:
+
+  // true if release_all() frees live nodes without visiting them
+  static const bool bulk_release = false;
+
+  HeapAlloc() = default;
+  HeapAlloc(const HeapAlloc& rhs) = delete;
+  HeapAlloc& operator=(const HeapAlloc& rhs) = delete;
+
+  // Returns a new value-initialized node
+  T* make();
+
+  // Frees a node returned by make()
+  void destroy(T* node);
+
+  // Nothing to do, nodes are freed one at a time by destroy()
+  void release_all();
+
+  // Exchanges the nodes (and counters) of two allocators
+  void swap(HeapAlloc& rhs);
+
+  // Returns the allocation counters
+  const AllocStats& stats() const;
+
+private:
+
+  AllocStats counts;
+
+};
+
+
+template<typename T>
+class PoolAlloc
+{
+public:
+
+  // true if release_all() frees live nodes without visiting them,
+  // which is only safe when nodes need no destructor call
+  static const bool bulk_release = std::is_trivially_destructible<T>::value;
+
+  PoolAlloc() = default;
+  PoolAlloc(const PoolAlloc& rhs) = delete;
+  PoolAlloc& operator=(const PoolAlloc& rhs) = delete;
+
+  // frees every slab
+  ~PoolAlloc();
+
+  // Returns a new value-initialized node, reusing a freed node if
+  // there is one and otherwise taking the next slot of the newest slab
+  T* make();
+
+  // Destroys a node returned by make() and puts it on the free list
+  void destroy(T* node);
+
+  // Frees every slab in O(#slabs). Any node still live is dropped
+  // without its destructor being run.
+  void release_all();
+
+  // Exchanges the nodes (and counters) of two allocators
+  void swap(PoolAlloc& rhs);
+
+  // Returns the allocation counters
+  const AllocStats& stats() const;
+
+private:
+
+  // a free slot holds the free-list link in place of a node
+  union Slot {
+    Slot* next;
+    alignas(T) unsigned char node[sizeof(T)];
+  };
+
+  // slots per slab (about 64KB of nodes, but at least 32)
+  static const int SLAB_SLOTS =
+    sizeof(Slot) * 32 > 65536 ? 32 : 65536 / sizeof(Slot);
+
+  // slabs are linked newest first
+  struct Slab {
+    Slab* next;
+    Slot slots[SLAB_SLOTS];
+  };
+
+  Slab* slabs = nullptr;
+
+  // number of slots handed out from the newest slab
+  int slab_used = SLAB_SLOTS;
+
+  Slot* free_list = nullptr;
+
+  AllocStats counts;
+
+};
+
+
+//----------------------------------------------------------------------
+// HeapAlloc
+//----------------------------------------------------------------------
+
+template<typename T>
+T* HeapAlloc<T>::make()
+{
+  counts.nodes++;
+  counts.system++;
+  return new T();
+}
+
+template<typename T>
+void HeapAlloc<T>::destroy(T* node)
+{
+  delete node;
+}
+
+template<typename T>
+void HeapAlloc<T>::release_all()
+{
+}
+
+template<typename T>
+void HeapAlloc<T>::swap(HeapAlloc& rhs)
+{
+  std::swap(counts, rhs.counts);
+}
+
+template<typename T>
+const AllocStats& HeapAlloc<T>::stats() const
+{
+  return counts;
+}
+
+
+//----------------------------------------------------------------------
+// PoolAlloc
+//----------------------------------------------------------------------
+
+template<typename T>
+PoolAlloc<T>::~PoolAlloc()
+{
+  release_all();
+}
+
+template<typename T>
+T* PoolAlloc<T>::make()
+{
+  Slot* slot = free_list;
+  if(slot != nullptr)
+  {
+    free_list = slot -> next;
+  }
+  else
+  {
+    if(slab_used == SLAB_SLOTS)
+    {
+      Slab* slab = new Slab;
+      slab -> next = slabs;
+      slabs = slab;
+      slab_used = 0;
+      counts.system++;
+    }
+    slot = &slabs -> slots[slab_used++];
+  }
+  counts.nodes++;
+  return new (slot -> node) T();
+}
+
+template<typename T>
+void PoolAlloc<T>::destroy(T* node)
+{
+  node -> ~T();
+  Slot* slot = reinterpret_cast<Slot*>(node);
+  slot -> next = free_list;
+  free_list = slot;
+}
+
+template<typename T>
+void PoolAlloc<T>::release_all()
+{
+  while(slabs != nullptr)
+  {
+    Slab* next = slabs -> next;
+    delete slabs;
+    slabs = next;
+  }
+  slab_used = SLAB_SLOTS;
+  free_list = nullptr;
+}
+
+template<typename T>
+void PoolAlloc<T>::swap(PoolAlloc& rhs)
+{
+  std::swap(slabs, rhs.slabs);
+  std::swap(slab_used, rhs.slab_used);
+  std::swap(free_list, rhs.free_list);
+  std::swap(counts, rhs.counts);
+}
+
+template<typename T>
+const AllocStats& PoolAlloc<T>::stats() const
+{
+  return counts;
+}
+
+
+#endif
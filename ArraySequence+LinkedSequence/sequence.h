@@ -11,6 +11,9 @@
 #define SEQUENCE_H
 
 
+// The concrete sequences are final, so code that holds one by its own
+// type (such as the templates in util.h) calls its members directly,
+// while code holding a Sequence<T>& goes through the vtable.
 template<typename T>
 class Sequence
 {
@@ -43,6 +46,10 @@ public:
   // greater than size()).
   virtual void insert(const T& elem, int index) = 0;
 
+  // Same as insert(const T&, int), but moves the element into the
+  // sequence instead of copying it.
+  virtual void insert(T&& elem, int index) = 0;
+
   // Shrinks the sequence by removing the element at the index in the
   // sequence. Throws out_of_range if index is invalid.
   virtual void erase(int index) = 0;
@@ -0,0 +1,191 @@
+//----------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: taskpool.h
+// DATE: Spring 2022
+// DESC: A small work-stealing thread pool for fork-join parallelism.
+//       Each thread keeps its own deque of tasks: it pushes and pops
+//       at the back, and idle threads steal from the front of another
+//       thread's deque, which holds its oldest (largest) tasks.
+//----------------------------------------------------------------------
+
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class TaskPool
+{
+public:
+
+  // Starts threads - 1 worker threads. The thread creating the pool
+  // acts as the last worker while it waits in fork_join.
+  TaskPool(int threads);
+
+  // Stops and joins the workers
+  ~TaskPool();
+
+  TaskPool(const TaskPool& rhs) = delete;
+  TaskPool& operator=(const TaskPool& rhs) = delete;
+
+  // Returns the number of threads (including the creating thread)
+  int size() const;
+
+  // Runs f and g, possibly in parallel, returning once both have
+  // finished. Must be called by the thread that created the pool or
+  // from within another fork_join task.
+  template<typename F, typename G>
+  void fork_join(const F& f, const G& g);
+
+private:
+
+  // a forked task lives in its fork_join's stack frame
+  struct Task {
+    std::function<void()> fn;
+    std::atomic<bool> done{false};
+  };
+
+  // per-thread task deque
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task*> tasks;
+  };
+
+  int thread_count;
+  std::unique_ptr<Queue[]> queues;
+  std::vector<std::thread> workers;
+  std::atomic<bool> stop{false};
+
+  // the deque owned by the current thread
+  static inline thread_local int current = 0;
+
+  // push a task onto (or pop the given task off) the back of a deque
+  void push(int q, Task* task);
+  bool take_back(int q, Task* task);
+
+  // pop from the back of our deque, else steal from the front of
+  // another; runs the task and returns true if one was found
+  bool run_one(int q);
+
+  // worker loop
+  void work(int q);
+
+};
+
+
+inline TaskPool::TaskPool(int threads)
+  : thread_count(threads < 1 ? 1 : threads),
+    queues(new Queue[threads < 1 ? 1 : threads])
+{
+  current = 0;
+  for(int i = 1; i < thread_count; i++)
+  {
+    workers.emplace_back(&TaskPool::work, this, i);
+  }
+}
+
+inline TaskPool::~TaskPool()
+{
+  stop = true;
+  for(std::thread& t : workers)
+  {
+    t.join();
+  }
+}
+
+inline int TaskPool::size() const
+{
+  return thread_count;
+}
+
+template<typename F, typename G>
+void TaskPool::fork_join(const F& f, const G& g)
+{
+  int q = current;
+  Task task;
+  task.fn = g;
+  push(q, &task);
+  f();
+  // nested fork_joins in f have been joined, so g is at the back of
+  // our deque unless another thread stole it
+  if(take_back(q, &task))
+  {
+    g();
+    return;
+  }
+  while(!task.done.load(std::memory_order_acquire))
+  {
+    if(!run_one(q))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+inline void TaskPool::push(int q, Task* task)
+{
+  std::lock_guard<std::mutex> guard(queues[q].lock);
+  queues[q].tasks.push_back(task);
+}
+
+inline bool TaskPool::take_back(int q, Task* task)
+{
+  std::lock_guard<std::mutex> guard(queues[q].lock);
+  if(!queues[q].tasks.empty() && queues[q].tasks.back() == task)
+  {
+    queues[q].tasks.pop_back();
+    return true;
+  }
+  return false;
+}
+
+inline bool TaskPool::run_one(int q)
+{
+  Task* task = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(queues[q].lock);
+    if(!queues[q].tasks.empty())
+    {
+      task = queues[q].tasks.back();
+      queues[q].tasks.pop_back();
+    }
+  }
+  for(int i = 1; task == nullptr && i < thread_count; i++)
+  {
+    Queue& victim = queues[(q + i) % thread_count];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if(!victim.tasks.empty())
+    {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+    }
+  }
+  if(task == nullptr)
+  {
+    return false;
+  }
+  task -> fn();
+  task -> done.store(true, std::memory_order_release);
+  return true;
+}
+
+inline void TaskPool::work(int q)
+{
+  current = q;
+  while(!stop.load())
+  {
+    if(!run_one(q))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+
+#endif
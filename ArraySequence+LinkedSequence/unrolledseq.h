@@ -0,0 +1,548 @@
+//----------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: unrolledseq.h
+// DATE: Spring 2022
+// DESC: An unrolled linked sequence. Each node holds a chunk of up to
+//       ChunkBytes of elements, so walking the list takes one pointer
+//       hop (and cache miss) per chunk rather than per element. Full
+//       chunks split in half on insert, and nearly empty chunks merge
+//       into a neighbor on erase.
+//----------------------------------------------------------------------
+
+
+#ifndef UNROLLEDSEQ_H
+#define UNROLLEDSEQ_H
+
+#include <stdexcept>
+#include <ostream>
+#include <algorithm>
+#include <utility>
+#include "sequence.h"
+#include "nodepool.h"
+
+
+// ChunkBytes sets the element storage per node (at least two
+// elements); NodeAlloc supplies the nodes (see nodepool.h)
+template<typename T, int ChunkBytes = 256,
+         template<typename> class NodeAlloc = HeapAlloc>
+class UnrolledSeq final : public Sequence<T>
+{
+public:
+
+  // Default constructor
+  UnrolledSeq();
+
+  // Copy constructor
+  UnrolledSeq(const UnrolledSeq& rhs);
+
+  // Move constructor
+  UnrolledSeq(UnrolledSeq&& rhs);
+
+  // Copy assignment operator
+  UnrolledSeq& operator=(const UnrolledSeq& rhs);
+
+  // Move assignment operator
+  UnrolledSeq& operator=(UnrolledSeq&& rhs);
+
+  // Destructor
+  ~UnrolledSeq();
+
+  // Returns the number of elements in the sequence
+  int size() const override;
+
+  // Tests if the sequence is empty
+  bool empty() const override;
+
+  // Removes all of the elements from the sequence
+  void clear() override;
+
+  // Returns a reference to the element at the index in the
+  // sequence. Throws out_of_range if index is invalid.
+  T& operator[](int index) override;
+
+  // Returns a constant address to the element at the index in the
+  // sequence. Throws out_of_range if index is invalid.
+  const T& operator[](int index) const override;
+
+  // Extends the sequence by inserting the element at the given
+  // index. Throws out_of_range if the index is invalid.
+  void insert(const T& elem, int index) override;
+
+  // Same as insert(const T&, int), but moves the element in
+  void insert(T&& elem, int index) override;
+
+  // Inserts an element constructed from args at the given index.
+  // Throws out_of_range if the index is invalid.
+  template<typename... Args>
+  void emplace(int index, Args&&... args);
+
+  // Shrinks the sequence by removing the element at the index in the
+  // sequence. Throws out_of_range if index is invalid.
+  void erase(int index) override;
+
+  // Returns true if the element is in the sequence, and false
+  // otherwise.
+  bool contains(const T& elem) const override;
+
+  // Sorts the elements in the sequence in place using less than (<)
+  void sort() override;
+
+  // Returns the number of elements a chunk holds
+  static int chunk_capacity();
+
+  // Returns the number of chunks in the list
+  int chunk_count() const;
+
+  // Returns the node allocation counters
+  const AllocStats& alloc_stats() const;
+
+private:
+
+  // elements per chunk
+  static const int CAPACITY =
+    ChunkBytes / (int) sizeof(T) < 2 ? 2 : ChunkBytes / (int) sizeof(T);
+
+  // a chunk of elements, linked both ways so erase can merge into
+  // either neighbor
+  struct Node {
+    T values[CAPACITY];
+    int count = 0;
+    Node* next = nullptr;
+    Node* prev = nullptr;
+  };
+
+  Node* head = nullptr;
+  Node* tail = nullptr;
+
+  // number of elements
+  int count = 0;
+
+  // number of chunks
+  int chunks = 0;
+
+  // allocator for the chunks
+  NodeAlloc<Node> alloc;
+
+  // returns the chunk holding the element at index (which must be
+  // valid), leaving index as the offset within that chunk
+  Node* find(int& index) const;
+
+  // links node in after before (or at the front if before is null)
+  void link_after(Node* before, Node* node);
+
+  // unlinks and frees a chunk
+  void unlink(Node* node);
+
+  // moves the upper half of a chunk into a new chunk after it
+  void split(Node* node);
+
+  // appends the elements of node's successor to node and frees the
+  // successor
+  void merge_next(Node* node);
+
+  // shared body of the insert overloads, forwarding elem into place
+  template<typename U>
+  void insert_value(U&& elem, int index);
+
+};
+
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+std::ostream& operator<<(std::ostream& stream,
+                         const UnrolledSeq<T,ChunkBytes,NodeAlloc>& seq)
+{
+  int n = seq.size();
+  for (int i = 0; i < n - 1; ++i)
+    stream << seq[i] << ", ";
+  if (n > 0)
+    stream << seq[n - 1];
+  return stream;
+}
+
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::UnrolledSeq()
+{
+}
+
+// copy constructor
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::UnrolledSeq(const UnrolledSeq& rhs)
+{
+  *this = rhs;
+}
+
+// move constructor
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::UnrolledSeq(UnrolledSeq&& rhs)
+{
+  *this = std::move(rhs);
+}
+
+// copy assignment, appending keeps the copy's chunks full
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>&
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::operator=(const UnrolledSeq& rhs)
+{
+  if(this != &rhs)
+  {
+    clear();
+    for(Node* node = rhs.head; node != nullptr; node = node -> next)
+    {
+      for(int i = 0; i < node -> count; i++)
+      {
+        insert(node -> values[i], count);
+      }
+    }
+  }
+  return *this;
+}
+
+// move assignment
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>&
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::operator=(UnrolledSeq&& rhs)
+{
+  if(this != &rhs)
+  {
+    clear();
+    head = rhs.head;
+    tail = rhs.tail;
+    count = rhs.count;
+    chunks = rhs.chunks;
+    alloc.swap(rhs.alloc);
+    rhs.head = nullptr;
+    rhs.tail = nullptr;
+    rhs.count = 0;
+    rhs.chunks = 0;
+  }
+  return *this;
+}
+
+// destructor
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::~UnrolledSeq()
+{
+  clear();
+}
+
+// returns the number of elements
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+int UnrolledSeq<T,ChunkBytes,NodeAlloc>::size() const
+{
+  return count;
+}
+
+// true if there are no elements
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+bool UnrolledSeq<T,ChunkBytes,NodeAlloc>::empty() const
+{
+  return count == 0;
+}
+
+// frees every chunk
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::clear()
+{
+  // a pool can drop all of its chunks at once
+  if(!NodeAlloc<Node>::bulk_release)
+  {
+    while(head != nullptr)
+    {
+      Node* temp = head;
+      head = head -> next;
+      alloc.destroy(temp);
+    }
+  }
+  alloc.release_all();
+  head = nullptr;
+  tail = nullptr;
+  count = 0;
+  chunks = 0;
+}
+
+// element access, one hop per chunk
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+T& UnrolledSeq<T,ChunkBytes,NodeAlloc>::operator[](int index)
+{
+  if(index < 0 || index >= count)
+  {
+    throw std::out_of_range("UnrolledSeq<T>::operator[](int)");
+  }
+  Node* node = find(index);
+  return node -> values[index];
+}
+
+// const element access
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+const T& UnrolledSeq<T,ChunkBytes,NodeAlloc>::operator[](int index) const
+{
+  if(index < 0 || index >= count)
+  {
+    throw std::out_of_range("UnrolledSeq<T>::operator[](int) const");
+  }
+  Node* node = find(index);
+  return node -> values[index];
+}
+
+// appends go into the tail chunk (or a new one when it is full), any
+// other insert splits its chunk first if the chunk is full
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::insert(const T& elem, int index)
+{
+  insert_value(elem, index);
+}
+
+// Same as above, but moves the element in
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::insert(T&& elem, int index)
+{
+  insert_value(std::move(elem), index);
+}
+
+// Inserts an element constructed from args at the given index
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+template<typename... Args>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::emplace(int index, Args&&... args)
+{
+  insert_value(T(std::forward<Args>(args)...), index);
+}
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+template<typename U>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::insert_value(U&& elem, int index)
+{
+  if(index < 0 || index > count)
+  {
+    throw std::out_of_range("UnrolledSeq<T>::insert(const T&, int)");
+  }
+  Node* node = nullptr;
+  if(index == count)
+  {
+    if(tail == nullptr || tail -> count == CAPACITY)
+    {
+      link_after(tail, alloc.make());
+    }
+    node = tail;
+    index = tail -> count;
+  }
+  else
+  {
+    node = find(index);
+    if(node -> count == CAPACITY)
+    {
+      split(node);
+      if(index > node -> count)
+      {
+        index -= node -> count;
+        node = node -> next;
+      }
+    }
+  }
+  for(int i = node -> count; i > index; i--)
+  {
+    node -> values[i] = std::move(node -> values[i - 1]);
+  }
+  node -> values[index] = std::forward<U>(elem);
+  node -> count++;
+  count++;
+}
+
+// removes the element, then frees its chunk if empty or merges it
+// into a neighbor once it is down to a quarter full
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::erase(int index)
+{
+  if(index < 0 || index >= count)
+  {
+    throw std::out_of_range("UnrolledSeq<T>::erase(int)");
+  }
+  Node* node = find(index);
+  for(int i = index; i < node -> count - 1; i++)
+  {
+    node -> values[i] = std::move(node -> values[i + 1]);
+  }
+  node -> count--;
+  // release whatever the vacated slot still holds
+  node -> values[node -> count] = T();
+  count--;
+  if(node -> count == 0)
+  {
+    unlink(node);
+  }
+  else if(node -> count <= CAPACITY / 4)
+  {
+    if(node -> next != nullptr && node -> count + node -> next -> count <= CAPACITY)
+    {
+      merge_next(node);
+    }
+    else if(node -> prev != nullptr && node -> prev -> count + node -> count <= CAPACITY)
+    {
+      merge_next(node -> prev);
+    }
+  }
+}
+
+// scans each chunk's array in turn
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+bool UnrolledSeq<T,ChunkBytes,NodeAlloc>::contains(const T& elem) const
+{
+  for(Node* node = head; node != nullptr; node = node -> next)
+  {
+    for(int i = 0; i < node -> count; i++)
+    {
+      if(node -> values[i] == elem)
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// gathers the elements into one array, sorts it, and writes them back
+// into the same chunk slots
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::sort()
+{
+  if(count < 2)
+  {
+    return;
+  }
+  T* buffer = new T[count];
+  int k = 0;
+  for(Node* node = head; node != nullptr; node = node -> next)
+  {
+    for(int i = 0; i < node -> count; i++)
+    {
+      buffer[k++] = std::move(node -> values[i]);
+    }
+  }
+  std::sort(buffer, buffer + count);
+  k = 0;
+  for(Node* node = head; node != nullptr; node = node -> next)
+  {
+    for(int i = 0; i < node -> count; i++)
+    {
+      node -> values[i] = std::move(buffer[k++]);
+    }
+  }
+  delete[] buffer;
+}
+
+// elements per chunk
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+int UnrolledSeq<T,ChunkBytes,NodeAlloc>::chunk_capacity()
+{
+  return CAPACITY;
+}
+
+// number of chunks
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+int UnrolledSeq<T,ChunkBytes,NodeAlloc>::chunk_count() const
+{
+  return chunks;
+}
+
+// returns the node allocation counters
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+const AllocStats& UnrolledSeq<T,ChunkBytes,NodeAlloc>::alloc_stats() const
+{
+  return alloc.stats();
+}
+
+// the tail is checked first so appends and back access stay O(1)
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+typename UnrolledSeq<T,ChunkBytes,NodeAlloc>::Node*
+UnrolledSeq<T,ChunkBytes,NodeAlloc>::find(int& index) const
+{
+  if(index >= count - tail -> count)
+  {
+    index -= count - tail -> count;
+    return tail;
+  }
+  Node* node = head;
+  while(index >= node -> count)
+  {
+    index -= node -> count;
+    node = node -> next;
+  }
+  return node;
+}
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::link_after(Node* before, Node* node)
+{
+  node -> prev = before;
+  node -> next = before == nullptr ? head : before -> next;
+  if(node -> next != nullptr)
+  {
+    node -> next -> prev = node;
+  }
+  else
+  {
+    tail = node;
+  }
+  if(before != nullptr)
+  {
+    before -> next = node;
+  }
+  else
+  {
+    head = node;
+  }
+  chunks++;
+}
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::unlink(Node* node)
+{
+  if(node -> prev != nullptr)
+  {
+    node -> prev -> next = node -> next;
+  }
+  else
+  {
+    head = node -> next;
+  }
+  if(node -> next != nullptr)
+  {
+    node -> next -> prev = node -> prev;
+  }
+  else
+  {
+    tail = node -> prev;
+  }
+  alloc.destroy(node);
+  chunks--;
+}
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::split(Node* node)
+{
+  Node* upper = alloc.make();
+  int half = node -> count / 2;
+  for(int i = half; i < node -> count; i++)
+  {
+    upper -> values[i - half] = std::move(node -> values[i]);
+    node -> values[i] = T();
+  }
+  upper -> count = node -> count - half;
+  node -> count = half;
+  link_after(node, upper);
+}
+
+template<typename T, int ChunkBytes, template<typename> class NodeAlloc>
+void UnrolledSeq<T,ChunkBytes,NodeAlloc>::merge_next(Node* node)
+{
+  Node* next = node -> next;
+  for(int i = 0; i < next -> count; i++)
+  {
+    node -> values[node -> count + i] = std::move(next -> values[i]);
+  }
+  node -> count += next -> count;
+  unlink(next);
+}
+
+
+#endif
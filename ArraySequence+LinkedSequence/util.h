@@ -105,4 +105,98 @@ void reset_reversed(Sequence<int>& s);
 //----------------------------------------------------------------------
 void reset_shuffled(Sequence<int>& s, int shuffles);
 
+
+//----------------------------------------------------------------------
+// Statically dispatched versions of the helpers above. Given a final
+// sequence type such as ArraySeq<int>, overload resolution picks these
+// over the Sequence<int> versions, and operator[] and insert become
+// direct (inlinable) calls. The Sequence<int> versions in util.cpp
+// instantiate these with S = Sequence<int> for polymorphic callers.
+//----------------------------------------------------------------------
+template<typename S>
+void faro_shuffle(S& s, int shuffles);
+
+template<typename S>
+void load_shuffled(S& s, int n, int shuffles);
+
+template<typename S>
+void load_in_order(S& s, int n);
+
+template<typename S>
+void load_reverse_order(S& s, int n);
+
+template<typename S>
+void reset_ordered(S& s);
+
+template<typename S>
+void reset_reversed(S& s);
+
+template<typename S>
+void reset_shuffled(S& s, int shuffles);
+
+
+template<typename S>
+void faro_shuffle(S& seq, int shuffles)
+{
+  int n = seq.size();
+  int* tmp_array = new int[n];
+  bool out_shuffle = true;
+  
+  for (int s = 0; s < shuffles; ++s) {
+    for (int i = 0; i < n/2; ++i) {    
+      int j = n/2 + i;
+      int index = 2*i;
+      tmp_array[index] = out_shuffle ? seq[i] : seq[j];
+      tmp_array[index + 1] = out_shuffle ? seq[j] : seq[i];
+    }
+    for (int i = 0; i < n; ++i)
+      seq[i] = tmp_array[i];
+    out_shuffle = !out_shuffle;
+  }
+  delete [] tmp_array;
+}
+
+template<typename S>
+void load_shuffled(S& s, int n, int shuffles)
+{
+  load_in_order<S>(s, n);
+  faro_shuffle<S>(s, shuffles);
+}
+
+template<typename S>
+void load_in_order(S& s, int n)
+{
+  for (int i = 0; i < n; ++i)
+    s.insert(i+1, i);
+}
+
+template<typename S>
+void load_reverse_order(S& s, int n)
+{
+  for (int i = 0; i < n; ++i)
+    s.insert(n-i, i);
+}
+
+template<typename S>
+void reset_ordered(S& s)
+{
+  int n = s.size();
+  for (int i = 0; i < n; ++i)
+    s[i] = i + 1;
+}
+
+template<typename S>
+void reset_reversed(S& s)
+{
+  int n = s.size();
+  for (int i = 0; i < n; ++i)
+    s[i] = n - i;
+}
+
+template<typename S>
+void reset_shuffled(S& s, int shuffles)
+{
+  faro_shuffle<S>(s, shuffles);
+}
+
 #endif
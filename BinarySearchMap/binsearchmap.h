@@ -8,6 +8,11 @@
 #ifndef BINSEARCHMAP_H
 #define BINSEARCHMAP_H
 
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "map.h"
 #include "arrayseq.h"
 
@@ -64,6 +69,27 @@ public:
 
   // Removes all key-value pairs from the map.
   void clear();
+
+  // Adds the key-value pairs in one linear pass by sorting them and
+  // merging them into the collection from the back. Throws
+  // invalid_argument, without modifying the collection, if a key is
+  // already in the collection or appears twice in the batch.
+  void insert_batch(const ArraySeq<std::pair<K,V>>& pairs);
+
+  // Removes the key-value pairs with the given keys in one linear pass
+  // by sorting the keys and compacting the remaining pairs. A repeated
+  // key is removed once. Throws out_of_range, without modifying the
+  // collection, if a key is not in the collection.
+  void erase_batch(const ArraySeq<K>& keys);
+
+  // Turns the read-optimized layout on or off. When on, a copy of the
+  // keys is kept in Eytzinger (breadth-first tree) order and searched
+  // without branches, so the first levels of every search share a few
+  // cache lines. Each change to the map rebuilds the copy in O(n).
+  void read_optimized(bool on);
+
+  // Returns true if the read-optimized layout is on
+  bool read_optimized() const;
   
 
 private:
@@ -75,9 +101,36 @@ private:
   // the binary search algorithm. 
   bool bin_search(const K& key, int& index) const;
   
+  // bin_search for integral keys: finds the first key not less than
+  // the given key by halving the range without branches
+  bool branchless_search(const K& key, int& index) const;
+
+  // bin_search in the read-optimized layout: finds the first key not
+  // less than the given key
+  bool eytzinger_search(const K& key, int& index) const;
+
+  // rebuilds the read-optimized layout from seq (if it is on)
+  void update_layout();
+
+  // update_layout helper: fills the subtree at slot k in order,
+  // starting from seq index i, and returns the next seq index
+  int fill_layout(int k, int i);
+
   // implemented as a resizable array of (key-value) pairs
   ArraySeq<std::pair<K,V>> seq;
 
+  // a key of the read-optimized layout, next to its index in seq so
+  // that finding the key also finds the index
+  struct Slot {
+    K key;
+    int index;
+  };
+
+  // read-optimized layout: the keys in Eytzinger order in slots 1 to
+  // n (slot 0 is unused)
+  bool read_mode = false;
+  std::vector<Slot> layout;
+
 };
 
 // TODO: Implement the functions above. Be sure to read over the
@@ -155,6 +208,7 @@ void BinSearchMap<K,V>::insert(const K& key, const V& value)
       seq.insert(p, index);
     }
   }
+  update_layout();
 }
 
 // Shrinks the collection by removing the key-value pair with the
@@ -168,6 +222,7 @@ void BinSearchMap<K,V>::erase(const K& key)
   if(bin_search(key, index))
   {
     seq.erase(index);
+    update_layout();
   }
   else
   {
@@ -283,6 +338,100 @@ template<typename K, typename V>
 void BinSearchMap<K,V>::clear()
 {
   seq.clear();
+  update_layout();
+}
+
+// Adds the key-value pairs in one linear pass. The batch is sorted
+// through pointers to its pairs and checked, the sequence is grown by
+// the batch size, and then the two are merged from the back so each
+// existing pair moves at most once.
+template<typename K, typename V>
+void BinSearchMap<K,V>::insert_batch(const ArraySeq<std::pair<K,V>>& pairs)
+{
+  std::vector<const std::pair<K,V>*> batch;
+  batch.reserve(pairs.size());
+  for(int i = 0; i < pairs.size(); i++)
+  {
+    batch.push_back(&pairs[i]);
+  }
+  std::sort(batch.begin(), batch.end(),
+            [](const std::pair<K,V>* a, const std::pair<K,V>* b) {
+              return a -> first < b -> first;
+            });
+  int index = 0;
+  for(int j = 0; j < (int) batch.size(); j++)
+  {
+    if((j > 0 && !(batch[j - 1] -> first < batch[j] -> first)) ||
+       bin_search(batch[j] -> first, index))
+    {
+      throw(std::invalid_argument("BinSearchMap<K,V>::insert_batch(const ArraySeq<std::pair<K,V>>&)"));
+    }
+  }
+  int i = seq.size() - 1;
+  int j = batch.size() - 1;
+  for(int k = 0; k < (int) batch.size(); k++)
+  {
+    seq.insert(*batch[k], seq.size());
+  }
+  int last = seq.size() - 1;
+  while(j >= 0)
+  {
+    if(i >= 0 && batch[j] -> first < seq[i].first)
+    {
+      seq[last] = std::move(seq[i]);
+      i--;
+    }
+    else
+    {
+      seq[last] = *batch[j];
+      j--;
+    }
+    last--;
+  }
+  update_layout();
+}
+
+// Removes the key-value pairs with the given keys in one linear
+// pass. The sorted keys are walked alongside the sequence, and each
+// pair that is kept is moved down over the erased ones.
+template<typename K, typename V>
+void BinSearchMap<K,V>::erase_batch(const ArraySeq<K>& keys)
+{
+  std::vector<K> batch;
+  batch.reserve(keys.size());
+  int index = 0;
+  for(int i = 0; i < keys.size(); i++)
+  {
+    if(!bin_search(keys[i], index))
+    {
+      throw(std::out_of_range("BinSearchMap<K,V>::erase_batch(const ArraySeq<K>&)"));
+    }
+    batch.push_back(keys[i]);
+  }
+  std::sort(batch.begin(), batch.end());
+  int kept = 0;
+  int j = 0;
+  for(int i = 0; i < seq.size(); i++)
+  {
+    while(j < (int) batch.size() && batch[j] < seq[i].first)
+    {
+      j++;
+    }
+    if(j < (int) batch.size() && !(seq[i].first < batch[j]))
+    {
+      continue;
+    }
+    if(kept != i)
+    {
+      seq[kept] = std::move(seq[i]);
+    }
+    kept++;
+  }
+  while(seq.size() > kept)
+  {
+    seq.erase(seq.size() - 1);
+  }
+  update_layout();
 }
 
 // If the key is in the collection, bin_search returns true and
@@ -293,6 +442,18 @@ void BinSearchMap<K,V>::clear()
 template<typename K, typename V> 
 bool BinSearchMap<K,V>::bin_search(const K& key, int& index) const
 {
+  if(read_mode && seq.size() > 0)
+  {
+    return eytzinger_search(key, index);
+  }
+  if constexpr(std::is_integral<K>::value)
+  {
+    if(seq.size() > 0)
+    {
+      return branchless_search(key, index);
+    }
+    return false;
+  }
   if(seq.size() > 0)
   {
     int left = 0;
@@ -322,4 +483,110 @@ bool BinSearchMap<K,V>::bin_search(const K& key, int& index) const
   return false;
 }
 
+// Each step keeps the lower or upper half of the range with a
+// conditional move instead of a branch, so there is nothing to
+// mispredict, and the middles of both possible halves are prefetched
+// ahead of the step that needs one of them. Gives the same index as
+// eytzinger_search.
+template<typename K, typename V>
+bool BinSearchMap<K,V>::branchless_search(const K& key, int& index) const
+{
+  const std::pair<K,V>* first = &seq[0];
+  const std::pair<K,V>* base = first;
+  int n = seq.size();
+  while(n > 1)
+  {
+    int half = n / 2;
+    __builtin_prefetch(base + half / 2);
+    __builtin_prefetch(base + half + half / 2);
+    base = base[half].first < key ? base + half : base;
+    n -= half;
+  }
+  index = (base - first) + (base -> first < key);
+  if(index == seq.size())
+  {
+    index--;
+    return false;
+  }
+  return seq[index].first == key;
+}
+
+// Searches the Eytzinger layout. Slot k's children are slots 2k and
+// 2k + 1, so the search steps left or right without a branch, and
+// the slots three levels down (eight apart, one cache line of int
+// slots) are prefetched as it goes. Gives the first key not less
+// than the key (or the last key if there is none), which is where
+// the plain search also stops.
+template<typename K, typename V>
+bool BinSearchMap<K,V>::eytzinger_search(const K& key, int& index) const
+{
+  const Slot* slots = layout.data();
+  int n = seq.size();
+  int prefetch_limit = n / 8;
+  int k = 1;
+  while(k <= n)
+  {
+    __builtin_prefetch(slots + (k <= prefetch_limit ? 8 * k : 0));
+    k = 2 * k + (slots[k].key < key);
+  }
+  // undo the right turns taken after the last left turn
+  k >>= __builtin_ffs(~k);
+  if(k == 0)
+  {
+    index = n - 1;
+    return false;
+  }
+  index = slots[k].index;
+  return !(key < slots[k].key);
+}
+
+// Turns the read-optimized layout on or off
+template<typename K, typename V>
+void BinSearchMap<K,V>::read_optimized(bool on)
+{
+  read_mode = on;
+  if(on)
+  {
+    update_layout();
+  }
+  else
+  {
+    layout = std::vector<Slot>();
+  }
+}
+
+// Returns true if the read-optimized layout is on
+template<typename K, typename V>
+bool BinSearchMap<K,V>::read_optimized() const
+{
+  return read_mode;
+}
+
+// rebuilds the read-optimized layout from seq (if it is on)
+template<typename K, typename V>
+void BinSearchMap<K,V>::update_layout()
+{
+  if(!read_mode)
+  {
+    return;
+  }
+  layout.resize(seq.size() + 1);
+  fill_layout(1, 0);
+}
+
+// an in-order walk of the implicit tree visits the slots in key
+// order, so it takes the keys of seq in order
+template<typename K, typename V>
+int BinSearchMap<K,V>::fill_layout(int k, int i)
+{
+  if(k <= seq.size())
+  {
+    i = fill_layout(2 * k, i);
+    layout[k].key = seq[i].first;
+    layout[k].index = i;
+    i = fill_layout(2 * k + 1, i + 1);
+  }
+  return i;
+}
+
 #endif
@@ -19,6 +19,7 @@
 #include <functional>
 #include <vector>
 #include <cassert>
+#include <random>
 #include "util.h"
 #include "arrayseq.h"
 #include "map.h"
@@ -37,6 +38,8 @@ double timed_contains(const Map<int,int>& m, int key);
 double timed_find_range(const Map<int,int>& m, int key1, int key2);
 double timed_next_key(const Map<int,int>& m, int key); 
 double timed_sorted_keys(const Map<int,int>& m);
+void batch_row(int n);
+void layout_row(int n);
 
 // test parameters
 const int start = 0;
@@ -140,7 +143,24 @@ int main(int argc, char* argv[])
 
     cout << endl;
   }
-  
+
+  // loading and then erasing n shuffled keys one at a time vs as one
+  // batch (comment lines so the plotting script skips them). One at a
+  // time is quadratic, so it is only timed up to stop keys.
+  cout << "# batch load/erase (msec): n, insert, erase, insert_batch, "
+       << "erase_batch" << endl;
+  for (int n = stop / 4; n <= stop; n *= 2)
+    batch_row(n);
+  batch_row(stop * 20);
+
+  // contains with the sorted layout, searched by the generic loop
+  // (double keys) and the branchless search (int keys), vs the
+  // read-optimized (Eytzinger) layout, for random keys of which about
+  // half are in the map
+  cout << "# contains (nsec/lookup): n, sorted generic, sorted "
+       << "branchless, eytzinger" << endl;
+  for (int n = 1000; n <= 4096000; n *= 4)
+    layout_row(n);
 }
 
 
@@ -221,5 +241,82 @@ double timed_sorted_keys(const Map<int,int>& m)
 }
 
 
+// times loading and erasing n shuffled keys with BinSearchMap, one
+// key at a time (only up to stop keys) and as one batch
+void batch_row(int n)
+{
+  ArraySeq<int> keys;
+  ArraySeq<pair<int,int>> pairs;
+  for (int i = 0; i < n; ++i)
+    keys.insert(i * 2, keys.size());
+  faro_shuffle(keys, 3);
+  for (int i = 0; i < n; ++i)
+    pairs.insert({keys[i], keys[i]}, pairs.size());
+  cout << "# " << n;
+  if (n <= stop) {
+    BinSearchMap<int,int> m;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i)
+      m.insert(keys[i], keys[i]);
+    auto t1 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i)
+      m.erase(keys[i]);
+    auto t2 = high_resolution_clock::now();
+    assert(m.empty());
+    cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << duration_cast<microseconds>(t2 - t1).count() / 1000.0;
+  }
+  else
+    cout << " - -";
+  BinSearchMap<int,int> m;
+  auto t0 = high_resolution_clock::now();
+  m.insert_batch(pairs);
+  auto t1 = high_resolution_clock::now();
+  assert(m.size() == n);
+  m.erase_batch(keys);
+  auto t2 = high_resolution_clock::now();
+  assert(m.empty());
+  cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+       << " " << duration_cast<microseconds>(t2 - t1).count() / 1000.0
+       << endl;
+}
 
-
+// times 1,000,000 random contains calls on a map of n even keys
+// with each search
+void layout_row(int n)
+{
+  const int lookups = 1000000;
+  ArraySeq<pair<int,int>> pairs;
+  ArraySeq<pair<double,int>> double_pairs;
+  for (int i = 0; i < n; ++i) {
+    pairs.insert({i * 2, i}, pairs.size());
+    double_pairs.insert({i * 2, i}, double_pairs.size());
+  }
+  ArraySeq<int> queries;
+  mt19937 gen(17);
+  uniform_int_distribution<int> dist(0, 2 * n - 1);
+  for (int i = 0; i < lookups; ++i)
+    queries.insert(dist(gen), queries.size());
+  BinSearchMap<double,int> generic;
+  generic.insert_batch(double_pairs);
+  BinSearchMap<int,int> m;
+  m.insert_batch(pairs);
+  cout << "# " << n;
+  long expected = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < lookups; ++i)
+    expected += generic.contains(queries[i]);
+  auto t1 = high_resolution_clock::now();
+  cout << " " << duration_cast<nanoseconds>(t1 - t0).count() / (double) lookups;
+  for (int mode = 0; mode < 2; ++mode) {
+    m.read_optimized(mode == 1);
+    long found = 0;
+    t0 = high_resolution_clock::now();
+    for (int i = 0; i < lookups; ++i)
+      found += m.contains(queries[i]);
+    t1 = high_resolution_clock::now();
+    cout << " " << duration_cast<nanoseconds>(t1 - t0).count() / (double) lookups;
+    assert(found == expected);
+  }
+  cout << endl;
+}
@@ -221,6 +221,143 @@ TEST(BasicBinSearchMapTests, PrevKeyCheck)
   ASSERT_EQ(false, m.prev_key('a', prev_key));
 }
 
+TEST(BasicBinSearchMapTests, BatchInsertCheck)
+{
+  BinSearchMap<int,int> m;
+  m.insert(20, 200);
+  m.insert(40, 400);
+  ArraySeq<pair<int,int>> batch;
+  batch.insert({50, 500}, 0);
+  batch.insert({10, 100}, 1);
+  batch.insert({30, 300}, 2);
+  batch.insert({5, 50}, 3);
+  m.insert_batch(batch);
+  ASSERT_EQ(6, m.size());
+  ArraySeq<int> k = m.sorted_keys();
+  int expected[] = {5, 10, 20, 30, 40, 50};
+  for (int i = 0; i < 6; ++i) {
+    ASSERT_EQ(expected[i], k[i]);
+    ASSERT_EQ(expected[i] * 10, m[expected[i]]);
+  }
+  // a key already present or repeated in the batch leaves m unchanged
+  ArraySeq<pair<int,int>> bad;
+  bad.insert({15, 0}, 0);
+  bad.insert({30, 0}, 1);
+  EXPECT_THROW(m.insert_batch(bad), std::invalid_argument);
+  bad.erase(1);
+  bad.insert({15, 1}, 1);
+  EXPECT_THROW(m.insert_batch(bad), std::invalid_argument);
+  ASSERT_EQ(6, m.size());
+  ASSERT_EQ(false, m.contains(15));
+  BinSearchMap<int,int> empty;
+  empty.insert_batch(batch);
+  ASSERT_EQ(4, empty.size());
+  empty.insert_batch(ArraySeq<pair<int,int>>());
+  ASSERT_EQ(4, empty.size());
+}
+
+TEST(BasicBinSearchMapTests, BatchEraseCheck)
+{
+  BinSearchMap<int,int> m;
+  for (int i = 0; i < 10; ++i)
+    m.insert(i, i * 10);
+  ArraySeq<int> keys;
+  keys.insert(7, 0);
+  keys.insert(0, 1);
+  keys.insert(3, 2);
+  keys.insert(7, 3);
+  keys.insert(9, 4);
+  m.erase_batch(keys);
+  ASSERT_EQ(6, m.size());
+  ArraySeq<int> k = m.sorted_keys();
+  int expected[] = {1, 2, 4, 5, 6, 8};
+  for (int i = 0; i < 6; ++i) {
+    ASSERT_EQ(expected[i], k[i]);
+    ASSERT_EQ(expected[i] * 10, m[expected[i]]);
+  }
+  // a missing key leaves m unchanged
+  ArraySeq<int> missing;
+  missing.insert(2, 0);
+  missing.insert(11, 1);
+  EXPECT_THROW(m.erase_batch(missing), std::out_of_range);
+  ASSERT_EQ(6, m.size());
+  ASSERT_EQ(true, m.contains(2));
+  m.erase_batch(m.sorted_keys());
+  ASSERT_EQ(true, m.empty());
+}
+
+TEST(BasicBinSearchMapTests, ReadOptimizedCheck)
+{
+  BinSearchMap<int,int> m1;
+  BinSearchMap<int,int> m2;
+  m2.read_optimized(true);
+  ASSERT_EQ(true, m2.read_optimized());
+  ASSERT_EQ(false, m2.contains(4));
+  // every size from empty to 100 even keys, checking all keys in and
+  // around the map
+  for (int n = 0; n <= 100; ++n) {
+    for (int key = -1; key <= 2 * n + 1; ++key) {
+      int k1 = 0, k2 = 0;
+      ASSERT_EQ(m1.contains(key), m2.contains(key));
+      ASSERT_EQ(m1.next_key(key, k1), m2.next_key(key, k2));
+      ASSERT_EQ(k1, k2);
+      ASSERT_EQ(m1.prev_key(key, k1), m2.prev_key(key, k2));
+      ASSERT_EQ(k1, k2);
+      ASSERT_EQ(m1.find_keys(key, key + 7).size(),
+                m2.find_keys(key, key + 7).size());
+    }
+    if (n % 2 == 0) {
+      m1.insert(n * 37 % 101 * 2, n);
+      m2.insert(n * 37 % 101 * 2, n);
+    }
+    else {
+      m1.insert((n - 1) * 37 % 101 * 2 + 1, n);
+      m2.insert((n - 1) * 37 % 101 * 2 + 1, n);
+      m1.erase((n - 1) * 37 % 101 * 2 + 1);
+      m2.erase((n - 1) * 37 % 101 * 2 + 1);
+      m1.insert(n * 37 % 101 * 2, n);
+      m2.insert(n * 37 % 101 * 2, n);
+    }
+    ASSERT_EQ(m1.size(), m2.size());
+  }
+  ArraySeq<int> keys = m1.sorted_keys();
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(m1[keys[i]], m2[keys[i]]);
+  m2.read_optimized(false);
+  ASSERT_EQ(false, m2.read_optimized());
+  ASSERT_EQ(true, m2.contains(keys[0]));
+  m2.read_optimized(true);
+  ArraySeq<int> half;
+  for (int i = 0; i < keys.size(); i += 2)
+    half.insert(keys[i], half.size());
+  m2.erase_batch(half);
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(i % 2 == 1, m2.contains(keys[i]));
+  m2.clear();
+  ASSERT_EQ(false, m2.contains(keys[0]));
+}
+
+TEST(BasicBinSearchMapTests, IntegralSearchCheck)
+{
+  // int keys use the branchless search and double keys the generic
+  // one; both must stop at the same places
+  BinSearchMap<int,int> m1;
+  BinSearchMap<double,int> m2;
+  for (int n = 0; n <= 40; ++n) {
+    for (int key = -1; key <= 2 * n + 1; ++key) {
+      int k1 = 0;
+      double k2 = 0;
+      ASSERT_EQ(m1.contains(key), m2.contains(key));
+      ASSERT_EQ(m1.next_key(key, k1), m2.next_key(key, k2));
+      ASSERT_EQ(k1, k2);
+      ASSERT_EQ(m1.prev_key(key, k1), m2.prev_key(key, k2));
+      ASSERT_EQ(k1, k2);
+    }
+    m1.insert(n * 17 % 41 * 2, n);
+    m2.insert(n * 17 % 41 * 2, n);
+  }
+}
+
 
 //----------------------------------------------------------------------
 // Main
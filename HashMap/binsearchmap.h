@@ -13,7 +13,7 @@
 
 
 template<typename K, typename V>
-class BinSearchMap : public Map<K,V>
+class BinSearchMap final : public Map<K,V>
 {
 public:
 
@@ -0,0 +1,406 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: concurrenthashmap.h
+// DATE: Spring 2022
+// DESC: A hash map that many threads can use at once. The keys are
+//       split across a power-of-two number of shards, each an
+//       ordinary HashMap behind its own reader/writer lock, so
+//       threads working on different shards never wait on each other
+//       and each shard grows (resizes and rehashes) on its own.
+//---------------------------------------------------------------------------
+
+#ifndef CONCURRENTHASHMAP_H
+#define CONCURRENTHASHMAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "map.h"
+#include "arrayseq.h"
+#include "hashmap.h"
+
+
+// NodeAlloc and Hash are passed on to the shards (see hashmap.h)
+template<typename K, typename V, template<typename> class NodeAlloc = HeapAlloc,
+         template<typename> class Hash = StdHash>
+class ConcurrentHashMap final : public Map<K,V>
+{
+public:
+
+  // constructor taking the number of shards, rounded up to a power of
+  // two (and at least 2)
+  ConcurrentHashMap(int requested_shards = 64);
+
+  // shards hold locks, so the map cannot be copied or moved
+  ConcurrentHashMap(const ConcurrentHashMap& rhs) = delete;
+  ConcurrentHashMap& operator=(const ConcurrentHashMap& rhs) = delete;
+
+  // Returns the number of key-value pairs in the map. Counts each
+  // shard in turn, so it may miss changes made while it runs.
+  int size() const;
+
+  // Tests if the map is empty (with the same caveat as size)
+  bool empty() const;
+
+  // Allows values associated with a key to be updated. Throws
+  // out_of_range if the given key is not in the collection. The
+  // reference is only safe to use while no other thread can erase
+  // the key; get() copies the value under the lock instead.
+  V& operator[](const K& key);
+
+  // Returns the value for a given key, as above.
+  const V& operator[](const K& key) const;
+
+  // Copies the value of the key into value under the shard's lock.
+  // Returns false (leaving value alone) if the key is not in the
+  // collection.
+  bool get(const K& key, V& value) const;
+
+  // Extends the collection by adding the given key-value pair.
+  // Expects key to not exist in map prior to insertion.
+  void insert(const K& key, const V& value);
+
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection. The check and the insert happen under
+  // one lock, so exactly one of several racing calls adds the key.
+  // Returns true if the key was added.
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
+  // Shrinks the collection by removing the key-value pair with the
+  // given key. Throws out_of_range if the given key is not in the
+  // collection.
+  void erase(const K& key);
+
+  // Returns true if the key is in the collection, and false otherwise.
+  bool contains(const K& key) const;
+
+  // Returns the values of the keys, each copied under its shard's
+  // lock. Throws out_of_range if any key is not in the collection.
+  ArraySeq<V> get_many(const ArraySeq<K>& keys) const;
+
+  // The ordered queries visit the shards in turn, each under its
+  // lock, and combine the results. They are not a snapshot of the
+  // whole map while other threads are writing.
+
+  // Returns the keys k in the collection such that k1 <= k <= k2
+  ArraySeq<K> find_keys(const K& k1, const K& k2) const;
+
+  // Returns the keys in the collection in ascending sorted order
+  ArraySeq<K> sorted_keys() const;
+
+  // Gives the key (as an ouptput parameter) immediately after the
+  // given key according to ascending sort order. Returns true if a
+  // successor key exists, and false otherwise.
+  bool next_key(const K& key, K& next_key) const;
+
+  // Gives the key (as an ouptput parameter) immediately before the
+  // given key according to ascending sort order. Returns true if a
+  // predecessor key exists, and false otherwise.
+  bool prev_key(const K& key, K& next_key) const;
+
+  // Removes all key-value pairs from the map, one shard at a time
+  void clear();
+
+  // Returns the number of shards
+  int shard_count() const;
+
+private:
+
+  // a shard on its own cache line, so that locking one shard does
+  // not slow down threads using its neighbors
+  struct alignas(64) Shard {
+    mutable std::shared_mutex lock;
+    HashMap<K,V,NodeAlloc,Hash> map;
+  };
+
+  int shards_used;
+
+  // the shard is picked by the top bits of the Fibonacci-mixed hash
+  // code, leaving the low bits (which pick buckets in the shard's
+  // table) spread evenly inside each shard
+  int shard_shift;
+
+  std::unique_ptr<Shard[]> shards;
+
+  // returns the shard holding key
+  Shard& shard_for(const K& key) const;
+
+  // ordered query helper: runs query (which returns keys) on each
+  // shard's map under its lock and returns all the keys sorted
+  template<typename F>
+  ArraySeq<K> collect_sorted(F query) const;
+
+};
+
+
+// constructor rounds the shard count up to a power of two
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ConcurrentHashMap<K,V,NodeAlloc,Hash>::ConcurrentHashMap(int requested_shards)
+{
+  int bits = 1;
+  while((1 << bits) < requested_shards && bits < 16)
+  {
+    bits++;
+  }
+  shards_used = 1 << bits;
+  shard_shift = 64 - bits;
+  shards.reset(new Shard[shards_used]);
+}
+
+// Returns the number of key-value pairs in the map
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int ConcurrentHashMap<K,V,NodeAlloc,Hash>::size() const
+{
+  int total = 0;
+  for(int i = 0; i < shards_used; i++)
+  {
+    std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+    total += shards[i].map.size();
+  }
+  return total;
+}
+
+// Tests if the map is empty
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::empty() const
+{
+  return size() == 0;
+}
+
+// Allows values associated with a key to be updated. Takes the lock
+// exclusively, since a shard's operator[] may move rehash buckets.
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+V& ConcurrentHashMap<K,V,NodeAlloc,Hash>::operator[](const K& key)
+{
+  Shard& shard = shard_for(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  return shard.map[key];
+}
+
+// Returns the value for a given key
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+const V& ConcurrentHashMap<K,V,NodeAlloc,Hash>::operator[](const K& key) const
+{
+  const Shard& shard = shard_for(key);
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  return shard.map[key];
+}
+
+// Copies the value of the key under the shard's lock
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::get(const K& key, V& value) const
+{
+  const Shard& shard = shard_for(key);
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  if(!shard.map.contains(key))
+  {
+    return false;
+  }
+  value = shard.map[key];
+  return true;
+}
+
+// Extends the collection by adding the given key-value pair
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void ConcurrentHashMap<K,V,NodeAlloc,Hash>::insert(const K& key, const V& value)
+{
+  Shard& shard = shard_for(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  shard.map.insert(key, value);
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void ConcurrentHashMap<K,V,NodeAlloc,Hash>::insert(K&& key, V&& value)
+{
+  Shard& shard = shard_for(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  shard.map.insert(std::move(key), std::move(value));
+}
+
+// Checks for and inserts the key under one lock
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+template<typename... Args>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::try_emplace(const K& key, Args&&... args)
+{
+  Shard& shard = shard_for(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  return shard.map.try_emplace(key, std::forward<Args>(args)...);
+}
+
+// Shrinks the collection by removing the key-value pair with the
+// given key
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void ConcurrentHashMap<K,V,NodeAlloc,Hash>::erase(const K& key)
+{
+  Shard& shard = shard_for(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  shard.map.erase(key);
+}
+
+// Returns true if the key is in the collection, and false otherwise.
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::contains(const K& key) const
+{
+  const Shard& shard = shard_for(key);
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  return shard.map.contains(key);
+}
+
+// Returns the values of the keys, each copied under its shard's lock
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<V> ConcurrentHashMap<K,V,NodeAlloc,Hash>::get_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<V> values;
+  V value;
+  for(int i = 0; i < keys.size(); i++)
+  {
+    if(!get(keys[i], value))
+    {
+      throw(std::out_of_range("ConcurrentHashMap<K,V>::get_many(const ArraySeq<K>&)"));
+    }
+    values.insert(value, i);
+  }
+  return values;
+}
+
+// Returns the keys k in the collection such that k1 <= k <= k2
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<K> ConcurrentHashMap<K,V,NodeAlloc,Hash>::find_keys(const K& k1, const K& k2) const
+{
+  return collect_sorted([&](const HashMap<K,V,NodeAlloc,Hash>& map) {
+    return map.find_keys(k1, k2);
+  });
+}
+
+// Returns the keys in the collection in ascending sorted order
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<K> ConcurrentHashMap<K,V,NodeAlloc,Hash>::sorted_keys() const
+{
+  return collect_sorted([](const HashMap<K,V,NodeAlloc,Hash>& map) {
+    return map.sorted_keys();
+  });
+}
+
+// takes the smallest successor over all shards
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::next_key(const K& key, K& next_key) const
+{
+  bool found = false;
+  K candidate;
+  for(int i = 0; i < shards_used; i++)
+  {
+    std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+    if(shards[i].map.next_key(key, candidate) && (!found || candidate < next_key))
+    {
+      next_key = candidate;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// takes the largest predecessor over all shards
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool ConcurrentHashMap<K,V,NodeAlloc,Hash>::prev_key(const K& key, K& next_key) const
+{
+  bool found = false;
+  K candidate;
+  for(int i = 0; i < shards_used; i++)
+  {
+    std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+    if(shards[i].map.prev_key(key, candidate) && (!found || next_key < candidate))
+    {
+      next_key = candidate;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Removes all key-value pairs from the map, one shard at a time
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void ConcurrentHashMap<K,V,NodeAlloc,Hash>::clear()
+{
+  for(int i = 0; i < shards_used; i++)
+  {
+    std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+    shards[i].map.clear();
+  }
+}
+
+// Returns the number of shards
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int ConcurrentHashMap<K,V,NodeAlloc,Hash>::shard_count() const
+{
+  return shards_used;
+}
+
+// returns the shard holding key
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+typename ConcurrentHashMap<K,V,NodeAlloc,Hash>::Shard&
+ConcurrentHashMap<K,V,NodeAlloc,Hash>::shard_for(const K& key) const
+{
+  std::uint64_t code = Hash<K>()(key);
+  return shards[(code * 0x9e3779b97f4a7c15ull) >> shard_shift];
+}
+
+// gathers each shard's keys under its lock, then sorts them once
+// outside the locks
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+template<typename F>
+ArraySeq<K> ConcurrentHashMap<K,V,NodeAlloc,Hash>::collect_sorted(F query) const
+{
+  std::vector<K> all;
+  for(int i = 0; i < shards_used; i++)
+  {
+    ArraySeq<K> part;
+    {
+      std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+      part = query(shards[i].map);
+    }
+    for(int j = 0; j < part.size(); j++)
+    {
+      all.push_back(part[j]);
+    }
+  }
+  std::sort(all.begin(), all.end());
+  ArraySeq<K> keys;
+  for(const K& key : all)
+  {
+    keys.insert(key, keys.size());
+  }
+  return keys;
+}
+
+
+#endif
@@ -0,0 +1,244 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: epoch.h
+// DATE: Spring 2022
+// DESC: Epoch-based reclamation for the lock-free containers. A
+//       thread reading shared nodes holds an EpochGuard; a node that
+//       has been unlinked is retired instead of deleted, and is only
+//       freed once every thread that was reading when it was
+//       unlinked has since left its guard. The global epoch advances
+//       when every active reader has seen the current one, so a node
+//       retired in epoch e is safe to free once the epoch reaches
+//       e + 2.
+//---------------------------------------------------------------------------
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+class EpochDomain
+{
+public:
+
+  // Returns the process-wide domain
+  static EpochDomain& global();
+
+  EpochDomain() = default;
+  EpochDomain(const EpochDomain& rhs) = delete;
+  EpochDomain& operator=(const EpochDomain& rhs) = delete;
+
+  // frees every retired node and every thread record
+  ~EpochDomain();
+
+  // Marks the calling thread as reading (guards may nest)
+  void enter();
+
+  // Ends the calling thread's innermost guard
+  void leave();
+
+  // Hands over an unlinked node, to be freed with deleter once no
+  // reader can still hold it
+  void retire(void* node, void (*deleter)(void*));
+
+private:
+
+  // a node waiting to be freed and the epoch it was retired in
+  struct Retired {
+    void* node;
+    void (*deleter)(void*);
+    std::uint64_t epoch;
+  };
+
+  // per-thread state, on its own cache line. A record outlives its
+  // thread: when the thread exits the record (and any nodes it still
+  // holds) is handed to the next thread that needs one.
+  struct alignas(64) Record {
+    std::atomic<std::uint64_t> epoch{0};
+    std::atomic<bool> active{false};
+    std::atomic<bool> in_use{false};
+    int depth = 0;
+    std::vector<Retired> retired;
+    Record* next = nullptr;
+  };
+
+  // releases the thread's record when the thread exits
+  struct ThreadRecord {
+    Record* record = nullptr;
+    ~ThreadRecord();
+  };
+
+  // retired nodes a thread collects before trying to free some
+  static const int COLLECT_THRESHOLD = 64;
+
+  std::atomic<std::uint64_t> epoch{0};
+
+  // every record ever created (records are never unlinked)
+  std::atomic<Record*> records{nullptr};
+
+  // returns the calling thread's record, claiming one on first use
+  Record* record();
+
+  // advances the epoch if every active thread has seen it
+  void try_advance();
+
+  // frees the nodes of the record retired at least two epochs ago
+  void collect(Record* rec);
+
+};
+
+
+// RAII guard for a read (or update) of lock-free nodes
+class EpochGuard
+{
+public:
+
+  explicit EpochGuard(EpochDomain& domain = EpochDomain::global())
+    : domain(domain)
+  {
+    domain.enter();
+  }
+
+  ~EpochGuard()
+  {
+    domain.leave();
+  }
+
+  EpochGuard(const EpochGuard& rhs) = delete;
+  EpochGuard& operator=(const EpochGuard& rhs) = delete;
+
+private:
+
+  EpochDomain& domain;
+
+};
+
+
+inline EpochDomain& EpochDomain::global()
+{
+  static EpochDomain domain;
+  return domain;
+}
+
+inline EpochDomain::~EpochDomain()
+{
+  Record* rec = records.load();
+  while(rec != nullptr)
+  {
+    for(const Retired& r : rec -> retired)
+    {
+      r.deleter(r.node);
+    }
+    Record* next = rec -> next;
+    delete rec;
+    rec = next;
+  }
+}
+
+// the announced epoch is stored and fenced before the caller reads
+// any shared pointer, so try_advance either sees this thread as
+// active in its epoch or the thread sees the newer epoch
+inline void EpochDomain::enter()
+{
+  Record* rec = record();
+  if(rec -> depth++ == 0)
+  {
+    rec -> active.store(true);
+    rec -> epoch.store(epoch.load());
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+inline void EpochDomain::leave()
+{
+  Record* rec = record();
+  if(--rec -> depth == 0)
+  {
+    rec -> active.store(false, std::memory_order_release);
+  }
+}
+
+inline void EpochDomain::retire(void* node, void (*deleter)(void*))
+{
+  Record* rec = record();
+  rec -> retired.push_back({node, deleter, epoch.load()});
+  if(rec -> retired.size() >= COLLECT_THRESHOLD)
+  {
+    try_advance();
+    collect(rec);
+  }
+}
+
+inline EpochDomain::ThreadRecord::~ThreadRecord()
+{
+  if(record != nullptr)
+  {
+    record -> in_use.store(false, std::memory_order_release);
+  }
+}
+
+// reuses the record of an exited thread when there is one, and
+// otherwise pushes a new record onto the list
+inline EpochDomain::Record* EpochDomain::record()
+{
+  static thread_local ThreadRecord mine;
+  if(mine.record != nullptr)
+  {
+    return mine.record;
+  }
+  for(Record* rec = records.load(); rec != nullptr; rec = rec -> next)
+  {
+    bool free = false;
+    if(rec -> in_use.compare_exchange_strong(free, true))
+    {
+      mine.record = rec;
+      return rec;
+    }
+  }
+  Record* rec = new Record;
+  rec -> in_use.store(true);
+  rec -> next = records.load();
+  while(!records.compare_exchange_weak(rec -> next, rec))
+  {
+  }
+  mine.record = rec;
+  return rec;
+}
+
+inline void EpochDomain::try_advance()
+{
+  std::uint64_t current = epoch.load();
+  for(Record* rec = records.load(); rec != nullptr; rec = rec -> next)
+  {
+    if(rec -> active.load() && rec -> epoch.load() != current)
+    {
+      return;
+    }
+  }
+  epoch.compare_exchange_strong(current, current + 1);
+}
+
+inline void EpochDomain::collect(Record* rec)
+{
+  std::uint64_t current = epoch.load();
+  int kept = 0;
+  for(int i = 0; i < (int) rec -> retired.size(); i++)
+  {
+    Retired r = rec -> retired[i];
+    if(r.epoch + 2 <= current)
+    {
+      r.deleter(r.node);
+    }
+    else
+    {
+      rec -> retired[kept++] = r;
+    }
+  }
+  rec -> retired.resize(kept);
+}
+
+
+#endif
@@ -0,0 +1,631 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: flathashmap.h
+// DATE: Spring 2022
+// DESC: Open addressing ("Swiss table" style) hash map. Each slot has
+//       a one byte control value holding either EMPTY, DELETED, or the
+//       low 7 bits of the key's hash. Slots are probed a group at a
+//       time, comparing all control bytes of a group at once with
+//       SSE2 (16 slots) or AVX2 (32 slots) instructions, so that most
+//       lookups touch a single cache line of keys.
+//---------------------------------------------------------------------------
+
+#ifndef FLATHASHMAP_H
+#define FLATHASHMAP_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "map.h"
+#include "arrayseq.h"
+
+
+template<typename K, typename V>
+class FlatHashMap final : public Map<K,V>
+{
+public:
+
+  // default constructor
+  FlatHashMap();
+
+  // copy constructor
+  FlatHashMap(const FlatHashMap& rhs);
+
+  // move constructor
+  FlatHashMap(FlatHashMap&& rhs);
+
+  // copy assignment
+  FlatHashMap& operator=(const FlatHashMap& rhs);
+
+  // move assignment
+  FlatHashMap& operator=(FlatHashMap&& rhs);
+
+  // destructor
+  ~FlatHashMap();
+
+  // Returns the number of key-value pairs in the map
+  int size() const;
+
+  // Tests if the map is empty
+  bool empty() const;
+
+  // Allows values associated with a key to be updated. Throws
+  // out_of_range if the given key is not in the collection.
+  V& operator[](const K& key);
+
+  // Returns the value for a given key. Throws out_of_range if the
+  // given key is not in the collection.
+  const V& operator[](const K& key) const;
+
+  // Extends the collection by adding the given key-value pair. If
+  // the key already exists its value is replaced.
+  void insert(const K& key, const V& value);
+
+  // Shrinks the collection by removing the key-value pair with the
+  // given key. Throws out_of_range if the given key is not in the
+  // collection.
+  void erase(const K& key);
+
+  // Returns true if the key is in the collection, and false otherwise.
+  bool contains(const K& key) const;
+
+  // Returns the keys k in the collection such that k1 <= k <= k2
+  ArraySeq<K> find_keys(const K& k1, const K& k2) const;
+
+  // Returns the keys in the collection in ascending sorted order
+  ArraySeq<K> sorted_keys() const;
+
+  // Gives the key (as an ouptput parameter) immediately after the
+  // given key according to ascending sort order. Returns true if a
+  // successor key exists, and false otherwise.
+  bool next_key(const K& key, K& next_key) const;
+
+  // Gives the key (as an ouptput parameter) immediately before the
+  // given key according to ascending sort order. Returns true if a
+  // predecessor key exists, and false otherwise.
+  bool prev_key(const K& key, K& next_key) const;
+
+  // Removes all key-value pairs from the map. Does not change the
+  // current capacity of the table.
+  void clear();
+
+  // statistics functions for the table: the number of groups probed
+  // to find each key (1 means the key is in its home group)
+  int max_probe_length() const;
+  double avg_probe_length() const;
+
+private:
+
+  // number of control bytes compared in one probe step
+#if defined(__AVX2__)
+  static const int GROUP_WIDTH = 32;
+#else
+  static const int GROUP_WIDTH = 16;
+#endif
+
+  // control byte values (full slots hold the 7-bit hash, 0 to 127)
+  static const signed char EMPTY = -128;
+  static const signed char DELETED = -2;
+
+  // number of key-value pairs in map
+  int count = 0;
+
+  // number of DELETED control bytes (tombstones) in the table
+  int deleted = 0;
+
+  // number of slots, always a power of two multiple of GROUP_WIDTH
+  int capacity = GROUP_WIDTH;
+
+  // control bytes, and the key-value slots they describe (a key and
+  // its value share a cache line)
+  signed char* ctrl = nullptr;
+  std::pair<K,V>* slots = nullptr;
+
+  // the (mixed) hash function
+  std::uint64_t hash(const K& key) const;
+
+  // bit i is set if control byte base + i equals c
+  std::uint32_t match(int base, signed char c) const;
+
+  // bit i is set if slot base + i is EMPTY or DELETED
+  std::uint32_t match_free(int base) const;
+
+  // index of the lowest set bit of a non-zero mask
+  static int lowest_bit(std::uint32_t mask);
+
+  // returns the slot holding key, or -1 if the key is not present
+  int find_index(const K& key) const;
+
+  // returns the first EMPTY or DELETED slot on the key's probe path
+  int find_free_index(std::uint64_t h) const;
+
+  // allocate new_capacity slots and reinsert every key
+  void resize_and_rehash(int new_capacity);
+
+  // allocate the arrays for the current capacity, all slots EMPTY
+  void init_table();
+
+};
+
+
+// constructor just initializes table
+template<typename K, typename V>
+FlatHashMap<K,V>::FlatHashMap()
+{
+  init_table();
+}
+
+// copy constructor
+template<typename K, typename V>
+FlatHashMap<K,V>::FlatHashMap(const FlatHashMap& rhs)
+{
+  init_table();
+  *this = rhs;
+}
+
+// move constructor
+template<typename K, typename V>
+FlatHashMap<K,V>::FlatHashMap(FlatHashMap&& rhs)
+{
+  init_table();
+  *this = std::move(rhs);
+}
+
+// copy assignment
+template<typename K, typename V>
+FlatHashMap<K,V>& FlatHashMap<K,V>::operator=(const FlatHashMap& rhs)
+{
+  if(this != &rhs)
+  {
+    delete[] ctrl;
+    delete[] slots;
+    capacity = rhs.capacity;
+    count = rhs.count;
+    deleted = rhs.deleted;
+    init_table();
+    std::memcpy(ctrl, rhs.ctrl, capacity);
+    for(int i = 0; i < capacity; i++)
+    {
+      if(ctrl[i] >= 0)
+      {
+        slots[i] = rhs.slots[i];
+      }
+    }
+  }
+  return *this;
+}
+
+// move assignment
+template<typename K, typename V>
+FlatHashMap<K,V>& FlatHashMap<K,V>::operator=(FlatHashMap&& rhs)
+{
+  if(this != &rhs)
+  {
+    delete[] ctrl;
+    delete[] slots;
+    ctrl = rhs.ctrl;
+    slots = rhs.slots;
+    count = rhs.count;
+    deleted = rhs.deleted;
+    capacity = rhs.capacity;
+    rhs.count = 0;
+    rhs.deleted = 0;
+    rhs.capacity = GROUP_WIDTH;
+    rhs.init_table();
+  }
+  return *this;
+}
+
+// destructor
+template<typename K, typename V>
+FlatHashMap<K,V>::~FlatHashMap()
+{
+  delete[] ctrl;
+  delete[] slots;
+}
+
+// Returns the number of key-value pairs in the map
+template<typename K, typename V>
+int FlatHashMap<K,V>::size() const
+{
+  return count;
+}
+
+// Tests if the map is empty
+template<typename K, typename V>
+bool FlatHashMap<K,V>::empty() const
+{
+  return size() == 0;
+}
+
+// Allows values associated with a key to be updated. Throws
+// out_of_range if the given key is not in the collection.
+template<typename K, typename V>
+V& FlatHashMap<K,V>::operator[](const K& key)
+{
+  int index = find_index(key);
+  if(index == -1)
+  {
+    throw(std::out_of_range("FlatHashMap<K,V>::operator[](const K& key)"));
+  }
+  return slots[index].second;
+}
+
+// Returns the value for a given key. Throws out_of_range if the
+// given key is not in the collection.
+template<typename K, typename V>
+const V& FlatHashMap<K,V>::operator[](const K& key) const
+{
+  int index = find_index(key);
+  if(index == -1)
+  {
+    throw(std::out_of_range("FlatHashMap<K,V>::operator[](const K& key)"));
+  }
+  return slots[index].second;
+}
+
+// Extends the collection by adding the given key-value pair. If the
+// key already exists its value is replaced.
+template<typename K, typename V>
+void FlatHashMap<K,V>::insert(const K& key, const V& value)
+{
+  int index = find_index(key);
+  if(index != -1)
+  {
+    slots[index].second = value;
+    return;
+  }
+  // keep used slots (including tombstones) at or below 7/8 full
+  if((count + deleted + 1) * 8 > capacity * 7)
+  {
+    if((count + 1) * 16 > capacity * 7)
+    {
+      resize_and_rehash(capacity * 2);
+    }
+    else
+    {
+      // mostly tombstones, so just clean them out
+      resize_and_rehash(capacity);
+    }
+  }
+  std::uint64_t h = hash(key);
+  index = find_free_index(h);
+  if(ctrl[index] == DELETED)
+  {
+    deleted--;
+  }
+  ctrl[index] = (signed char)(h & 0x7F);
+  slots[index].first = key;
+  slots[index].second = value;
+  count++;
+}
+
+// Shrinks the collection by removing the key-value pair with the
+// given key. Throws out_of_range if the given key is not in the
+// collection.
+template<typename K, typename V>
+void FlatHashMap<K,V>::erase(const K& key)
+{
+  int index = find_index(key);
+  if(index == -1)
+  {
+    throw(std::out_of_range("FlatHashMap<K,V>::erase(const K& key)"));
+  }
+  // a group that still has an EMPTY slot never stopped a probe from
+  // finishing, so the slot can go straight back to EMPTY
+  int base = index - (index % GROUP_WIDTH);
+  if(match(base, EMPTY) != 0)
+  {
+    ctrl[index] = EMPTY;
+  }
+  else
+  {
+    ctrl[index] = DELETED;
+    deleted++;
+  }
+  count--;
+}
+
+// Returns true if the key is in the collection, and false otherwise.
+template<typename K, typename V>
+bool FlatHashMap<K,V>::contains(const K& key) const
+{
+  return find_index(key) != -1;
+}
+
+// Returns the keys k in the collection such that k1 <= k <= k2
+template<typename K, typename V>
+ArraySeq<K> FlatHashMap<K,V>::find_keys(const K& k1, const K& k2) const
+{
+  ArraySeq<K> seq;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0 && slots[i].first >= k1 && slots[i].first <= k2)
+    {
+      seq.insert(slots[i].first, seq.size());
+    }
+  }
+  seq.sort();
+  return seq;
+}
+
+// Returns the keys in the collection in ascending sorted order
+template<typename K, typename V>
+ArraySeq<K> FlatHashMap<K,V>::sorted_keys() const
+{
+  ArraySeq<K> seq;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0)
+    {
+      seq.insert(slots[i].first, seq.size());
+    }
+  }
+  seq.sort();
+  return seq;
+}
+
+// Gives the key (as an ouptput parameter) immediately after the
+// given key according to ascending sort order. Returns true if a
+// successor key exists, and false otherwise.
+template<typename K, typename V>
+bool FlatHashMap<K,V>::next_key(const K& key, K& next_key) const
+{
+  bool found = false;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0 && slots[i].first > key && (!found || slots[i].first < next_key))
+    {
+      next_key = slots[i].first;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Gives the key (as an ouptput parameter) immediately before the
+// given key according to ascending sort order. Returns true if a
+// predecessor key exists, and false otherwise.
+template<typename K, typename V>
+bool FlatHashMap<K,V>::prev_key(const K& key, K& next_key) const
+{
+  bool found = false;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0 && slots[i].first < key && (!found || slots[i].first > next_key))
+    {
+      next_key = slots[i].first;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Removes all key-value pairs from the map. Does not change the
+// current capacity of the table.
+template<typename K, typename V>
+void FlatHashMap<K,V>::clear()
+{
+  std::memset(ctrl, EMPTY, capacity);
+  count = 0;
+  deleted = 0;
+}
+
+// statistics functions for the table
+template<typename K, typename V>
+int FlatHashMap<K,V>::max_probe_length() const
+{
+  int max = 0;
+  int groups = capacity / GROUP_WIDTH;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0)
+    {
+      int g = (int)((hash(slots[i].first) >> 7) & (groups - 1));
+      int length = 1;
+      while(g != i / GROUP_WIDTH)
+      {
+        g = (g + length) & (groups - 1);
+        length++;
+      }
+      if(length > max)
+      {
+        max = length;
+      }
+    }
+  }
+  return max;
+}
+
+template<typename K, typename V>
+double FlatHashMap<K,V>::avg_probe_length() const
+{
+  if(count == 0)
+  {
+    return 0;
+  }
+  int total = 0;
+  int groups = capacity / GROUP_WIDTH;
+  for(int i = 0; i < capacity; i++)
+  {
+    if(ctrl[i] >= 0)
+    {
+      int g = (int)((hash(slots[i].first) >> 7) & (groups - 1));
+      int length = 1;
+      while(g != i / GROUP_WIDTH)
+      {
+        g = (g + length) & (groups - 1);
+        length++;
+      }
+      total += length;
+    }
+  }
+  return total/1.0/count;
+}
+
+// std::hash is the identity for integers, so mix the bits (the
+// murmur3 finalizer) to spread both the group index and the 7-bit tag
+template<typename K, typename V>
+std::uint64_t FlatHashMap<K,V>::hash(const K& key) const
+{
+  std::hash<K> hash_code;
+  std::uint64_t h = hash_code(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+template<typename K, typename V>
+std::uint32_t FlatHashMap<K,V>::match(int base, signed char c) const
+{
+#if defined(__AVX2__)
+  __m256i group = _mm256_loadu_si256((const __m256i*)(ctrl + base));
+  __m256i cmp = _mm256_cmpeq_epi8(group, _mm256_set1_epi8(c));
+  return (std::uint32_t)_mm256_movemask_epi8(cmp);
+#elif defined(__SSE2__)
+  __m128i group = _mm_loadu_si128((const __m128i*)(ctrl + base));
+  __m128i cmp = _mm_cmpeq_epi8(group, _mm_set1_epi8(c));
+  return (std::uint32_t)_mm_movemask_epi8(cmp);
+#else
+  std::uint32_t mask = 0;
+  for(int i = 0; i < GROUP_WIDTH; i++)
+  {
+    if(ctrl[base + i] == c)
+    {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+// EMPTY and DELETED are the only negative control bytes, so their
+// sign bits are exactly the free slots
+template<typename K, typename V>
+std::uint32_t FlatHashMap<K,V>::match_free(int base) const
+{
+#if defined(__AVX2__)
+  __m256i group = _mm256_loadu_si256((const __m256i*)(ctrl + base));
+  return (std::uint32_t)_mm256_movemask_epi8(group);
+#elif defined(__SSE2__)
+  __m128i group = _mm_loadu_si128((const __m128i*)(ctrl + base));
+  return (std::uint32_t)_mm_movemask_epi8(group);
+#else
+  std::uint32_t mask = 0;
+  for(int i = 0; i < GROUP_WIDTH; i++)
+  {
+    if(ctrl[base + i] < 0)
+    {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+template<typename K, typename V>
+int FlatHashMap<K,V>::lowest_bit(std::uint32_t mask)
+{
+#if defined(__GNUC__)
+  return __builtin_ctz(mask);
+#else
+  int i = 0;
+  while((mask & 1u) == 0)
+  {
+    mask >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+// probes whole groups using triangular steps (1, 2, 3, ...), which
+// visits every group once since the group count is a power of two
+template<typename K, typename V>
+int FlatHashMap<K,V>::find_index(const K& key) const
+{
+  std::uint64_t h = hash(key);
+  signed char tag = (signed char)(h & 0x7F);
+  int groups = capacity / GROUP_WIDTH;
+  int g = (int)((h >> 7) & (groups - 1));
+  for(int step = 1; step <= groups; step++)
+  {
+    int base = g * GROUP_WIDTH;
+    std::uint32_t mask = match(base, tag);
+    while(mask != 0)
+    {
+      int index = base + lowest_bit(mask);
+      if(slots[index].first == key)
+      {
+        return index;
+      }
+      mask &= mask - 1;
+    }
+    if(match(base, EMPTY) != 0)
+    {
+      return -1;
+    }
+    g = (g + step) & (groups - 1);
+  }
+  return -1;
+}
+
+template<typename K, typename V>
+int FlatHashMap<K,V>::find_free_index(std::uint64_t h) const
+{
+  int groups = capacity / GROUP_WIDTH;
+  int g = (int)((h >> 7) & (groups - 1));
+  for(int step = 1; ; step++)
+  {
+    int base = g * GROUP_WIDTH;
+    std::uint32_t mask = match_free(base);
+    if(mask != 0)
+    {
+      return base + lowest_bit(mask);
+    }
+    g = (g + step) & (groups - 1);
+  }
+}
+
+// resize and rehash the table
+template<typename K, typename V>
+void FlatHashMap<K,V>::resize_and_rehash(int new_capacity)
+{
+  signed char* old_ctrl = ctrl;
+  std::pair<K,V>* old_slots = slots;
+  int old_capacity = capacity;
+  capacity = new_capacity;
+  init_table();
+  for(int i = 0; i < old_capacity; i++)
+  {
+    if(old_ctrl[i] >= 0)
+    {
+      std::uint64_t h = hash(old_slots[i].first);
+      int index = find_free_index(h);
+      ctrl[index] = (signed char)(h & 0x7F);
+      slots[index] = std::move(old_slots[i]);
+    }
+  }
+  deleted = 0;
+  delete[] old_ctrl;
+  delete[] old_slots;
+}
+
+// allocate the table with every slot EMPTY
+template<typename K, typename V>
+void FlatHashMap<K,V>::init_table()
+{
+  ctrl = new signed char[capacity];
+  slots = new std::pair<K,V>[capacity];
+  std::memset(ctrl, EMPTY, capacity);
+}
+
+#endif
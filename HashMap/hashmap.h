@@ -8,18 +8,31 @@
 #ifndef HASHMAP_H
 #define HASHMAP_H
 
+#include <algorithm>
+#include <vector>
 #include "map.h"
 #include "arrayseq.h"
+#include "nodepool.h"
+#include "hashpolicy.h"
 
 
-template<typename K, typename V>
-class HashMap : public Map<K,V>
+// NodeAlloc supplies the chain nodes (see nodepool.h) and Hash turns
+// keys into hash codes (see hashpolicy.h)
+template<typename K, typename V, template<typename> class NodeAlloc = HeapAlloc,
+         template<typename> class Hash = StdHash>
+class HashMap final : public Map<K,V>
 {
 public:
 
   // default constructor
   HashMap();
 
+  // constructor selecting the rehash mode. When incremental is true,
+  // growing the table keeps the old table live and moves a few of its
+  // buckets on each insert, erase, and (non-const) lookup instead of
+  // moving every chain at once.
+  HashMap(bool incremental);
+
   // copy constructor
   HashMap(const HashMap& rhs);
 
@@ -53,6 +66,15 @@ public:
   // Expects key to not exist in map prior to insertion.
   void insert(const K& key, const V& value);
 
+  // Same as above, but moves the key and value into the map
+  void insert(K&& key, V&& value);
+
+  // Adds the key with a value constructed from args unless the key is
+  // already in the collection, in which case args are left unused.
+  // Returns true if the key was added. The key is hashed once.
+  template<typename... Args>
+  bool try_emplace(const K& key, Args&&... args);
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -62,9 +84,27 @@ public:
   // Returns true if the key is in the collection, and false otherwise.
   bool contains(const K& key) const;
 
+  // Returns whether each of the keys is in the collection. The keys
+  // are looked up a group at a time so their cache misses overlap.
+  ArraySeq<bool> contains_many(const ArraySeq<K>& keys) const;
+
+  // Returns the values of the keys, looked up as in contains_many.
+  // Throws out_of_range if any key is not in the collection.
+  ArraySeq<V> get_many(const ArraySeq<K>& keys) const;
+
   // Returns the keys k in the collection such that k1 <= k <= k2
   ArraySeq<K> find_keys(const K& k1, const K& k2) const;
 
+  // Turns the ordered index on or off. When on, a sorted copy of the
+  // keys answers find_keys, sorted_keys, next_key and prev_key in
+  // O(log n + k) instead of a scan of every bucket. Inserts and erases
+  // stay O(1) and only mark the copy stale; the next ordered query
+  // rebuilds it in O(n log n).
+  void ordered_index(bool on);
+
+  // Returns true if the ordered index is on
+  bool ordered_index() const;
+
   // Returns the keys in the collection in ascending sorted order
   ArraySeq<K> sorted_keys() const;  
 
@@ -86,6 +126,13 @@ public:
   int min_chain_length() const;
   int max_chain_length() const;
   double avg_chain_length() const;
+
+  // Returns the chain-length histogram: entry i is the number of
+  // buckets holding i keys, up to the longest chain
+  ArraySeq<int> chain_histogram() const;
+
+  // Returns the node allocation counters
+  const AllocStats& alloc_stats() const;
   
 private:
 
@@ -108,20 +155,103 @@ private:
   // array of linked lists
   Node** table = new Node*[capacity];
 
+  // allocator for the chain nodes
+  NodeAlloc<Node> alloc;
+
+  // true if resizes are spread over later operations
+  bool incremental = false;
+
+  // number of old buckets moved per operation during a rehash (more
+  // than 4/3 finishes a rehash before the table next fills up)
+  const int rehash_buckets_per_op = 2;
+
+  // number of batched lookups whose buckets are fetched together
+  static const int PROBE_GROUP = 32;
+
+  // ordered index: the keys in ascending order, valid only while
+  // index_stale is false (rebuilt by const queries, hence mutable)
+  bool index_on = false;
+  mutable bool index_stale = true;
+  mutable std::vector<K> index_keys;
+
+  // the table being drained by an incremental rehash (nullptr when
+  // no rehash is in progress), its size, and the next bucket to move.
+  // Old bucket i splits into new buckets i and i + old_capacity, and
+  // both are only initialized once bucket i has been moved.
+  Node** old_table = nullptr;
+  int old_capacity = 0;
+  int rehash_index = 0;
+
   // the hash function
   int hash(const K& key) const;
 
+  // the hash function for a table of the given capacity
+  int hash(const K& key, int table_capacity) const;
+
   // resize and rehash the table
   void resize_and_rehash();
 
+  // grows the table (at once or incrementally) if it has reached the
+  // load factor threshold, returning true if it did
+  bool make_room();
+
+  // start an incremental rehash into a table twice the size
+  void start_rehash();
+
+  // move up to rehash_buckets_per_op buckets out of the old table
+  void rehash_step();
+
+  // link each node of the chain into the (current) table
+  void move_chain(Node* chain);
+
+  // returns the table whose bucket currently holds the chain for
+  // key (the old table until that bucket has been moved), setting
+  // index to the bucket
+  Node** table_for(const K& key, int& index) const;
+
+  // returns the node holding key, or nullptr if not found
+  Node* find_node(const K& key) const;
+
+  // unlinks and deletes the node for key from the given table
+  // bucket, returning false if the key is not in that bucket
+  bool erase_from(Node** tab, int index, const K& key);
+
   // initialize the table to all nullptr
   void init_table();
+
+  // the number of buckets across the table and the old table, and
+  // the chain at index i of that combined range (for full scans)
+  int bucket_count() const;
+  Node* bucket(int i) const;
+
+  // shared body of the insert overloads, forwarding key and value
+  // into the new entry
+  template<typename KK, typename VV>
+  void insert_pair(KK&& key, VV&& value);
+
+  // calls f(i, value) for each keys[i], with value nullptr if the key
+  // is not in the map
+  template<typename F>
+  void find_many(const ArraySeq<K>& keys, F f) const;
+
+  // returns the ordered index, rebuilding it first if it is stale
+  const std::vector<K>& sorted_index() const;
   
 };
 
 //constructor just initializes table
-template<typename K, typename V>
-HashMap<K,V>::HashMap()
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>::HashMap()
+{
+  init_table();
+}
+
+// constructor selecting the rehash mode
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>::HashMap(bool incremental)
+  : incremental(incremental)
 {
   init_table();
 }
@@ -131,66 +261,61 @@ HashMap<K,V>::HashMap()
 //       below.
 
 // copy constructor
-template<typename K, typename V>
-HashMap<K,V>::HashMap(const HashMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>::HashMap(const HashMap& rhs)
 {
   init_table();
   *this = rhs;
 }
 
 // move constructor
-template<typename K, typename V>
-HashMap<K,V>::HashMap(HashMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>::HashMap(HashMap&& rhs)
 {
   init_table();
   *this = std::move(rhs);
 }
 
 // copy assignment
-template<typename K, typename V>
-HashMap<K,V>& HashMap<K,V>::operator=(const HashMap& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>& HashMap<K,V,NodeAlloc,Hash>::operator=(const HashMap& rhs)
 {
   if(this != &rhs)
   {
     clear();
     delete[] table;
-    Node** temp_table = new Node*[rhs.capacity];
-    Node* temp = nullptr;
-    Node* holder;
     capacity = rhs.capacity;
     count = rhs.count;
+    incremental = rhs.incremental;
+    index_on = rhs.index_on;
+    table = new Node*[capacity];
+    init_table();
+    // nodes still in an old table are rehashed into the copy
+    for(int i = 0; i < rhs.bucket_count(); i++)
     {
-      table = temp_table;
-      init_table();
-      for(int i = 0; i < rhs.capacity; i++)
+      Node* temp = rhs.bucket(i);
+      while(temp != nullptr)
       {
-        temp = rhs.table[i];
-        while(temp != nullptr)
-        {
-          holder = new Node();
-          holder -> key = temp -> key;
-          holder -> value = temp -> value;
-          holder -> next = temp -> next;
-          if(table[i] == nullptr)
-          {
-            table[i] = holder;
-          }
-          else
-          {
-            holder -> next = table[i];
-            table[i] = holder;
-          }
-          temp = temp -> next;
-        }
+        Node* holder = alloc.make();
+        int index = hash(temp -> key);
+        holder -> key = temp -> key;
+        holder -> value = temp -> value;
+        holder -> next = table[index];
+        table[index] = holder;
+        temp = temp -> next;
       }
     }
   }
-  
+  return *this;
 }
 
 // move assignment
-template<typename K, typename V>
-HashMap<K,V>& HashMap<K,V>::operator=(HashMap&& rhs)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>& HashMap<K,V,NodeAlloc,Hash>::operator=(HashMap&& rhs)
 {
   if(this != &rhs)
   {
@@ -199,163 +324,236 @@ HashMap<K,V>& HashMap<K,V>::operator=(HashMap&& rhs)
     table = rhs.table;
     count = rhs.count;
     capacity = rhs.capacity;
+    incremental = rhs.incremental;
+    old_table = rhs.old_table;
+    old_capacity = rhs.old_capacity;
+    rehash_index = rhs.rehash_index;
+    index_on = rhs.index_on;
+    index_stale = rhs.index_stale;
+    index_keys.swap(rhs.index_keys);
+    alloc.swap(rhs.alloc);
     rhs.table = new Node*[16];
     rhs.count = 0;
     rhs.capacity = 16;
+    rhs.old_table = nullptr;
+    rhs.old_capacity = 0;
+    rhs.rehash_index = 0;
+    rhs.index_stale = true;
     rhs.init_table();
-    return *this;
   }
+  return *this;
 }  
 
 // destructor
-template<typename K, typename V>
-HashMap<K,V>::~HashMap()
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+HashMap<K,V,NodeAlloc,Hash>::~HashMap()
 {
   clear();
   delete[] table;
 }
 
 // Returns the number of key-value pairs in the map
-template<typename K, typename V>
-int HashMap<K,V>::size() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::size() const
 {
   return count;
 }
 
 // Tests if the map is empty
-template<typename K, typename V>
-bool HashMap<K,V>::empty() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::empty() const
 {
   return size() == 0;
 }
 
 // Allows values associated with a key to be updated. Throws
 // out_of_range if the given key is not in the collection.
-template<typename K, typename V>
-V& HashMap<K,V>::operator[](const K& key)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+V& HashMap<K,V,NodeAlloc,Hash>::operator[](const K& key)
 {
-  int index = hash(key);
-  Node* temp = table[index];
-  while(temp != nullptr)
+  rehash_step();
+  Node* temp = find_node(key);
+  if(temp == nullptr)
   {
-    if(temp -> key == key)
-    {
-      return temp -> value;
-    }
-    
-    temp = temp -> next;
+    throw(std::out_of_range("HashMap<K,V>::operator[](const K& key)"));
   }
-  throw(std::out_of_range("HashMap<K,V>::operator[](const K& key)"));
+  return temp -> value;
 }
 
 // Returns the value for a given key. Throws out_of_range if the
 // given key is not in the collection.
-template<typename K, typename V> 
-const V& HashMap<K,V>::operator[](const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+const V& HashMap<K,V,NodeAlloc,Hash>::operator[](const K& key) const
 {
-  int index = hash(key);
-  Node* temp = table[index];
-  while(temp != nullptr)
+  Node* temp = find_node(key);
+  if(temp == nullptr)
   {
-    if(temp -> key == key)
-    {
-      return temp -> value;
-    }
-    
-    temp = temp -> next;
+    throw(std::out_of_range("HashMap<K,V>::operator[](const K& key)"));
   }
-  throw(std::out_of_range("HashMap<K,V>::operator[](const K& key)"));
+  return temp -> value;
 }
 
 // Extends the collection by adding the given key-value pair.
 // Expects key to not exist in map prior to insertion.
-template<typename K, typename V>
-void HashMap<K,V>::insert(const K& key, const V& value)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::insert(const K& key, const V& value)
 {
-  if(count/capacity >= load_factor_threshold)
+  insert_pair(key, value);
+}
+
+// Same as above, but moves the key and value into the map
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::insert(K&& key, V&& value)
+{
+  insert_pair(std::move(key), std::move(value));
+}
+
+// Shared insert body. The key is forwarded only once it is no longer
+// needed for placement.
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+template<typename KK, typename VV>
+void HashMap<K,V,NodeAlloc,Hash>::insert_pair(KK&& key, VV&& value)
+{
+  rehash_step();
+  make_room();
+  int index;
+  Node** tab = table_for(key, index);
+  Node* temp = alloc.make();
+  temp -> key = std::forward<KK>(key);
+  temp -> value = std::forward<VV>(value);
+  temp -> next = tab[index];
+  tab[index] = temp;
+  count++;
+  index_stale = true;
+}
+
+// Adds the key with a value constructed from args unless the key is
+// already in the collection. The key's chain is searched and, when
+// the table does not grow, linked into without hashing again.
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+template<typename... Args>
+bool HashMap<K,V,NodeAlloc,Hash>::try_emplace(const K& key, Args&&... args)
+{
+  rehash_step();
+  int index;
+  Node** tab = table_for(key, index);
+  for(Node* temp = tab[index]; temp != nullptr; temp = temp -> next)
   {
-    resize_and_rehash();
+    if(temp -> key == key)
+    {
+      return false;
+    }
   }
-  int index = hash(key);
-  Node* temp = new Node();
+  if(make_room())
+  {
+    tab = table_for(key, index);
+  }
+  Node* temp = alloc.make();
   temp -> key = key;
-  temp -> value = value;
-  temp -> next = table[index];
-  table[index] = temp;
+  temp -> value = V(std::forward<Args>(args)...);
+  temp -> next = tab[index];
+  tab[index] = temp;
   count++;
+  index_stale = true;
+  return true;
 }
 
 // Shrinks the collection by removing the key-value pair with the
 // given key. Does not modify the collection if the collection does
 // not contain the key. Throws out_of_range if the given key is not
 // in the collection.
-template<typename K, typename V>
-void HashMap<K,V>::erase(const K& key)
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::erase(const K& key)
 {
-  int index = hash(key);
-  Node* temp = table[index];
-  Node* prev = nullptr;
-  if(temp == nullptr)
-  {
-    throw(std::out_of_range("HashMap<K,V>::erase(const K& key)"));
-  }
-  if(temp -> key == key)
+  rehash_step();
+  int index;
+  Node** tab = table_for(key, index);
+  if(erase_from(tab, index, key))
   {
-    table[index] = table[index] -> next;
-    delete temp;
-    count--;
+    index_stale = true;
     return;
   }
-  prev = temp;
-  temp = temp -> next;
-  while(temp != nullptr)
-  {
-    if(temp -> key == key)
-    {
-      prev -> next = temp -> next;
-      delete temp;
-      count--;
-      delete prev;
-      return;
-    }
-    
-    temp = temp -> next;
-    prev = prev -> next;
-  }
   throw(std::out_of_range("HashMap<K,V>::erase(const K& key)"));
 }
 
 // Returns true if the key is in the collection, and false otherwise.
-template<typename K, typename V>
-bool HashMap<K,V>::contains(const K& key) const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::contains(const K& key) const
 {
-  int index = hash(key);
-  Node* temp = table[index];
-  while(temp != nullptr)
+  return find_node(key) != nullptr;
+}
+
+// Returns whether each of the keys is in the collection
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<bool> HashMap<K,V,NodeAlloc,Hash>::contains_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<bool> found;
+  for(int i = 0; i < keys.size(); i++)
   {
-    if(temp -> key == key)
-    {
-      return true;
-    }
-    
-    temp = temp -> next;
+    found.insert(false, i);
   }
+  find_many(keys, [&](int i, const V* value) {
+    found[i] = value != nullptr;
+  });
+  return found;
+}
 
-  return false;
+// Returns the values of the keys. Throws out_of_range if any key is
+// not in the collection.
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<V> HashMap<K,V,NodeAlloc,Hash>::get_many(const ArraySeq<K>& keys) const
+{
+  ArraySeq<V> values;
+  for(int i = 0; i < keys.size(); i++)
+  {
+    values.insert(V(), i);
+  }
+  find_many(keys, [&](int i, const V* value) {
+    if(value == nullptr)
+    {
+      throw(std::out_of_range("HashMap<K,V>::get_many(const ArraySeq<K>&)"));
+    }
+    values[i] = *value;
+  });
+  return values;
 }
 
 // Returns the keys k in the collection such that k1 <= k <= k2
-template<typename K, typename V>
-ArraySeq<K> HashMap<K,V>::find_keys(const K& k1, const K& k2) const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<K> HashMap<K,V,NodeAlloc,Hash>::find_keys(const K& k1, const K& k2) const
 {
-  int index1 = hash(k1);
-  int index2 = hash(k2);
   Node* temp = nullptr;
   ArraySeq<K> seq;
 
-  for(int i = index1; i <= index2 && i < capacity; i++)
+  if(index_on)
   {
-    temp = table[i];
+    const std::vector<K>& keys = sorted_index();
+    auto it = std::lower_bound(keys.begin(), keys.end(), k1);
+    for(; it != keys.end() && !(k2 < *it); ++it)
+    {
+      seq.insert(*it, seq.size());
+    }
+    return seq;
+  }
+
+  // hashing does not preserve order, so every bucket is checked
+  for(int i = 0; i < bucket_count(); i++)
+  {
+    temp = bucket(i);
     while(temp!=nullptr)
     {
       if(temp -> key >= k1 && temp -> key <= k2)
@@ -370,14 +568,23 @@ ArraySeq<K> HashMap<K,V>::find_keys(const K& k1, const K& k2) const
 }
 
 // Returns the keys in the collection in ascending sorted order
-template<typename K, typename V>
-ArraySeq<K> HashMap<K,V>::sorted_keys() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<K> HashMap<K,V,NodeAlloc,Hash>::sorted_keys() const
 {
   ArraySeq<K> seq;
   Node* temp = nullptr;
-  for(int i = 0; i < capacity; i++)
+  if(index_on)
+  {
+    for(const K& key : sorted_index())
+    {
+      seq.insert(key, seq.size());
+    }
+    return seq;
+  }
+  for(int i = 0; i < bucket_count(); i++)
   {
-    temp = table[i];
+    temp = bucket(i);
     while(temp != nullptr)
     {
       seq.insert(temp -> key, seq.size());
@@ -391,14 +598,26 @@ ArraySeq<K> HashMap<K,V>::sorted_keys() const
 // Gives the key (as an ouptput parameter) immediately after the
 // given key according to ascending sort order. Returns true if a
 // successor key exists, and false otherwise.
-template<typename K, typename V>
-bool HashMap<K,V>::next_key(const K& key, K& next_key) const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::next_key(const K& key, K& next_key) const
 {
   Node* temp = nullptr;
   bool found = false;
-  for(int i = 0; i < capacity; i++)
+  if(index_on)
+  {
+    const std::vector<K>& keys = sorted_index();
+    auto it = std::upper_bound(keys.begin(), keys.end(), key);
+    if(it == keys.end())
+    {
+      return false;
+    }
+    next_key = *it;
+    return true;
+  }
+  for(int i = 0; i < bucket_count(); i++)
   {
-    temp = table[i];
+    temp = bucket(i);
     while(temp != nullptr)
     {
       if(found == false)
@@ -425,14 +644,26 @@ bool HashMap<K,V>::next_key(const K& key, K& next_key) const
 // Gives the key (as an ouptput parameter) immediately before the
 // given key according to ascending sort order. Returns true if a
 // predecessor key exists, and false otherwise.
-template<typename K, typename V>
-bool HashMap<K,V>::prev_key(const K& key, K& next_key) const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::prev_key(const K& key, K& next_key) const
 {
   Node* temp = nullptr;
   bool found = false;
-  for(int i = 0; i < capacity; i++)
+  if(index_on)
+  {
+    const std::vector<K>& keys = sorted_index();
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    if(it == keys.begin())
+    {
+      return false;
+    }
+    next_key = *(it - 1);
+    return true;
+  }
+  for(int i = 0; i < bucket_count(); i++)
   {
-    temp = table[i];
+    temp = bucket(i);
     while(temp != nullptr)
     {
       if(found == false)
@@ -456,37 +687,68 @@ bool HashMap<K,V>::prev_key(const K& key, K& next_key) const
   return found;
 }
 
+// Turns the ordered index on or off
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::ordered_index(bool on)
+{
+  index_on = on;
+  index_stale = true;
+  index_keys = std::vector<K>();
+}
+
+// Returns true if the ordered index is on
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::ordered_index() const
+{
+  return index_on;
+}
+
 // Removes all key-value pairs from the map. Does not change the
 // current capacity of the table.
-template<typename K, typename V>
-void HashMap<K,V>::clear()
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::clear()
 {
   Node* temp = nullptr;
   Node* next = nullptr;
-  for(int i = 0; i < capacity; i++)
+  // a pool can drop all of its nodes at once
+  if(!NodeAlloc<Node>::bulk_release)
   {
-    temp = table[i];
-    while(temp != nullptr)
+    for(int i = 0; i < bucket_count(); i++)
     {
-      next = temp -> next;
-      delete temp;
-      temp = next;
+      temp = bucket(i);
+      while(temp != nullptr)
+      {
+        next = temp -> next;
+        alloc.destroy(temp);
+        temp = next;
+      }
     }
   }
+  alloc.release_all();
+  delete[] old_table;
+  old_table = nullptr;
+  old_capacity = 0;
+  rehash_index = 0;
+  init_table();
   count = 0;
+  index_stale = true;
 }
 
 // statistics functions for the hash table implementation
-template<typename K, typename V>
-int HashMap<K,V>::min_chain_length() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::min_chain_length() const
 {
   int min = count;
   int temp_min;
   Node* temp;
-  for(int i = 0; i < capacity; i++)
+  for(int i = 0; i < bucket_count(); i++)
   {
     temp_min = 0;
-    temp = table[i];
+    temp = bucket(i);
     while(temp != nullptr)
     {
       temp = temp -> next;
@@ -500,16 +762,17 @@ int HashMap<K,V>::min_chain_length() const
   return min;
 }
 
-template<typename K, typename V>
-int HashMap<K,V>::max_chain_length() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::max_chain_length() const
 {
   int max = 0;
   int temp_max;
   Node* temp;
-  for(int i = 0; i < capacity; i++)
+  for(int i = 0; i < bucket_count(); i++)
   {
     temp_max = 0;
-    temp = table[i];
+    temp = bucket(i);
     while(temp != nullptr)
     {
       temp = temp -> next;
@@ -523,15 +786,16 @@ int HashMap<K,V>::max_chain_length() const
   return max;
 }
 
-template<typename K, typename V>
-double HashMap<K,V>::avg_chain_length() const
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+double HashMap<K,V,NodeAlloc,Hash>::avg_chain_length() const
 {
   int total = 0;
   int chain_count = 0;
   Node* temp;
-  for(int i = 0; i < capacity; i++)
+  for(int i = 0; i < bucket_count(); i++)
   {
-    temp = table[i];
+    temp = bucket(i);
     if(temp != nullptr)
     {
       chain_count++;
@@ -549,19 +813,83 @@ double HashMap<K,V>::avg_chain_length() const
   return total/1.0/chain_count;
 }
 
-template<typename K, typename V>
-int HashMap<K,V>::hash(const K& key) const
+// Returns the chain-length histogram
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+ArraySeq<int> HashMap<K,V,NodeAlloc,Hash>::chain_histogram() const
 {
-  std::hash<K> hash_code;
-  int code = hash_code(key);
-  return code % capacity;
+  ArraySeq<int> histogram;
+  for(int i = 0; i < bucket_count(); i++)
+  {
+    int length = 0;
+    for(Node* temp = bucket(i); temp != nullptr; temp = temp -> next)
+    {
+      length++;
+    }
+    while(histogram.size() <= length)
+    {
+      histogram.insert(0, histogram.size());
+    }
+    histogram[length]++;
+  }
+  return histogram;
+}
+
+// Returns the node allocation counters
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+const AllocStats& HashMap<K,V,NodeAlloc,Hash>::alloc_stats() const
+{
+  return alloc.stats();
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::hash(const K& key) const
+{
+  return hash(key, capacity);
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::hash(const K& key, int table_capacity) const
+{
+  // the capacity is always a power of two, so the low bits of the
+  // code are the index
+  return Hash<K>()(key) & (table_capacity - 1);
+}
+
+// grow the table once it reaches the load factor threshold
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::make_room()
+{
+  if(count/1.0/capacity < load_factor_threshold)
+  {
+    return false;
+  }
+  if(incremental)
+  {
+    start_rehash();
+  }
+  else
+  {
+    resize_and_rehash();
+  }
+  return true;
 }
 
 // resize and rehash the table
 
-template<typename K, typename V>
-void HashMap<K,V>::resize_and_rehash()
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::resize_and_rehash()
 {
+  // finish any incremental rehash before moving everything
+  while(old_table != nullptr)
+  {
+    rehash_step();
+  }
   capacity = capacity * 2;
   Node** temp_table = new Node*[capacity];
   for(int i = 0; i < capacity; i++)
@@ -594,8 +922,9 @@ void HashMap<K,V>::resize_and_rehash()
 
 // initialize the table to all nullptr
 
-template<typename K, typename V>
-void HashMap<K,V>::init_table()
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::init_table()
 {
   for(int i = 0; i < capacity; i++)
   {
@@ -603,4 +932,224 @@ void HashMap<K,V>::init_table()
   }
 }
 
+// start an incremental rehash: the current table becomes the old
+// table and new inserts go to a table twice the size
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::start_rehash()
+{
+  // the previous rehash must be done before starting another one
+  while(old_table != nullptr)
+  {
+    rehash_step();
+  }
+  old_table = table;
+  old_capacity = capacity;
+  rehash_index = 0;
+  capacity = capacity * 2;
+  // left uninitialized: buckets are cleared as they are moved into,
+  // which also spreads the cost of first touching the new memory
+  table = new Node*[capacity];
+}
+
+// move a bounded number of buckets from the old table
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::rehash_step()
+{
+  if(old_table == nullptr)
+  {
+    return;
+  }
+  for(int i = 0; i < rehash_buckets_per_op && rehash_index < old_capacity; i++)
+  {
+    table[rehash_index] = nullptr;
+    table[rehash_index + old_capacity] = nullptr;
+    move_chain(old_table[rehash_index]);
+    old_table[rehash_index] = nullptr;
+    rehash_index++;
+  }
+  if(rehash_index == old_capacity)
+  {
+    delete[] old_table;
+    old_table = nullptr;
+    old_capacity = 0;
+    rehash_index = 0;
+  }
+}
+
+// relink the nodes of a chain into the current table
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+void HashMap<K,V,NodeAlloc,Hash>::move_chain(Node* chain)
+{
+  while(chain != nullptr)
+  {
+    Node* holder = chain;
+    chain = chain -> next;
+    int index = hash(holder -> key);
+    holder -> next = table[index];
+    table[index] = holder;
+  }
+}
+
+// the table owning a key's bucket
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+typename HashMap<K,V,NodeAlloc,Hash>::Node** HashMap<K,V,NodeAlloc,Hash>::table_for(const K& key, int& index) const
+{
+  if(old_table != nullptr)
+  {
+    index = hash(key, old_capacity);
+    if(index >= rehash_index)
+    {
+      return old_table;
+    }
+  }
+  index = hash(key);
+  return table;
+}
+
+// find the node for a key
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+typename HashMap<K,V,NodeAlloc,Hash>::Node* HashMap<K,V,NodeAlloc,Hash>::find_node(const K& key) const
+{
+  int index;
+  Node* temp = table_for(key, index)[index];
+  while(temp != nullptr)
+  {
+    if(temp -> key == key)
+    {
+      return temp;
+    }
+    temp = temp -> next;
+  }
+  return nullptr;
+}
+
+// batched lookup, PROBE_GROUP keys at a time in three passes: find
+// each key's bucket and prefetch the slot, read each chain head and
+// prefetch the node, then walk the chains. A lookup's misses overlap
+// with the rest of its group's instead of being paid one at a time.
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+template<typename F>
+void HashMap<K,V,NodeAlloc,Hash>::find_many(const ArraySeq<K>& keys, F f) const
+{
+  Node* const* slots[PROBE_GROUP];
+  Node* heads[PROBE_GROUP];
+  for(int start = 0; start < keys.size(); start += PROBE_GROUP)
+  {
+    int n = keys.size() - start < PROBE_GROUP ? keys.size() - start : PROBE_GROUP;
+    for(int i = 0; i < n; i++)
+    {
+      int index;
+      slots[i] = table_for(keys[start + i], index) + index;
+      __builtin_prefetch(slots[i]);
+    }
+    for(int i = 0; i < n; i++)
+    {
+      heads[i] = *slots[i];
+      if(heads[i] != nullptr)
+      {
+        __builtin_prefetch(heads[i]);
+      }
+    }
+    for(int i = 0; i < n; i++)
+    {
+      Node* temp = heads[i];
+      while(temp != nullptr && !(temp -> key == keys[start + i]))
+      {
+        temp = temp -> next;
+      }
+      f(start + i, temp == nullptr ? nullptr : &temp -> value);
+    }
+  }
+}
+
+// unlink and delete the node for a key from one bucket
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+bool HashMap<K,V,NodeAlloc,Hash>::erase_from(Node** tab, int index, const K& key)
+{
+  Node* temp = tab[index];
+  Node* prev = nullptr;
+  while(temp != nullptr)
+  {
+    if(temp -> key == key)
+    {
+      if(prev == nullptr)
+      {
+        tab[index] = temp -> next;
+      }
+      else
+      {
+        prev -> next = temp -> next;
+      }
+      alloc.destroy(temp);
+      count--;
+      return true;
+    }
+    prev = temp;
+    temp = temp -> next;
+  }
+  return false;
+}
+
+// buckets of the table followed by those of the old table
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+int HashMap<K,V,NodeAlloc,Hash>::bucket_count() const
+{
+  return capacity + old_capacity;
+}
+
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+typename HashMap<K,V,NodeAlloc,Hash>::Node* HashMap<K,V,NodeAlloc,Hash>::bucket(int i) const
+{
+  if(i >= capacity)
+  {
+    return old_table[i - capacity];
+  }
+  if(old_table != nullptr && i % old_capacity >= rehash_index)
+  {
+    // not yet initialized
+    return nullptr;
+  }
+  return table[i];
+}
+
+// collects the keys from every bucket and sorts them when the index
+// is stale
+template<typename K, typename V, template<typename> class NodeAlloc,
+         template<typename> class Hash>
+const std::vector<K>& HashMap<K,V,NodeAlloc,Hash>::sorted_index() const
+{
+  if(index_stale)
+  {
+    index_keys.clear();
+    index_keys.reserve(count);
+    for(int i = 0; i < bucket_count(); i++)
+    {
+      for(Node* temp = bucket(i); temp != nullptr; temp = temp -> next)
+      {
+        index_keys.push_back(temp -> key);
+      }
+    }
+    std::sort(index_keys.begin(), index_keys.end());
+    index_stale = false;
+  }
+  return index_keys;
+}
+
 #endif
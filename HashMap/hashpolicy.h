@@ -0,0 +1,59 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: hashpolicy.h
+// DATE: Spring 2022
+// DESC: hash policies for HashMap. Each turns a key into a 64-bit
+//       code whose low bits pick the bucket (the table size is a
+//       power of two, so the index is code & (capacity - 1)).
+//       StdHash passes std::hash through unchanged, which for
+//       integers is the identity; the others mix its result so that
+//       every bit of the key reaches the low bits.
+//---------------------------------------------------------------------------
+
+#ifndef HASHPOLICY_H
+#define HASHPOLICY_H
+
+#include <cstdint>
+#include <functional>
+
+
+// std::hash as is (the identity for integers)
+template<typename K>
+struct StdHash
+{
+  std::uint64_t operator()(const K& key) const
+  {
+    return std::hash<K>()(key);
+  }
+};
+
+
+// Fibonacci (multiplicative) hashing: multiply by 2^64 / golden ratio
+// and keep the high half, where the product's best mixed bits are
+template<typename K>
+struct FibonacciHash
+{
+  std::uint64_t operator()(const K& key) const
+  {
+    std::uint64_t code = std::hash<K>()(key);
+    return (code * 0x9e3779b97f4a7c15ull) >> 32;
+  }
+};
+
+
+// the wyhash mixer: a 64x64 -> 128-bit multiply of the code with
+// two constants, folded by xoring the high and low halves
+template<typename K>
+struct WyHash
+{
+  std::uint64_t operator()(const K& key) const
+  {
+    std::uint64_t code = std::hash<K>()(key);
+    unsigned __int128 product = (unsigned __int128) (code ^ 0xa0761d6478bd642full)
+                                * 0xe7037ed1a0b428dbull;
+    return (std::uint64_t) product ^ (std::uint64_t) (product >> 64);
+  }
+};
+
+
+#endif
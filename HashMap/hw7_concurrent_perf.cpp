@@ -0,0 +1,132 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: hw7_concurrent_perf.cpp
+// DATE: Spring 2022
+// DESC: Multi-threaded throughput driver for ConcurrentHashMap and
+//       LockFreeHashMap. To run from the command line use:
+//          ./hw7_concurrent_perf
+//       which prints, for each thread count and read percentage, the
+//       millions of operations per second of the sharded map, of the
+//       lock-free map, and of a HashMap behind one lock. Lines
+//       starting with # are comments.
+//---------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <random>
+#include <cassert>
+#include "arrayseq.h"
+#include "hashmap.h"
+#include "concurrenthashmap.h"
+#include "lockfreehashmap.h"
+
+
+using namespace std;
+using namespace std::chrono;
+
+// a HashMap behind one reader/writer lock, for comparison
+class LockedHashMap
+{
+public:
+  bool contains(int key) const
+  {
+    shared_lock<shared_mutex> guard(lock);
+    return map.contains(key);
+  }
+  void insert(int key, int value)
+  {
+    unique_lock<shared_mutex> guard(lock);
+    map.insert(key, value);
+  }
+  void erase(int key)
+  {
+    unique_lock<shared_mutex> guard(lock);
+    map.erase(key);
+  }
+private:
+  mutable shared_mutex lock;
+  HashMap<int,int> map;
+};
+
+template<typename M>
+double throughput(int threads, int read_pct);
+
+// test parameters
+const int preload = 1000000;
+const int ops_per_thread = 200000;
+
+
+int main(int argc, char* argv[])
+{
+  cout << fixed << showpoint;
+  cout << setprecision(2);
+
+  cout << "# Throughput in millions of operations per second" << endl;
+  cout << "# Map preloaded with " << preload << " even keys; each write "
+       << "inserts and then erases an odd key" << endl;
+  cout << "# hardware threads: " << thread::hardware_concurrency() << endl;
+  cout << "# Column 1 = threads" << endl;
+  cout << "# Column 2 = read percentage" << endl;
+  cout << "# Column 3 = sharded map (64 shards)" << endl;
+  cout << "# Column 4 = lock-free (split-ordered list)" << endl;
+  cout << "# Column 5 = one lock" << endl;
+
+  for (int threads = 1; threads <= 64; threads *= 2) {
+    for (int read_pct : {50, 90, 99, 100}) {
+      cout << threads << " " << read_pct << " "
+           << throughput<ConcurrentHashMap<int,int>>(threads, read_pct) << " "
+           << throughput<LockFreeHashMap<int,int>>(threads, read_pct) << " "
+           << throughput<LockedHashMap>(threads, read_pct) << endl;
+    }
+  }
+}
+
+
+// runs ops_per_thread operations on each of the given number of
+// threads against a preloaded map, read_pct percent of them contains
+// calls and the rest an insert followed by an erase
+template<typename M>
+double throughput(int threads, int read_pct)
+{
+  M m;
+  for (int i = 0; i < preload; ++i)
+    m.insert(i * 2, i);
+  vector<thread> workers;
+  vector<long> hits(threads * 8);
+  auto t0 = high_resolution_clock::now();
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&m, &hits, t, threads, read_pct] {
+      mt19937 gen(t + 1);
+      uniform_int_distribution<int> key_dist(0, preload - 1);
+      uniform_int_distribution<int> pct_dist(0, 99);
+      long found = 0;
+      for (int i = 0; i < ops_per_thread; ++i) {
+        int key = key_dist(gen);
+        if (pct_dist(gen) < read_pct)
+          found += m.contains(key * 2);
+        else {
+          // odd keys owned by this thread, so no two threads collide
+          int odd = (key / threads * threads + t) * 2 + 1;
+          m.insert(odd, i);
+          m.erase(odd);
+        }
+      }
+      // spaced out so the threads do not share a cache line
+      hits[t * 8] = found;
+    });
+  }
+  for (thread& worker : workers)
+    worker.join();
+  auto t1 = high_resolution_clock::now();
+  long total = 0;
+  for (int t = 0; t < threads; ++t)
+    total += hits[t * 8];
+  assert(total <= (long) threads * ops_per_thread);
+  double secs = duration_cast<microseconds>(t1 - t0).count() / 1e6;
+  return threads * (double) ops_per_thread / secs / 1e6;
+}
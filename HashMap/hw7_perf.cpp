@@ -19,17 +19,45 @@
 #include <functional>
 #include <vector>
 #include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <algorithm>
+#include <random>
 #include "util.h"
 #include "arrayseq.h"
 #include "map.h"
 #include "arraymap.h"
 #include "binsearchmap.h"
 #include "hashmap.h"
+#include "flathashmap.h"
 
 
 using namespace std;
 using namespace std::chrono;
 
+// heap allocations made so far, counted by the replacement operator
+// new below (array new and the deletes forward to these)
+long heap_allocs = 0;
+
+void* operator new(std::size_t size)
+{
+  ++heap_allocs;
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
 // NOTE: all data is "shuffled"
 
 double timed_insert(Map<int,int>& m, int key);
@@ -38,12 +66,26 @@ double timed_contains(const Map<int,int>& m, int key);
 double timed_find_range(const Map<int,int>& m, int key1, int key2);
 double timed_next_key(const Map<int,int>& m, int key); 
 double timed_sorted_keys(const Map<int,int>& m);
+double bulk_insert(Map<int,int>& m, const ArraySeq<int>& keys);
+double bulk_contains(const Map<int,int>& m, const ArraySeq<int>& keys);
+void insert_latencies(Map<int,int>& m, const ArraySeq<int>& keys);
+template<typename M>
+void alloc_row(const string& label, const ArraySeq<int>& keys, int n);
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n);
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys);
+void ordered_row(HashMap<int,int>& m, const ArraySeq<int>& keys);
+template<template<typename> class Hash>
+void policy_row(const string& label, const ArraySeq<int>& keys, int n);
 
 // test parameters
 const int start = 0;
 const int step = 5000;
 const int stop = 50000;
 const int runs = 3;
+const int bulk_n = 2000000;
+const int string_n = 200000;
 
 
 int main(int argc, char* argv[])
@@ -83,6 +125,14 @@ int main(int argc, char* argv[])
   cout << "# Column 20 = min chain length" << endl;
   cout << "# Column 21 = max chain length" << endl;  
   cout << "# Column 22 = avg chain length" << endl;  
+
+  cout << "# Column 23 = flat hash map insert" << endl;
+  cout << "# Column 24 = flat hash map erase" << endl;
+  cout << "# Column 25 = flat hash map contains" << endl;
+  cout << "# Column 26 = flat hash map find range" << endl;
+  cout << "# Column 27 = flat hash map next key" << endl;
+  cout << "# Column 28 = flat hash map sorted keys" << endl;
+  cout << "# Column 29 = flat hash map avg probe length" << endl;
   
   // generate shuffled data
   ArraySeq<int> keys, vals;
@@ -99,10 +149,12 @@ int main(int argc, char* argv[])
     BinSearchMap<int,int> m1;
     ArrayMap<int,int> m2;
     HashMap<int,int> m3;
+    FlatHashMap<int,int> m4;
     for (int i = 0; i < n; ++i) {
       m1.insert(keys[i], vals[i]);
       m2.insert(keys[i], vals[i]);
       m3.insert(keys[i], vals[i]);
+      m4.insert(keys[i], vals[i]);
     }
 
     int min = 2;
@@ -168,10 +220,101 @@ int main(int argc, char* argv[])
     cout << c21 << " " << flush;
     double c22 = m3.avg_chain_length();
     cout << c22 << " " << flush;    
+
+    // flat (open addressing) hash map
+    double c23 = timed_insert(m4, med + 1);
+    cout << c23 << " " << flush;
+    double c24 = timed_erase(m4, med + 1);
+    cout << c24 << " " << flush;
+    assert(m4.size() == n);
+    double c25 = timed_contains(m4, max + 1);
+    cout << c25 << " " << flush;
+    double c26 = timed_find_range(m4, med, med + (n/20));
+    cout << c26 << " " << flush;
+    double c27 = timed_next_key(m4, med);
+    cout << c27 << " " << flush;
+    double c28 = timed_sorted_keys(m4);
+    cout << c28 << " " << flush;
+    double c29 = m4.avg_probe_length();
+    cout << c29 << " " << flush;
     
     cout << endl;
   }
-  
+
+  // bulk throughput (comment lines so the plot script skips them)
+  ArraySeq<int> bulk_keys;
+  for (int i = 0; i < bulk_n; ++i)
+    bulk_keys.insert(i * 2, i);
+  faro_shuffle(bulk_keys, 3);
+  HashMap<int,int> chained;
+  FlatHashMap<int,int> flat;
+  cout << "# bulk " << bulk_n << " keys (msec): chained insert, flat insert, "
+       << "chained contains, flat contains" << endl;
+  cout << "# " << bulk_insert(chained, bulk_keys) << " " << flush;
+  cout << bulk_insert(flat, bulk_keys) << " " << flush;
+  cout << bulk_contains(chained, bulk_keys) << " " << flush;
+  cout << bulk_contains(flat, bulk_keys) << endl;
+
+  // per-insert tail latency, stop-the-world vs incremental rehash
+  HashMap<int,int> full_rehash;
+  HashMap<int,int> incremental_rehash(true);
+  cout << "# insert latency over " << bulk_n << " keys (usec): "
+       << "p50, p99, p999, max" << endl;
+  cout << "# stop-the-world ";
+  insert_latencies(full_rehash, bulk_keys);
+  cout << "# incremental ";
+  insert_latencies(incremental_rehash, bulk_keys);
+
+  // heap vs pool node allocation
+  cout << "# node allocation over " << bulk_n << " keys (msec): load, "
+       << "erase+reinsert half, clear, nodes, system allocations" << endl;
+  alloc_row<HashMap<int,int>>("heap", bulk_keys, bulk_n);
+  alloc_row<HashMap<int,int,PoolAlloc>>("pool", bulk_keys, bulk_n);
+
+  // contains one key at a time vs contains_many in batches
+  cout << "# batched contains of " << bulk_n << " keys (msec): one at a time, "
+       << "batches of 16, 256, 4096, 65536" << endl;
+  {
+    // queries in random order, so neighboring lookups share nothing
+    vector<int> order;
+    for (int i = 0; i < bulk_keys.size(); ++i)
+      order.push_back(bulk_keys[i]);
+    shuffle(order.begin(), order.end(), mt19937(17));
+    ArraySeq<int> queries;
+    for (int key : order)
+      queries.insert(key, queries.size());
+    batch_row("chained", chained, queries);
+  }
+
+  // ordered queries scanning every bucket vs using the ordered index
+  cout << "# ordered queries over " << bulk_n << " keys (usec/query): "
+       << "next_key scan, find_range scan, index rebuild, "
+       << "next_key index, find_range index" << endl;
+  ordered_row(chained, bulk_keys);
+
+  // hash policies on the shuffled even keys and on multiples of 1024
+  const int policy_n = bulk_n / 2;
+  ArraySeq<int> spaced_keys;
+  for (int i = 0; i < policy_n; ++i)
+    spaced_keys.insert(bulk_keys[i] * 512, i);
+  cout << "# hash policies over " << policy_n << " keys: insert msec, "
+       << "contains msec, max chain, then the number of buckets holding "
+       << "0, 1, 2, ... keys" << endl;
+  policy_row<StdHash>("even std", bulk_keys, policy_n);
+  policy_row<FibonacciHash>("even fibonacci", bulk_keys, policy_n);
+  policy_row<WyHash>("even wyhash", bulk_keys, policy_n);
+  policy_row<StdHash>("x1024 std", spaced_keys, policy_n);
+  policy_row<FibonacciHash>("x1024 fibonacci", spaced_keys, policy_n);
+  policy_row<WyHash>("x1024 wyhash", spaced_keys, policy_n);
+
+  // string keys and values copied, moved, and emplaced (comment lines
+  // so the plot script skips them)
+  cout << "# string load over " << string_n << " keys: copy msec, "
+       << "copy allocs/insert, move msec, move allocs/insert, "
+       << "try_emplace msec, try_emplace allocs/insert" << endl;
+  string_row<HashMap<string,string>>("heap", bulk_keys, string_n);
+  string_row<HashMap<string,string,PoolAlloc>>("pool", bulk_keys, string_n);
+
 }
 
 
@@ -251,6 +394,199 @@ double timed_sorted_keys(const Map<int,int>& m)
   return (total/1000) / runs;
 }
 
+// inserts every key (in the given order) into an empty map
+double bulk_insert(Map<int,int>& m, const ArraySeq<int>& keys)
+{
+  int n = keys.size();
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    m.insert(keys[i], i);
+  auto t1 = high_resolution_clock::now();
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// looks up every key, half of which hit (even) and half miss (odd)
+double bulk_contains(const Map<int,int>& m, const ArraySeq<int>& keys)
+{
+  int n = keys.size();
+  int found = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    found += m.contains(keys[i] + (i % 2));
+  auto t1 = high_resolution_clock::now();
+  assert(found == (n + 1) / 2);
+  return duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+}
+
+// times each insert separately and prints latency percentiles
+void insert_latencies(Map<int,int>& m, const ArraySeq<int>& keys)
+{
+  int n = keys.size();
+  vector<double> times(n);
+  for (int i = 0; i < n; ++i) {
+    auto t0 = high_resolution_clock::now();
+    m.insert(keys[i], i);
+    auto t1 = high_resolution_clock::now();
+    times[i] = duration_cast<nanoseconds>(t1 - t0).count() / 1000.0;
+  }
+  std::sort(times.begin(), times.end());
+  cout << times[n / 2] << " " << times[(long)n * 99 / 100] << " "
+       << times[(long)n * 999 / 1000] << " " << times[n - 1] << endl;
+}
+
+// loads the keys, erases and reinserts every other key, and clears
+// the map, printing the three times and the allocation counts
+template<typename M>
+void alloc_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  M m;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    m.insert(keys[i], keys[i]);
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < n; i += 2)
+    m.erase(keys[i]);
+  for (int i = 0; i < n; i += 2)
+    m.insert(keys[i], keys[i]);
+  auto t2 = high_resolution_clock::now();
+  m.clear();
+  auto t3 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t3 - t2).count() / 1000.0 << " "
+       << m.alloc_stats().nodes << " " << m.alloc_stats().system << endl;
+}
+
+// loads n string keys with 40 character values three ways: copied
+// from const references, moved in, and with try_emplace building the
+// value from its arguments. Prints the time (msec) and the heap
+// allocations per insert of each.
+template<typename M>
+void string_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  vector<string> key_strs, val_strs;
+  for (int i = 0; i < n; ++i) {
+    key_strs.push_back("string key number " + to_string(keys[i]));
+    val_strs.push_back(string(40, 'a' + i % 26));
+  }
+  cout << "# " << label;
+  for (int mode = 0; mode < 3; ++mode) {
+    vector<string> ks = key_strs;
+    vector<string> vs = val_strs;
+    M m;
+    long a0 = heap_allocs;
+    auto t0 = high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+      if (mode == 0)
+        m.insert(ks[i], vs[i]);
+      else if (mode == 1)
+        m.insert(std::move(ks[i]), std::move(vs[i]));
+      else
+        m.try_emplace(ks[i], 40, 'a' + i % 26);
+    }
+    auto t1 = high_resolution_clock::now();
+    long a1 = heap_allocs;
+    assert(m.size() == n);
+    cout << " " << duration_cast<microseconds>(t1 - t0).count() / 1000.0
+         << " " << (a1 - a0) / (double) n;
+  }
+  cout << endl;
+}
+
+// looks every key up with contains, then with contains_many in
+// batches of each size, printing the times (msec)
+template<typename M>
+void batch_row(const string& label, const M& m, const ArraySeq<int>& keys)
+{
+  long found = 0;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < keys.size(); ++i)
+    found += m.contains(keys[i]);
+  auto t1 = high_resolution_clock::now();
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0;
+  for (int size = 16; size <= 65536; size *= 16) {
+    vector<ArraySeq<int>> batches;
+    for (int i = 0; i < keys.size(); i += size) {
+      batches.push_back(ArraySeq<int>());
+      for (int j = i; j < i + size && j < keys.size(); ++j)
+        batches.back().insert(keys[j], j - i);
+    }
+    auto t2 = high_resolution_clock::now();
+    for (const ArraySeq<int>& batch : batches) {
+      ArraySeq<bool> results = m.contains_many(batch);
+      for (int j = 0; j < results.size(); ++j)
+        found -= results[j];
+    }
+    auto t3 = high_resolution_clock::now();
+    cout << " " << duration_cast<microseconds>(t3 - t2).count() / 1000.0;
+  }
+  cout << endl;
+  assert(found == -3L * keys.size());
+}
 
 
+// times next_key and 100-key find_keys queries on m, first scanning
+// the buckets and then with the ordered index (the first indexed
+// query, which builds the index, is timed on its own)
+void ordered_row(HashMap<int,int>& m, const ArraySeq<int>& keys)
+{
+  const int scan_queries = 5;
+  const int index_queries = 100000;
+  long found = 0;
+  int next = 0;
+  m.ordered_index(false);
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < scan_queries; ++i)
+    found += m.next_key(keys[i], next);
+  auto t1 = high_resolution_clock::now();
+  for (int i = 0; i < scan_queries; ++i)
+    found += m.find_keys(keys[i], keys[i] + 198).size();
+  auto t2 = high_resolution_clock::now();
+  cout << "# " << duration_cast<nanoseconds>(t1 - t0).count() / 1000.0 / scan_queries
+       << " " << duration_cast<nanoseconds>(t2 - t1).count() / 1000.0 / scan_queries;
+  m.ordered_index(true);
+  t0 = high_resolution_clock::now();
+  found += m.next_key(keys[0], next);
+  t1 = high_resolution_clock::now();
+  cout << " " << duration_cast<nanoseconds>(t1 - t0).count() / 1000.0;
+  t0 = high_resolution_clock::now();
+  for (int i = 0; i < index_queries; ++i)
+    found += m.next_key(keys[i], next);
+  t1 = high_resolution_clock::now();
+  for (int i = 0; i < index_queries; ++i)
+    found += m.find_keys(keys[i], keys[i] + 198).size();
+  t2 = high_resolution_clock::now();
+  cout << " " << duration_cast<nanoseconds>(t1 - t0).count() / 1000.0 / index_queries
+       << " " << duration_cast<nanoseconds>(t2 - t1).count() / 1000.0 / index_queries
+       << endl;
+  m.ordered_index(false);
+  assert(found > 0);
+}
 
+
+// loads and looks up the first n keys with the given hash policy and
+// prints the timings and the chain-length histogram
+template<template<typename> class Hash>
+void policy_row(const string& label, const ArraySeq<int>& keys, int n)
+{
+  HashMap<int,int,HeapAlloc,Hash> m;
+  auto t0 = high_resolution_clock::now();
+  for (int i = 0; i < n; ++i)
+    m.insert(keys[i], i);
+  auto t1 = high_resolution_clock::now();
+  long found = 0;
+  for (int i = 0; i < n; ++i)
+    found += m.contains(keys[i]);
+  auto t2 = high_resolution_clock::now();
+  assert(found == n);
+  cout << "# " << label << " "
+       << duration_cast<microseconds>(t1 - t0).count() / 1000.0 << " "
+       << duration_cast<microseconds>(t2 - t1).count() / 1000.0 << " "
+       << m.max_chain_length();
+  ArraySeq<int> histogram = m.chain_histogram();
+  for (int i = 0; i < histogram.size(); ++i)
+    cout << " " << histogram[i];
+  cout << endl;
+}
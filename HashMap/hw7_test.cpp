@@ -7,9 +7,15 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
 #include <gtest/gtest.h>
 #include "arrayseq.h"
 #include "hashmap.h"
+#include "flathashmap.h"
+#include "concurrenthashmap.h"
+#include "lockfreehashmap.h"
 
 using namespace std;
 
@@ -233,6 +239,50 @@ TEST(BasicHashMapTests, ResizeRehashCheck)
   }
 }
 
+TEST(BasicHashMapTests, IncrementalRehashCheck)
+{
+  int n = 1000;
+  HashMap<int,int> m(true);
+  for (int i = 1; i <= n; ++i) {
+    m.insert(i, i*10);
+    // every key so far must be visible while buckets are moving
+    ASSERT_EQ(true, m.contains(1));
+    ASSERT_EQ(true, m.contains(i));
+    ASSERT_EQ(i*10, m[i]);
+  }
+  ASSERT_EQ(n, m.size());
+  for (int i = 1; i <= n; ++i)
+    ASSERT_EQ(i*10, m[i]);
+  ASSERT_EQ(n, m.sorted_keys().size());
+  ASSERT_EQ(n, m.find_keys(1, n).size());
+}
+
+TEST(BasicHashMapTests, IncrementalRehashEraseCopyCheck)
+{
+  HashMap<int,int> m(true);
+  // 13 inserts cross the 0.75 threshold of 16 buckets
+  for (int i = 0; i < 13; ++i)
+    m.insert(i, i);
+  // copy and erase while the old table is still being drained
+  HashMap<int,int> m2(m);
+  for (int i = 0; i < 13; i += 2)
+    m.erase(i);
+  ASSERT_EQ(6, m.size());
+  ASSERT_EQ(13, m2.size());
+  for (int i = 0; i < 13; ++i) {
+    ASSERT_EQ(i % 2 == 1, m.contains(i));
+    ASSERT_EQ(true, m2.contains(i));
+  }
+  EXPECT_THROW(m.erase(0), std::out_of_range);
+  int k = 0;
+  ASSERT_EQ(true, m.next_key(5, k));
+  ASSERT_EQ(7, k);
+  m.clear();
+  ASSERT_EQ(0, m.size());
+  m.insert(3, 3);
+  ASSERT_EQ(true, m.contains(3));
+}
+
 TEST(BasicHashMapTests, DestructorCheck)
 {
   HashMap<char,int>* m = new HashMap<char,int>;
@@ -393,6 +443,501 @@ TEST(BasicHashMapTests, StatsRandomCheck)
   ASSERT_EQ(1.5, m.avg_chain_length());
 }
 
+TEST(BasicHashMapTests, ChainHistogramCheck)
+{
+  HashMap<int,int> m;
+  ASSERT_EQ(1, m.chain_histogram().size());
+  ASSERT_EQ(16, m.chain_histogram()[0]);
+  for (int i = 0; i < 12; ++i)
+    m.insert(i % 4, i);
+  // 4 chains of 3 keys and 12 empty buckets
+  ArraySeq<int> h = m.chain_histogram();
+  ASSERT_EQ(4, h.size());
+  ASSERT_EQ(12, h[0]);
+  ASSERT_EQ(0, h[1]);
+  ASSERT_EQ(0, h[2]);
+  ASSERT_EQ(4, h[3]);
+}
+
+template<template<typename> class Hash>
+void check_hash_policy(bool incremental)
+{
+  HashMap<long,int,HeapAlloc,Hash> m(incremental);
+  // clustered keys (multiples of 64) and negative keys
+  for (int i = 0; i < 2000; ++i)
+    m.insert((i - 1000) * 64L, i);
+  ASSERT_EQ(2000, m.size());
+  for (int i = 0; i < 2000; ++i) {
+    ASSERT_EQ(true, m.contains((i - 1000) * 64L));
+    ASSERT_EQ(false, m.contains((i - 1000) * 64L + 1));
+    ASSERT_EQ(i, m[(i - 1000) * 64L]);
+  }
+  for (int i = 0; i < 2000; i += 2)
+    m.erase((i - 1000) * 64L);
+  ASSERT_EQ(1000, m.size());
+  ArraySeq<int> h = m.chain_histogram();
+  int keys = 0;
+  for (int i = 0; i < h.size(); ++i)
+    keys += i * h[i];
+  ASSERT_EQ(1000, keys);
+  ASSERT_EQ(h.size() - 1, m.max_chain_length());
+}
+
+TEST(BasicHashMapTests, HashPolicyCheck)
+{
+  check_hash_policy<StdHash>(false);
+  check_hash_policy<FibonacciHash>(false);
+  check_hash_policy<FibonacciHash>(true);
+  check_hash_policy<WyHash>(false);
+  check_hash_policy<WyHash>(true);
+  // multiples of 64 fill 1 bucket in 64 with the identity hash, but
+  // spread out once mixed
+  HashMap<int,int> identity;
+  HashMap<int,int,HeapAlloc,WyHash> mixed;
+  for (int i = 0; i < 1000; ++i) {
+    identity.insert(i * 64, i);
+    mixed.insert(i * 64, i);
+  }
+  ASSERT_GT(identity.max_chain_length(), 10);
+  ASSERT_LT(mixed.max_chain_length(), 10);
+}
+
+//----------------------------------------------------------------------
+// Basic Tests for the FlatHashMap (open addressing) implementation
+//----------------------------------------------------------------------
+
+TEST(BasicFlatHashMapTests, InsertAccessCheck)
+{
+  FlatHashMap<char,int> m;
+  ASSERT_EQ(true, m.empty());
+  m.insert('a', 10);
+  m.insert('b', 20);
+  m.insert('c', 30);
+  ASSERT_EQ(3, m.size());
+  ASSERT_EQ(10, m['a']);
+  ASSERT_EQ(20, m['b']);
+  ASSERT_EQ(30, m['c']);
+  m['b'] = 25;
+  ASSERT_EQ(25, m['b']);
+  ASSERT_EQ(true, m.contains('c'));
+  ASSERT_EQ(false, m.contains('d'));
+}
+
+TEST(BasicFlatHashMapTests, EraseCheck)
+{
+  FlatHashMap<char,int> m;
+  int x = 10;
+  EXPECT_THROW(m.erase('a'), std::out_of_range);
+  EXPECT_THROW(x = m['a'], std::out_of_range);
+  m.insert('a', 10);
+  m.insert('b', 20);
+  m.erase('a');
+  ASSERT_EQ(1, m.size());
+  ASSERT_EQ(false, m.contains('a'));
+  ASSERT_EQ(true, m.contains('b'));
+  EXPECT_THROW(m.erase('a'), std::out_of_range);
+  m.insert('a', 30);
+  ASSERT_EQ(30, m['a']);
+}
+
+TEST(BasicFlatHashMapTests, ResizeRehashCheck)
+{
+  int n = 5000;
+  FlatHashMap<int,int> m;
+  for (int i = 0; i < n; ++i)
+    m.insert(i * 16, i);
+  ASSERT_EQ(n, m.size());
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(true, m.contains(i * 16));
+    ASSERT_EQ(i, m[i * 16]);
+    ASSERT_EQ(false, m.contains(i * 16 + 1));
+  }
+  ASSERT_LE(1, m.max_probe_length());
+}
+
+TEST(BasicFlatHashMapTests, ChurnCheck)
+{
+  // repeated insert/erase fills the table with tombstones
+  FlatHashMap<int,int> m;
+  for (int r = 0; r < 50; ++r) {
+    for (int i = 0; i < 100; ++i)
+      m.insert(r * 1000 + i, i);
+    for (int i = 0; i < 100; i += 2)
+      m.erase(r * 1000 + i);
+  }
+  ASSERT_EQ(50 * 50, m.size());
+  for (int r = 0; r < 50; ++r) {
+    ASSERT_EQ(false, m.contains(r * 1000));
+    ASSERT_EQ(true, m.contains(r * 1000 + 1));
+  }
+}
+
+TEST(BasicFlatHashMapTests, OrderedQueryCheck)
+{
+  FlatHashMap<char,int> m;
+  m.insert('e', 50);
+  m.insert('a', 10);
+  m.insert('c', 30);
+  m.insert('g', 70);
+  ArraySeq<char> k = m.sorted_keys();
+  ASSERT_EQ(4, k.size());
+  ASSERT_EQ('a', k[0]);
+  ASSERT_EQ('g', k[3]);
+  k = m.find_keys('b', 'e');
+  ASSERT_EQ(2, k.size());
+  ASSERT_EQ('c', k[0]);
+  ASSERT_EQ('e', k[1]);
+  char key = 0;
+  ASSERT_EQ(true, m.next_key('c', key));
+  ASSERT_EQ('e', key);
+  ASSERT_EQ(true, m.prev_key('c', key));
+  ASSERT_EQ('a', key);
+  ASSERT_EQ(false, m.next_key('g', key));
+  ASSERT_EQ(false, m.prev_key('a', key));
+}
+
+TEST(BasicFlatHashMapTests, CopyMoveCheck)
+{
+  FlatHashMap<int,int> m1;
+  for (int i = 0; i < 100; ++i)
+    m1.insert(i, i * 2);
+  FlatHashMap<int,int> m2(m1);
+  m2.erase(5);
+  ASSERT_EQ(100, m1.size());
+  ASSERT_EQ(99, m2.size());
+  ASSERT_EQ(true, m1.contains(5));
+  FlatHashMap<int,int> m3(std::move(m1));
+  ASSERT_EQ(0, m1.size());
+  ASSERT_EQ(100, m3.size());
+  m1 = m2;
+  ASSERT_EQ(99, m1.size());
+  ASSERT_EQ(198, m1[99]);
+  m3 = std::move(m1);
+  ASSERT_EQ(99, m3.size());
+  ASSERT_EQ(0, m1.size());
+  m1.insert(1, 1);
+  ASSERT_EQ(1, m1.size());
+}
+
+
+TEST(BasicHashMapTests, PoolAllocCheck)
+{
+  HashMap<int,int,PoolAlloc> m;
+  for (int i = 0; i < 1000; ++i)
+    m.insert(i, i * 2);
+  for (int i = 0; i < 1000; i += 2)
+    m.erase(i);
+  ASSERT_EQ(500, m.size());
+  long slabs = m.alloc_stats().system;
+  for (int i = 0; i < 1000; i += 2)
+    m.insert(i, i * 2);
+  ASSERT_EQ(slabs, m.alloc_stats().system);
+  ASSERT_EQ(1500, m.alloc_stats().nodes);
+  HashMap<int,int,PoolAlloc> m2(m);
+  HashMap<int,int,PoolAlloc> m3(std::move(m));
+  ASSERT_EQ(0, m.size());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(i * 2, m2[i]);
+    ASSERT_EQ(i * 2, m3[i]);
+  }
+  m2.clear();
+  ASSERT_EQ(0, m2.size());
+  m2.insert(5, 6);
+  ASSERT_EQ(6, m2[5]);
+  HashMap<int,std::string,PoolAlloc> m4;
+  m4.insert(1, std::string(40, 'x'));
+  m4.insert(2, std::string(40, 'y'));
+  m4.erase(1);
+  ASSERT_EQ(std::string(40, 'y'), m4[2]);
+}
+
+TEST(BasicHashMapTests, MoveInsertCheck)
+{
+  HashMap<std::string,std::string> m;
+  std::vector<const char*> buffers;
+  for (int i = 0; i < 500; ++i) {
+    std::string value(40, 'a' + (i % 26));
+    buffers.push_back(value.data());
+    m.insert(std::to_string(i), std::move(value));
+  }
+  for (int i = 0; i < 500; ++i)
+    ASSERT_EQ(buffers[i], m[std::to_string(i)].data());
+  ASSERT_EQ(false, m.try_emplace("5", 3, 'z'));
+  ASSERT_EQ(true, m.try_emplace("x", 3, 'z'));
+  ASSERT_EQ("zzz", m["x"]);
+  // hash codes with the top bit set still land inside the table
+  HashMap<long,int> n;
+  for (long i = 1; i <= 100; ++i)
+    n.insert(-i * 1000003, (int) i);
+  for (long i = 1; i <= 100; ++i)
+    ASSERT_EQ(i, n[-i * 1000003]);
+  n.erase(-1000003);
+  ASSERT_EQ(false, n.contains(-1000003));
+}
+
+TEST(BasicHashMapTests, TryEmplaceCheck)
+{
+  // an incremental rehash may be under way when the key is added
+  HashMap<int,std::string> m(true);
+  for (int i = 0; i < 1000; i += 2)
+    m.insert(i, "even");
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i % 2 == 1, m.try_emplace(i, 3, 'z'));
+  ASSERT_EQ(1000, m.size());
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i % 2 == 0 ? "even" : "zzz", m[i]);
+  ASSERT_EQ(false, m.try_emplace(999, 1, 'y'));
+}
+
+TEST(BasicHashMapTests, BatchLookupCheck)
+{
+  // stop partway through an incremental rehash so lookups see both
+  // tables
+  HashMap<int,int> m(true);
+  for (int i = 0; i < 1000; ++i)
+    m.insert((i * 37) % 1000 * 2, i);
+  ArraySeq<int> keys;
+  for (int i = 0; i < 2500; ++i)
+    keys.insert((i * 7919) % 2200 - 100, i);
+  ArraySeq<bool> found = m.contains_many(keys);
+  ArraySeq<int> present;
+  for (int i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(m.contains(keys[i]), found[i]);
+    if (found[i])
+      present.insert(keys[i], present.size());
+  }
+  ArraySeq<int> values = m.get_many(present);
+  for (int i = 0; i < present.size(); ++i)
+    ASSERT_EQ(m[present[i]], values[i]);
+  ASSERT_THROW(m.get_many(keys), std::out_of_range);
+  // maps without their own batch lookup use the one-at-a-time default
+  FlatHashMap<int,int> flat;
+  for (int i = 0; i < 100; ++i)
+    flat.insert(i * 2, i);
+  ArraySeq<bool> flat_found = flat.contains_many(keys);
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(flat.contains(keys[i]), flat_found[i]);
+}
+TEST(BasicHashMapTests, OrderedIndexCheck)
+{
+  HashMap<int,int> m1;
+  HashMap<int,int> m2(true);
+  m2.ordered_index(true);
+  ASSERT_EQ(true, m2.ordered_index());
+  int k1 = 0, k2 = 0;
+  ASSERT_EQ(false, m2.next_key(0, k2));
+  ASSERT_EQ(0, m2.sorted_keys().size());
+  // queries between changes, so the index is rebuilt many times
+  for (int i = 0; i < 300; ++i) {
+    int key = (i * 53) % 301 - 150;
+    m1.insert(key, i);
+    m2.insert(key, i);
+    if (i % 3 == 2) {
+      int old = ((i - 1) * 53) % 301 - 150;
+      m1.erase(old);
+      m2.erase(old);
+    }
+    for (int probe = key - 2; probe <= key + 2; ++probe) {
+      ASSERT_EQ(m1.next_key(probe, k1), m2.next_key(probe, k2));
+      if (m2.next_key(probe, k2))
+        ASSERT_EQ(k1, k2);
+      ASSERT_EQ(m1.prev_key(probe, k1), m2.prev_key(probe, k2));
+      if (m2.prev_key(probe, k2))
+        ASSERT_EQ(k1, k2);
+    }
+    ArraySeq<int> r1 = m1.find_keys(key - 20, key + 20);
+    ArraySeq<int> r2 = m2.find_keys(key - 20, key + 20);
+    r1.sort();
+    ASSERT_EQ(r1.size(), r2.size());
+    for (int j = 0; j < r1.size(); ++j)
+      ASSERT_EQ(r1[j], r2[j]);
+  }
+  ArraySeq<int> s1 = m1.sorted_keys();
+  HashMap<int,int> copy = m2;
+  ArraySeq<int> s2 = copy.sorted_keys();
+  ASSERT_EQ(true, copy.ordered_index());
+  ASSERT_EQ(s1.size(), s2.size());
+  for (int j = 0; j < s1.size(); ++j)
+    ASSERT_EQ(s1[j], s2[j]);
+  HashMap<int,int> moved = std::move(m2);
+  ASSERT_EQ(s1.size(), moved.sorted_keys().size());
+  ASSERT_EQ(0, m2.sorted_keys().size());
+  moved.clear();
+  ASSERT_EQ(false, moved.next_key(-1000, k2));
+}
+
+
+//----------------------------------------------------------------------
+// Basic Tests for the ConcurrentHashMap (sharded) implementation
+//----------------------------------------------------------------------
+
+TEST(BasicConcurrentHashMapTests, MapApiCheck)
+{
+  ConcurrentHashMap<int,int> m(5);
+  ASSERT_EQ(8, m.shard_count());
+  ASSERT_EQ(true, m.empty());
+  for (int i = 0; i < 1000; ++i)
+    m.insert(i * 3, i);
+  ASSERT_EQ(1000, m.size());
+  ASSERT_EQ(true, m.contains(300));
+  ASSERT_EQ(false, m.contains(301));
+  ASSERT_EQ(100, m[300]);
+  m[300] = 7;
+  int value = 0;
+  ASSERT_EQ(true, m.get(300, value));
+  ASSERT_EQ(7, value);
+  ASSERT_EQ(false, m.get(301, value));
+  ASSERT_THROW(m[301], std::out_of_range);
+  ASSERT_THROW(m.erase(301), std::out_of_range);
+  ASSERT_EQ(false, m.try_emplace(300, 1));
+  ASSERT_EQ(true, m.try_emplace(301, 1));
+  m.erase(301);
+  ArraySeq<int> keys = m.sorted_keys();
+  ASSERT_EQ(1000, keys.size());
+  for (int i = 0; i < keys.size(); ++i)
+    ASSERT_EQ(i * 3, keys[i]);
+  ArraySeq<int> range = m.find_keys(10, 20);
+  ASSERT_EQ(3, range.size());
+  ASSERT_EQ(12, range[0]);
+  ASSERT_EQ(18, range[2]);
+  int k = 0;
+  ASSERT_EQ(true, m.next_key(300, k));
+  ASSERT_EQ(303, k);
+  ASSERT_EQ(true, m.prev_key(300, k));
+  ASSERT_EQ(297, k);
+  ASSERT_EQ(false, m.next_key(2997, k));
+  ASSERT_EQ(false, m.prev_key(0, k));
+  ArraySeq<int> some;
+  some.insert(3, 0);
+  some.insert(6, 1);
+  ASSERT_EQ(2, m.get_many(some)[1]);
+  m.clear();
+  ASSERT_EQ(true, m.empty());
+}
+
+TEST(BasicConcurrentHashMapTests, ThreadedCheck)
+{
+  const int threads = 8;
+  const int per_thread = 5000;
+  ConcurrentHashMap<int,int> m(4);
+  std::atomic<int> added{0};
+  std::vector<std::thread> workers;
+  // each thread inserts its own keys, erases every other one, races
+  // the others on try_emplace of shared keys, and reads throughout
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < per_thread; ++i) {
+        int key = i * threads + t;
+        m.insert(key, key);
+        if (i % 2 == 1)
+          m.erase(key - threads);
+        if (m.try_emplace(-1 - i % 1000, t))
+          added++;
+        int value = 0;
+        if (m.get(key, value))
+          EXPECT_EQ(key, value);
+      }
+    });
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+  ASSERT_EQ(1000, added.load());
+  ASSERT_EQ(threads * per_thread / 2 + 1000, m.size());
+  for (int i = 0; i < per_thread; ++i)
+    for (int t = 0; t < threads; ++t)
+      ASSERT_EQ(i % 2 == 1, m.contains(i * threads + t));
+}
+
+
+//----------------------------------------------------------------------
+// Basic Tests for the LockFreeHashMap (split-ordered list)
+//----------------------------------------------------------------------
+
+// every key hashes to the same code, so all pairs share one run
+template<typename K>
+struct CollidingHash
+{
+  std::uint64_t operator()(const K& key) const
+  {
+    return 42;
+  }
+};
+
+TEST(BasicLockFreeHashMapTests, SingleThreadCheck)
+{
+  LockFreeHashMap<int,int> m;
+  ASSERT_EQ(true, m.empty());
+  ASSERT_EQ(2, m.bucket_count());
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(true, m.insert(i, i * 10));
+  ASSERT_EQ(false, m.insert(7, 0));
+  ASSERT_EQ(1000, m.size());
+  // doubled up to the first count holding 1000 pairs at load 2
+  ASSERT_EQ(512, m.bucket_count());
+  for (int i = 0; i < 1000; i += 2)
+    ASSERT_EQ(true, m.erase(i));
+  ASSERT_EQ(false, m.erase(0));
+  ASSERT_EQ(false, m.erase(1000));
+  ASSERT_EQ(500, m.size());
+  for (int i = 0; i < 1000; ++i) {
+    int value = -1;
+    ASSERT_EQ(i % 2 == 1, m.contains(i));
+    ASSERT_EQ(i % 2 == 1, m.get(i, value));
+    ASSERT_EQ(i % 2 == 1 ? i * 10 : -1, value);
+  }
+  LockFreeHashMap<std::string,int,CollidingHash> c;
+  ASSERT_EQ(true, c.insert("a", 1));
+  ASSERT_EQ(true, c.insert("b", 2));
+  ASSERT_EQ(false, c.insert("a", 3));
+  ASSERT_EQ(true, c.erase("a"));
+  int value = 0;
+  ASSERT_EQ(false, c.contains("a"));
+  ASSERT_EQ(true, c.get("b", value));
+  ASSERT_EQ(2, value);
+}
+
+TEST(BasicLockFreeHashMapTests, StressCheck)
+{
+  const int threads = 8;
+  const int per_thread = 20000;
+  const int keys = 512;
+  LockFreeHashMap<int,int> m;
+  // net successful inserts minus erases of each key
+  std::vector<std::atomic<int>> net(keys);
+  for (std::atomic<int>& n : net)
+    n.store(0);
+  std::vector<std::thread> workers;
+  // all threads churn one small key range, so inserts, erases, and
+  // unlinks of the same nodes race, as do the bucket splits
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      unsigned seed = t + 1;
+      for (int i = 0; i < per_thread; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 8) % keys;
+        if ((seed >> 4) % 2 == 0) {
+          if (m.insert(key, key + 1))
+            net[key]++;
+        }
+        else if (m.erase(key))
+          net[key]--;
+        int value = 0;
+        if (m.get(key, value))
+          EXPECT_EQ(key + 1, value);
+      }
+    });
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+  int total = 0;
+  for (int key = 0; key < keys; ++key) {
+    ASSERT_EQ(true, net[key] == 0 || net[key] == 1);
+    ASSERT_EQ(net[key] == 1, m.contains(key));
+    total += net[key];
+  }
+  ASSERT_EQ(total, m.size());
+}
+
 
 //----------------------------------------------------------------------
 // Main
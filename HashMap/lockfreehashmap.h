@@ -0,0 +1,469 @@
+//---------------------------------------------------------------------------
+// NAME: Samuel Sovi
+// FILE: lockfreehashmap.h
+// DATE: Spring 2022
+// DESC: A lock-free hash map built on a split-ordered list (Shalev and
+//       Shavit). All the pairs live in one sorted linked list, ordered
+//       by the bit-reversed hash code, so the pairs of any bucket are
+//       a contiguous run of the list no matter how many buckets there
+//       are. Each bucket points at a dummy node placed at the start of
+//       its run. Growing the table just doubles the bucket count: a
+//       new bucket is created lazily, the first time it is used, by
+//       splicing its dummy into its parent bucket's run, so no pair
+//       ever moves. Links are changed with compare-and-swap, erased
+//       nodes are marked in the low bit of their next pointer before
+//       being unlinked (Harris and Michael), and unlinked nodes are
+//       freed through epoch-based reclamation (see epoch.h).
+//---------------------------------------------------------------------------
+
+#ifndef LOCKFREEHASHMAP_H
+#define LOCKFREEHASHMAP_H
+
+#include <atomic>
+#include <cstdint>
+#include "hashpolicy.h"
+#include "epoch.h"
+
+
+// Not a Map<K,V>: V& access and the ordered queries have no lock-free
+// meaning, so the map offers the operations below, all of which are
+// safe to call from any number of threads at once. Values are copied
+// in on insert and copied out by get; a stored value never changes.
+// Hash defaults to FibonacciHash rather than the identity: if keys
+// leave some buckets untouched while the list grows (say, only even
+// integers), the first use of such a bucket walks the whole list from
+// its parent's dummy to splice in its own.
+template<typename K, typename V, template<typename> class Hash = FibonacciHash>
+class LockFreeHashMap
+{
+public:
+
+  // default constructor (two buckets, grown as pairs are added)
+  LockFreeHashMap();
+
+  // nodes are shared with other threads, so the map cannot be copied
+  LockFreeHashMap(const LockFreeHashMap& rhs) = delete;
+  LockFreeHashMap& operator=(const LockFreeHashMap& rhs) = delete;
+
+  // destructor. Must not run while other threads use the map.
+  ~LockFreeHashMap();
+
+  // Returns the number of key-value pairs in the map (exact once
+  // writers have finished)
+  int size() const;
+
+  // Tests if the map is empty (with the same caveat as size)
+  bool empty() const;
+
+  // Adds the key-value pair unless the key is already in the
+  // collection. Returns true if the pair was added.
+  bool insert(const K& key, const V& value);
+
+  // Removes the pair with the given key. Returns true if it was in the
+  // collection (and this call removed it).
+  bool erase(const K& key);
+
+  // Returns true if the key is in the collection, and false otherwise.
+  bool contains(const K& key) const;
+
+  // Copies the value of the key into value. Returns false (leaving
+  // value alone) if the key is not in the collection.
+  bool get(const K& key, V& value) const;
+
+  // Returns the number of buckets the table has grown to
+  int bucket_count() const;
+
+private:
+
+  // a list node. Dummy nodes have an even split-order key and no
+  // pair; regular nodes have an odd one. The low bit of next marks
+  // the node as erased.
+  struct Node {
+    std::uint64_t so_key;
+    K key;
+    V value;
+    std::atomic<Node*> next;
+  };
+
+  // where a search stopped: the link to change to insert before the
+  // key's run, and the link to the matching node when one was found
+  struct Window {
+    std::atomic<Node*>* ins_prev;
+    Node* ins_next;
+    std::atomic<Node*>* prev;
+    Node* curr;
+  };
+
+  // buckets live in segments that double in size: segment 0 holds
+  // bucket 0, and segment s > 0 holds buckets [2^(s-1), 2^s)
+  static const int SEGMENTS = 31;
+
+  // average pairs per bucket before the bucket count doubles
+  static const int LOAD_FACTOR = 2;
+
+  mutable std::atomic<std::atomic<Node*>*> segments[SEGMENTS];
+
+  std::atomic<int> buckets{2};
+
+  std::atomic<int> count{0};
+
+  // helper functions for the marked next pointers
+  static bool is_marked(Node* ptr);
+  static Node* marked(Node* ptr);
+  static Node* unmarked(Node* ptr);
+
+  // split-order keys: a regular key is the reversed hash code with
+  // the low bit set, and a bucket's dummy key is the reversed bucket
+  // index, so a dummy sorts just before the pairs of its bucket
+  static std::uint64_t reverse(std::uint64_t code);
+  static std::uint64_t regular_key(std::uint64_t code);
+  static std::uint64_t dummy_key(int bucket);
+
+  // deleter handed to the epoch domain
+  static void delete_node(void* node);
+
+  // returns the bucket's slot, allocating its segment if needed
+  std::atomic<Node*>& bucket_slot(int bucket) const;
+
+  // returns the dummy node of the bucket, creating it if needed
+  Node* bucket_head(int bucket) const;
+
+  // splices the bucket's dummy into its parent bucket's run
+  void initialize_bucket(int bucket) const;
+
+  // Searches from start for the node with the split-order key and
+  // (for regular nodes) the key, unlinking marked nodes on the way.
+  // Returns true if it was found.
+  bool find(Node* start, std::uint64_t so_key, const K* key, Window& w) const;
+
+  // doubles the bucket count once the load factor is exceeded
+  void grow(int pairs);
+
+};
+
+
+template<typename K, typename V, template<typename> class Hash>
+LockFreeHashMap<K,V,Hash>::LockFreeHashMap()
+{
+  for(int s = 0; s < SEGMENTS; ++s)
+  {
+    segments[s].store(nullptr);
+  }
+  Node* head = new Node{dummy_key(0), K(), V(), {nullptr}};
+  bucket_slot(0).store(head);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+LockFreeHashMap<K,V,Hash>::~LockFreeHashMap()
+{
+  // every node still linked (marked or not) is freed here; nodes
+  // already unlinked belong to the epoch domain
+  Node* curr = bucket_slot(0).load();
+  while(curr != nullptr)
+  {
+    Node* next = unmarked(curr -> next.load());
+    delete curr;
+    curr = next;
+  }
+  for(int s = 0; s < SEGMENTS; ++s)
+  {
+    delete[] segments[s].load();
+  }
+}
+
+template<typename K, typename V, template<typename> class Hash>
+int LockFreeHashMap<K,V,Hash>::size() const
+{
+  return count.load();
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::empty() const
+{
+  return size() == 0;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::insert(const K& key, const V& value)
+{
+  EpochGuard guard;
+  std::uint64_t code = Hash<K>()(key);
+  std::uint64_t so_key = regular_key(code);
+  Node* head = bucket_head(code & (buckets.load() - 1));
+  Node* node = new Node{so_key, key, value, {nullptr}};
+  Window w;
+  while(true)
+  {
+    if(find(head, so_key, &key, w))
+    {
+      // never published, so no other thread can hold it
+      delete node;
+      return false;
+    }
+    // linking in front of the key's run means two racing inserts of
+    // the same key swap the same link, and the loser finds the winner
+    node -> next.store(w.ins_next);
+    if(w.ins_prev -> compare_exchange_strong(w.ins_next, node))
+    {
+      break;
+    }
+  }
+  grow(count.fetch_add(1) + 1);
+  return true;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::erase(const K& key)
+{
+  EpochGuard guard;
+  std::uint64_t code = Hash<K>()(key);
+  std::uint64_t so_key = regular_key(code);
+  Node* head = bucket_head(code & (buckets.load() - 1));
+  Window w;
+  while(true)
+  {
+    if(!find(head, so_key, &key, w))
+    {
+      return false;
+    }
+    // the mark is the linearization point: whoever sets it erased
+    // the key
+    Node* next = w.curr -> next.load();
+    if(is_marked(next) || !w.curr -> next.compare_exchange_strong(next, marked(next)))
+    {
+      continue;
+    }
+    Node* expected = w.curr;
+    if(w.prev -> compare_exchange_strong(expected, next))
+    {
+      EpochDomain::global().retire(w.curr, delete_node);
+    }
+    else
+    {
+      // the link changed under us; a search unlinks (and retires) it
+      find(head, so_key, &key, w);
+    }
+    count.fetch_sub(1);
+    return true;
+  }
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::contains(const K& key) const
+{
+  EpochGuard guard;
+  std::uint64_t code = Hash<K>()(key);
+  Window w;
+  return find(bucket_head(code & (buckets.load() - 1)), regular_key(code), &key, w);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::get(const K& key, V& value) const
+{
+  EpochGuard guard;
+  std::uint64_t code = Hash<K>()(key);
+  Window w;
+  if(!find(bucket_head(code & (buckets.load() - 1)), regular_key(code), &key, w))
+  {
+    return false;
+  }
+  value = w.curr -> value;
+  return true;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+int LockFreeHashMap<K,V,Hash>::bucket_count() const
+{
+  return buckets.load();
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::is_marked(Node* ptr)
+{
+  return reinterpret_cast<std::uintptr_t>(ptr) & 1;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+typename LockFreeHashMap<K,V,Hash>::Node* LockFreeHashMap<K,V,Hash>::marked(Node* ptr)
+{
+  return reinterpret_cast<Node*>(reinterpret_cast<std::uintptr_t>(ptr) | 1);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+typename LockFreeHashMap<K,V,Hash>::Node* LockFreeHashMap<K,V,Hash>::unmarked(Node* ptr)
+{
+  return reinterpret_cast<Node*>(reinterpret_cast<std::uintptr_t>(ptr) & ~(std::uintptr_t) 1);
+}
+
+// swaps ever smaller halves: 32-bit halves, then 16-bit quarters, and
+// so on down to single bits
+template<typename K, typename V, template<typename> class Hash>
+std::uint64_t LockFreeHashMap<K,V,Hash>::reverse(std::uint64_t code)
+{
+  code = (code >> 32) | (code << 32);
+  code = ((code >> 16) & 0x0000ffff0000ffffull) | ((code & 0x0000ffff0000ffffull) << 16);
+  code = ((code >> 8) & 0x00ff00ff00ff00ffull) | ((code & 0x00ff00ff00ff00ffull) << 8);
+  code = ((code >> 4) & 0x0f0f0f0f0f0f0f0full) | ((code & 0x0f0f0f0f0f0f0f0full) << 4);
+  code = ((code >> 2) & 0x3333333333333333ull) | ((code & 0x3333333333333333ull) << 2);
+  code = ((code >> 1) & 0x5555555555555555ull) | ((code & 0x5555555555555555ull) << 1);
+  return code;
+}
+
+// the top bit of the code (never part of a bucket index) gives way to
+// the regular-node bit
+template<typename K, typename V, template<typename> class Hash>
+std::uint64_t LockFreeHashMap<K,V,Hash>::regular_key(std::uint64_t code)
+{
+  return reverse(code) | 1;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+std::uint64_t LockFreeHashMap<K,V,Hash>::dummy_key(int bucket)
+{
+  return reverse(bucket);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+void LockFreeHashMap<K,V,Hash>::delete_node(void* node)
+{
+  delete static_cast<Node*>(node);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+std::atomic<typename LockFreeHashMap<K,V,Hash>::Node*>&
+LockFreeHashMap<K,V,Hash>::bucket_slot(int bucket) const
+{
+  int s = bucket == 0 ? 0 : 32 - __builtin_clz(bucket);
+  int first = s == 0 ? 0 : 1 << (s - 1);
+  std::atomic<Node*>* segment = segments[s].load();
+  if(segment == nullptr)
+  {
+    int length = s == 0 ? 1 : 1 << (s - 1);
+    std::atomic<Node*>* fresh = new std::atomic<Node*>[length];
+    for(int i = 0; i < length; ++i)
+    {
+      fresh[i].store(nullptr, std::memory_order_relaxed);
+    }
+    if(segments[s].compare_exchange_strong(segment, fresh))
+    {
+      segment = fresh;
+    }
+    else
+    {
+      // another thread installed the segment first
+      delete[] fresh;
+    }
+  }
+  return segment[bucket - first];
+}
+
+template<typename K, typename V, template<typename> class Hash>
+typename LockFreeHashMap<K,V,Hash>::Node* LockFreeHashMap<K,V,Hash>::bucket_head(int bucket) const
+{
+  std::atomic<Node*>& slot = bucket_slot(bucket);
+  if(slot.load() == nullptr)
+  {
+    initialize_bucket(bucket);
+  }
+  return slot.load();
+}
+
+// the parent is the bucket with the top bit cleared: before the last
+// doubling, the new bucket's pairs all lived in the parent's run
+template<typename K, typename V, template<typename> class Hash>
+void LockFreeHashMap<K,V,Hash>::initialize_bucket(int bucket) const
+{
+  int parent = bucket & ~(1 << (31 - __builtin_clz(bucket)));
+  Node* start = bucket_head(parent);
+  std::uint64_t so_key = dummy_key(bucket);
+  Node* dummy = new Node{so_key, K(), V(), {nullptr}};
+  Window w;
+  while(true)
+  {
+    if(find(start, so_key, nullptr, w))
+    {
+      // another thread spliced the dummy in first
+      delete dummy;
+      dummy = w.curr;
+      break;
+    }
+    dummy -> next.store(w.ins_next);
+    if(w.ins_prev -> compare_exchange_strong(w.ins_next, dummy))
+    {
+      break;
+    }
+  }
+  // racing initializers all store the one dummy in the list
+  bucket_slot(bucket).store(dummy);
+}
+
+template<typename K, typename V, template<typename> class Hash>
+bool LockFreeHashMap<K,V,Hash>::find(Node* start, std::uint64_t so_key, const K* key,
+                                     Window& w) const
+{
+retry:
+  // dummies are never erased, so the start link is never marked
+  std::atomic<Node*>* prev = &start -> next;
+  Node* curr = prev -> load();
+  bool placed = false;
+  while(curr != nullptr)
+  {
+    Node* next = curr -> next.load();
+    if(is_marked(next))
+    {
+      // curr was erased: unlink it, and start over if prev changed
+      // (or was itself erased) in the meantime
+      Node* expected = curr;
+      if(!prev -> compare_exchange_strong(expected, unmarked(next)))
+      {
+        goto retry;
+      }
+      EpochDomain::global().retire(curr, delete_node);
+      curr = unmarked(next);
+      continue;
+    }
+    if(curr -> so_key > so_key)
+    {
+      break;
+    }
+    if(curr -> so_key == so_key)
+    {
+      // regular keys sharing a hash code form a run in no particular
+      // order; a dummy's key is unique
+      if(!placed)
+      {
+        w.ins_prev = prev;
+        w.ins_next = curr;
+        placed = true;
+      }
+      if(key == nullptr || curr -> key == *key)
+      {
+        w.prev = prev;
+        w.curr = curr;
+        return true;
+      }
+    }
+    prev = &curr -> next;
+    curr = next;
+  }
+  if(!placed)
+  {
+    w.ins_prev = prev;
+    w.ins_next = curr;
+  }
+  return false;
+}
+
+template<typename K, typename V, template<typename> class Hash>
+void LockFreeHashMap<K,V,Hash>::grow(int pairs)
+{
+  int current = buckets.load();
+  if(current < (1 << (SEGMENTS - 1)) && pairs > current * LOAD_FACTOR)
+  {
+    // only one racing thread doubles; new buckets fill in lazily
+    buckets.compare_exchange_strong(current, current * 2);
+  }
+}
+
+
+#endif
@@ -16,9 +16,14 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <utility>
+
 #include "arrayseq.h"
 
 
+// The concrete maps are final, so code that holds one by its own type
+// calls its members directly, while code holding a Map<K,V>& goes
+// through the vtable.
 template<typename K, typename V>
 class Map
 {
@@ -45,6 +50,14 @@ public:
   // Expects key to not exist in map prior to insertion.
   virtual void insert(const K& key, const V& value) = 0;
 
+  // Extends the collection by adding the given key-value pair, moving
+  // from the key and value. Expects key to not exist in map prior to
+  // insertion. The default copies them; maps override it to move.
+  virtual void insert(K&& key, V&& value)
+  {
+    insert(static_cast<const K&>(key), static_cast<const V&>(value));
+  }
+
   // Shrinks the collection by removing the key-value pair with the
   // given key. Does not modify the collection if the collection does
   // not contain the key. Throws out_of_range if the given key is not
@@ -54,6 +67,27 @@ public:
   // Returns true if the key is in the collection, and false otherwise.
   virtual bool contains(const K& key) const = 0;
 
+  // Returns whether each of the keys is in the collection (the i-th
+  // result is for keys[i]). The default looks the keys up one at a
+  // time; maps override it to overlap the lookups of a batch.
+  virtual ArraySeq<bool> contains_many(const ArraySeq<K>& keys) const
+  {
+    ArraySeq<bool> found;
+    for(int i = 0; i < keys.size(); i++)
+      found.insert(contains(keys[i]), i);
+    return found;
+  }
+
+  // Returns the values of the keys (the i-th value is for keys[i]).
+  // Throws out_of_range if any key is not in the collection.
+  virtual ArraySeq<V> get_many(const ArraySeq<K>& keys) const
+  {
+    ArraySeq<V> values;
+    for(int i = 0; i < keys.size(); i++)
+      values.insert((*this)[keys[i]], i);
+    return values;
+  }
+
   // Returns the keys k in the collection such that k1 <= k <= k2
   virtual ArraySeq<K> find_keys(const K& k1, const K& k2) const = 0;
 